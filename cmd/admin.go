@@ -0,0 +1,269 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bytes"
+	"crypto/subtle"
+	"fmt"
+	"net"
+	"strconv"
+	"strings"
+	"sync"
+
+	"github.com/CodisLabs/codis/pkg/utils/bytesize"
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+// ServeAdmin serves the admin port of a sync on addr. It speaks RESP, so
+// redis-cli can be used to read stats and to tune a running sync:
+//
+//	AUTH password               with --auth, before any other command
+//	INFO                        counters, stage queue depths and settings
+//	CONFIG GET pattern          ratelimit, parallel and flushsize
+//	CONFIG SET name value       change one of them
+//	PAUSE / RESUME              hold back or restart writes to the targets
+//
+// While paused the master link stays open and the backlog keeps buffering.
+// Without --auth only a loopback addr is accepted.
+func (cmd *cmdSync) ServeAdmin(addr string) {
+	if err := checkAdminAddr(addr, args.auth); err != nil {
+		log.PanicError(err, "serve admin failed")
+	}
+	l, err := net.Listen("tcp", addr)
+	if err != nil {
+		log.PanicErrorf(err, "listen admin on '%s' failed", addr)
+	}
+	defer l.Close()
+	s := newAdminServer(cmd, args.auth)
+	log.Infof("admin listen on '%s'", l.Addr())
+	if err := s.Serve(l); err != nil {
+		log.PanicErrorf(err, "serve admin on '%s' failed", addr)
+	}
+}
+
+// checkAdminAddr refuses to serve the admin port beyond loopback without a
+// password, since it can pause and throttle the sync.
+func checkAdminAddr(addr, auth string) error {
+	if auth != "" {
+		return nil
+	}
+	host, _, err := net.SplitHostPort(addr)
+	if err != nil {
+		return errors.Trace(err)
+	}
+	if host == "localhost" {
+		return nil
+	}
+	if ip := net.ParseIP(host); ip != nil && ip.IsLoopback() {
+		return nil
+	}
+	return errors.Errorf("admin addr '%s' is not loopback, please bind it to 127.0.0.1 or set --auth", addr)
+}
+
+func newAdminServer(cmd *cmdSync, auth string) *redis.Server {
+	h := &adminHandler{cmd: cmd, auth: auth}
+	h.authed = make(map[interface{}]bool)
+	s := redis.MustServer(h)
+	s.MaxConns = 64
+	s.OnClose = func(c net.Conn) {
+		h.mu.Lock()
+		delete(h.authed, c)
+		h.mu.Unlock()
+	}
+	return s
+}
+
+// adminHandler serves the admin commands. With auth set, a connection has to
+// send AUTH before anything but PING.
+type adminHandler struct {
+	cmd  *cmdSync
+	auth string
+
+	mu     sync.Mutex
+	authed map[interface{}]bool
+}
+
+var (
+	errWrongArgs = errors.New("wrong number of arguments")
+	errNoAuth    = errors.New("NOAUTH Authentication required")
+)
+
+func (h *adminHandler) check(arg0 interface{}) error {
+	if h.auth == "" {
+		return nil
+	}
+	h.mu.Lock()
+	defer h.mu.Unlock()
+	if !h.authed[arg0] {
+		return errNoAuth
+	}
+	return nil
+}
+
+func (h *adminHandler) Auth(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	if len(args) != 1 {
+		return nil, errWrongArgs
+	}
+	if h.auth == "" {
+		return nil, errors.New("Client sent AUTH, but no password is set")
+	}
+	ok := subtle.ConstantTimeCompare(args[0], []byte(h.auth)) == 1
+	h.mu.Lock()
+	h.authed[arg0] = ok
+	h.mu.Unlock()
+	if !ok {
+		return nil, errors.New("invalid password")
+	}
+	return redis.NewString("OK"), nil
+}
+
+func (h *adminHandler) Ping(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	return redis.NewString("PONG"), nil
+}
+
+func (h *adminHandler) Pause(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	if err := h.check(arg0); err != nil {
+		return nil, err
+	}
+	targetLimiter.Pause()
+	log.Info("admin: pause writes to target")
+	return redis.NewString("OK"), nil
+}
+
+func (h *adminHandler) Resume(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	if err := h.check(arg0); err != nil {
+		return nil, err
+	}
+	targetLimiter.Resume()
+	log.Info("admin: resume writes to target")
+	return redis.NewString("OK"), nil
+}
+
+func (h *adminHandler) Info(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	if err := h.check(arg0); err != nil {
+		return nil, err
+	}
+	cmd := h.cmd
+	stat := cmd.Stat()
+	received, applied := cmd.received.Get(), cmd.applied.Get()
+
+	var b bytes.Buffer
+	fmt.Fprintf(&b, "# Sync\r\n")
+	fmt.Fprintf(&b, "replid:%s\r\n", cmd.ReplID())
+	fmt.Fprintf(&b, "rbytes:%d\r\n", stat.rbytes)
+	fmt.Fprintf(&b, "wbytes:%d\r\n", stat.wbytes)
+	fmt.Fprintf(&b, "nentry:%d\r\n", stat.nentry)
+	fmt.Fprintf(&b, "ignore:%d\r\n", stat.ignore)
+	fmt.Fprintf(&b, "forward:%d\r\n", stat.forward)
+	fmt.Fprintf(&b, "nbypass:%d\r\n", stat.nbypass)
+	fmt.Fprintf(&b, "received:%d\r\n", received)
+	fmt.Fprintf(&b, "applied:%d\r\n", applied)
+	fmt.Fprintf(&b, "lag:%d\r\n", received-applied)
+
+	cmd.mu.Lock()
+	var backlog, entries, pending int
+	if cmd.backlog != nil {
+		backlog, _ = cmd.backlog.Buffered()
+	}
+	if cmd.entries != nil {
+		entries = len(cmd.entries)
+	}
+	for _, f := range cmd.forwarders {
+		pending += f.Pending()
+	}
+	cmd.mu.Unlock()
+	fmt.Fprintf(&b, "\r\n# Queues\r\n")
+	fmt.Fprintf(&b, "backlog:%d\r\n", backlog)
+	fmt.Fprintf(&b, "entries:%d\r\n", entries)
+	fmt.Fprintf(&b, "workers:%d\r\n", cmd.nworker.Get())
+	fmt.Fprintf(&b, "pending:%d\r\n", pending)
+
+	fmt.Fprintf(&b, "\r\n# Config\r\n")
+	for _, kv := range h.config() {
+		fmt.Fprintf(&b, "%s:%s\r\n", kv[0], kv[1])
+	}
+	fmt.Fprintf(&b, "paused:%d\r\n", bool2int(targetLimiter.Paused()))
+	return redis.NewBulkBytes(b.Bytes()), nil
+}
+
+func bool2int(b bool) int {
+	if b {
+		return 1
+	}
+	return 0
+}
+
+func (h *adminHandler) config() [][2]string {
+	return [][2]string{
+		{"ratelimit", strconv.FormatInt(targetLimiter.Rate(), 10)},
+		{"parallel", strconv.Itoa(h.cmd.Parallel())},
+		{"flushsize", strconv.FormatInt(forwardFlushSize.Get(), 10)},
+	}
+}
+
+func (h *adminHandler) Config(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	if err := h.check(arg0); err != nil {
+		return nil, err
+	}
+	if len(args) == 0 {
+		return nil, errWrongArgs
+	}
+	switch strings.ToLower(string(args[0])) {
+	case "get":
+		if len(args) != 2 {
+			return nil, errWrongArgs
+		}
+		pattern := strings.ToLower(string(args[1]))
+		r := redis.NewArray()
+		for _, kv := range h.config() {
+			if pattern == "*" || pattern == kv[0] {
+				r.AppendBulkBytes([]byte(kv[0]))
+				r.AppendBulkBytes([]byte(kv[1]))
+			}
+		}
+		return r, nil
+	case "set":
+		if len(args) != 3 {
+			return nil, errWrongArgs
+		}
+		name, value := strings.ToLower(string(args[1])), string(args[2])
+		if err := h.set(name, value); err != nil {
+			return nil, err
+		}
+		log.Infof("admin: set %s = %s", name, value)
+		return redis.NewString("OK"), nil
+	}
+	return nil, errors.Errorf("unknown subcommand '%s'", args[0])
+}
+
+func (h *adminHandler) set(name, value string) error {
+	switch name {
+	case "ratelimit":
+		n, err := bytesize.Parse(value)
+		if err != nil || n < 0 {
+			return errors.Errorf("invalid ratelimit '%s'", value)
+		}
+		targetLimiter.SetRate(n)
+	case "parallel":
+		n, err := parseInt(value, 1, 1024)
+		if err != nil {
+			return errors.Errorf("invalid parallel '%s'", value)
+		}
+		if err := h.cmd.SetParallel(n); err != nil {
+			return err
+		}
+	case "flushsize":
+		n, err := bytesize.Parse(value)
+		if err != nil || n < 0 {
+			return errors.Errorf("invalid flushsize '%s'", value)
+		}
+		forwardFlushSize.Set(n)
+	default:
+		return errors.Errorf("unknown config '%s'", name)
+	}
+	return nil
+}
@@ -0,0 +1,100 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"net"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+func TestAdminConfigParallel(t *testing.T) {
+	defer withParallel(4)()
+	cmd := &cmdSync{resize: make(chan struct{}, 1)}
+	h := &adminHandler{cmd: cmd}
+	get := func() string {
+		r, err := h.Config(nil, []byte("get"), []byte("parallel"))
+		assert.MustNoError(err)
+		return string(r.(*redis.Array).Value[1].(*redis.BulkBytes).Value)
+	}
+	assert.Must(get() == "4")
+	_, err := h.Config(nil, []byte("set"), []byte("parallel"), []byte("8"))
+	assert.MustNoError(err)
+	assert.Must(get() == "8")
+
+	for _, v := range []string{"0", "1025", "x"} {
+		_, err = h.Config(nil, []byte("set"), []byte("parallel"), []byte(v))
+		assert.Must(err != nil)
+	}
+	assert.Must(get() == "8")
+
+	cmd = &cmdSync{resize: make(chan struct{}, 1)}
+	cmd.fixed.Set(true)
+	h = &adminHandler{cmd: cmd}
+	_, err = h.Config(nil, []byte("set"), []byte("parallel"), []byte("8"))
+	assert.Must(err != nil)
+	assert.Must(get() == "4")
+}
+
+func TestAdminConfigRefused(t *testing.T) {
+	h := &adminHandler{cmd: &cmdSync{resize: make(chan struct{}, 1)}}
+	for _, args := range [][]string{
+		{}, {"get"}, {"set", "parallel"}, {"set", "unknown", "1"}, {"reset"},
+		{"set", "ratelimit", "-1"}, {"set", "flushsize", "x"},
+	} {
+		var b [][]byte
+		for _, a := range args {
+			b = append(b, []byte(a))
+		}
+		_, err := h.Config(nil, b...)
+		assert.Must(err != nil)
+	}
+}
+
+func TestAdminAddr(t *testing.T) {
+	for _, addr := range []string{"127.0.0.1:6380", "localhost:6380", "[::1]:6380"} {
+		assert.MustNoError(checkAdminAddr(addr, ""))
+	}
+	for _, addr := range []string{":6380", "0.0.0.0:6380", "10.0.0.1:6380", "6380"} {
+		assert.Must(checkAdminAddr(addr, "") != nil)
+	}
+	assert.MustNoError(checkAdminAddr(":6380", "secret"))
+}
+
+func TestAdminAuth(t *testing.T) {
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	defer l.Close()
+	s := newAdminServer(&cmdSync{resize: make(chan struct{}, 1)}, "secret")
+	go s.Serve(l)
+
+	c, err := net.Dial("tcp", l.Addr().String())
+	assert.MustNoError(err)
+	defer c.Close()
+	r := bufio.NewReader(c)
+	do := func(args ...interface{}) redis.Resp {
+		_, err := c.Write(redis.MustEncodeToBytes(redis.NewCommand(args[0].(string), args[1:]...)))
+		assert.MustNoError(err)
+		resp, err := redis.Decode(r)
+		assert.MustNoError(err)
+		return resp
+	}
+	isError := func(resp redis.Resp) bool {
+		_, ok := resp.(*redis.Error)
+		return ok
+	}
+	assert.Must(do("PING").(*redis.String).Value == "PONG")
+	for _, args := range [][]interface{}{
+		{"INFO"}, {"PAUSE"}, {"RESUME"}, {"CONFIG", "SET", "flushsize", "0"}, {"AUTH", "wrong"}, {"INFO"},
+	} {
+		assert.Must(isError(do(args...)))
+	}
+	assert.Must(do("AUTH", "secret").(*redis.String).Value == "OK")
+	assert.Must(!isError(do("CONFIG", "GET", "*")))
+	assert.Must(isError(do("AUTH", "wrong")))
+	assert.Must(isError(do("CONFIG", "GET", "*")))
+}
@@ -0,0 +1,61 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"encoding/json"
+	"io/ioutil"
+	"os"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+)
+
+// checkpoint records how far the replication stream of a master has been
+// applied on the target: Offset is the master offset of the last applied
+// byte and DB is the database selected at that point.
+type checkpoint struct {
+	ReplID string `json:"replid"`
+	Offset int64  `json:"offset"`
+	DB     uint32 `json:"db"`
+}
+
+func loadCheckpoint(name string) *checkpoint {
+	b, err := ioutil.ReadFile(name)
+	if err != nil {
+		if os.IsNotExist(err) {
+			return nil
+		}
+		log.PanicErrorf(err, "read checkpoint '%s' failed", name)
+	}
+	if len(b) == 0 {
+		return nil
+	}
+	cp := &checkpoint{}
+	if err := json.Unmarshal(b, cp); err != nil {
+		log.PanicErrorf(err, "decode checkpoint '%s' failed", name)
+	}
+	if cp.ReplID == "" || cp.Offset < 0 || cp.DB > MaxDB {
+		log.Panicf("invalid checkpoint '%s' = %s", name, b)
+	}
+	return cp
+}
+
+func (cp *checkpoint) Save(name string) error {
+	b, err := json.Marshal(cp)
+	if err != nil {
+		return errors.Trace(err)
+	}
+	tmp := name + ".tmp"
+	if err := ioutil.WriteFile(tmp, b, 0600); err != nil {
+		return errors.Trace(err)
+	}
+	return errors.Trace(os.Rename(tmp, name))
+}
+
+func removeCheckpoint(name string) {
+	if err := os.Remove(name); err != nil && !os.IsNotExist(err) {
+		log.PanicErrorf(err, "remove checkpoint '%s' failed", name)
+	}
+}
@@ -129,8 +129,12 @@ func (cmd *cmdDecode) decoderMain(ipipe <-chan *rdb.BinEntry, opipe chan<- strin
 			log.PanicError(err, "encode to json failed")
 		}
 	}
+	var intern *rdb.Interner
+	if args.intern {
+		intern = rdb.NewInterner()
+	}
 	for e := range ipipe {
-		o, err := rdb.DecodeDump(e.Value)
+		o, err := rdb.DecodeDumpIntern(e.Value, intern)
 		if err != nil {
 			log.PanicError(err, "decode failed")
 		}
@@ -168,7 +172,7 @@ func (cmd *cmdDecode) decoderMain(ipipe <-chan *rdb.BinEntry, opipe chan<- strin
 					Field string `json:"field"`
 					Value string `json:"value"`
 				}{
-					e.DB, "hash", string(e.Key), string(ele.Field), string(ele.Value),
+					e.DB, "hash", string(e.Key), intern.Lookup(ele.Field), string(ele.Value),
 				})
 			}
 		case rdb.Set:
@@ -179,7 +183,7 @@ func (cmd *cmdDecode) decoderMain(ipipe <-chan *rdb.BinEntry, opipe chan<- strin
 					Key    string `json:"key"`
 					Member string `json:"member"`
 				}{
-					e.DB, "dict", string(e.Key), string(mem),
+					e.DB, "dict", string(e.Key), intern.Lookup(mem),
 				})
 			}
 		case rdb.ZSet:
@@ -191,7 +195,7 @@ func (cmd *cmdDecode) decoderMain(ipipe <-chan *rdb.BinEntry, opipe chan<- strin
 					Member string  `json:"member"`
 					Score  float64 `json:"score"`
 				}{
-					e.DB, "zset", string(e.Key), string(ele.Member), ele.Score,
+					e.DB, "zset", string(e.Key), intern.Lookup(ele.Member), ele.Score,
 				})
 			}
 		}
@@ -208,4 +212,8 @@ func (cmd *cmdDecode) decoderMain(ipipe <-chan *rdb.BinEntry, opipe chan<- strin
 		cmd.nentry.Incr()
 		opipe <- b.String()
 	}
+	if intern != nil {
+		log.Infof("decode: intern lookup=%d hits=%d [%3d%%] disabled=%d", intern.Stats.Lookup, intern.Stats.Hits,
+			int(100*intern.HitRatio()), intern.Stats.Disabled)
+	}
 }
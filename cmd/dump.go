@@ -8,10 +8,15 @@ import (
 	"io"
 	"net"
 	"os"
+	"sort"
 	"time"
 
+	"github.com/CodisLabs/codis/pkg/utils/errors"
 	"github.com/CodisLabs/codis/pkg/utils/log"
 	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/libs/stats"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+	"github.com/CodisLabs/redis-port/pkg/redis"
 )
 
 type cmdDump struct {
@@ -28,6 +33,10 @@ func (cmd *cmdDump) Main() {
 
 	log.Infof("dump from '%s' to '%s'\n", from, output)
 
+	if len(args.froms) > 1 && !args.scan {
+		log.Panic("dump from multiple masters requires --scan")
+	}
+
 	var dumpto io.WriteCloser
 	if output != "/dev/stdout" {
 		dumpto = openWriteFile(output)
@@ -36,50 +45,66 @@ func (cmd *cmdDump) Main() {
 		dumpto = os.Stdout
 	}
 
-	master, nsize := cmd.SendCmd(from, args.passwd)
+	if args.scan {
+		writer := bufio.NewWriterSize(dumpto, WriterBufferSize)
+		cmd.DumpScan(args.froms, writer)
+		return
+	}
+
+	master, reader, header := cmd.SendCmd(from, args.passwd)
 	defer master.Close()
 
-	log.Infof("rdb file = %d\n", nsize)
+	nsize := header.size
+	if nsize != 0 {
+		log.Infof("rdb file = %d\n", nsize)
+	} else {
+		log.Info("rdb file = diskless\n")
+	}
 
-	reader := bufio.NewReaderSize(master, ReaderBufferSize)
 	writer := bufio.NewWriterSize(dumpto, WriterBufferSize)
 
-	cmd.DumpRDBFile(reader, writer, nsize)
+	nsize = cmd.DumpRDBFile(header.Reader(reader), writer, nsize)
 
 	if !args.extra {
 		return
 	}
 
+	if header.mark != nil {
+		// a diskless master holds the backlog back until the first ack
+		if _, err := master.Write(redis.MustEncodeToBytes(redis.NewCommand("replconf", "ack", 0))); err != nil {
+			log.PanicError(errors.Trace(err), "write replconf ack failed")
+		}
+	}
+
 	cmd.DumpCommand(reader, writer, nsize)
 }
 
-func (cmd *cmdDump) SendCmd(master, passwd string) (net.Conn, int64) {
-	c, wait := openSyncConn(master, passwd)
-	var nsize int64
-	for nsize == 0 {
-		select {
-		case nsize = <-wait:
-			if nsize == 0 {
-				log.Info("+")
-			}
-		case <-time.After(time.Second):
-			log.Info("-")
-		}
-	}
-	return c, nsize
+func (cmd *cmdDump) SendCmd(master, passwd string) (net.Conn, *bufio.Reader, *rdbHeader) {
+	c, br, wait := openSyncConn(master, passwd)
+	return c, br, waitRdbHeader(wait)
 }
 
-func (cmd *cmdDump) DumpRDBFile(reader *bufio.Reader, writer *bufio.Writer, nsize int64) {
+func (cmd *cmdDump) DumpRDBFile(reader io.Reader, writer *bufio.Writer, nsize int64) int64 {
 	var nread atomic2.Int64
 	wait := make(chan struct{})
 	go func() {
 		defer close(wait)
 		p := make([]byte, WriterBufferSize)
-		for nsize != nread.Get() {
-			nstep := int(nsize - nread.Get())
-			ncopy := int64(iocopy(reader, writer, p, nstep))
-			nread.Add(ncopy)
-			flushWriter(writer)
+		for {
+			n, err := reader.Read(p)
+			if n != 0 {
+				if _, err := writer.Write(p[:n]); err != nil {
+					log.PanicError(err, "write error")
+				}
+				nread.Add(int64(n))
+				flushWriter(writer)
+			}
+			if err == io.EOF {
+				return
+			}
+			if err != nil {
+				log.PanicError(err, "read error")
+			}
 		}
 	}()
 
@@ -90,10 +115,15 @@ func (cmd *cmdDump) DumpRDBFile(reader *bufio.Reader, writer *bufio.Writer, nsiz
 		case <-time.After(time.Second):
 		}
 		n := nread.Get()
-		p := 100 * n / nsize
-		log.Infof("total = %d - %12d [%3d%%]\n", nsize, n, p)
+		if nsize != 0 {
+			p := 100 * n / nsize
+			log.Infof("total = %d - %12d [%3d%%]\n", nsize, n, p)
+		} else {
+			log.Infof("total = %12d\n", n)
+		}
 	}
 	log.Info("dump: rdb done")
+	return nread.Get()
 }
 
 func (cmd *cmdDump) DumpCommand(reader *bufio.Reader, writer *bufio.Writer, nsize int64) {
@@ -112,3 +142,67 @@ func (cmd *cmdDump) DumpCommand(reader *bufio.Reader, writer *bufio.Writer, nsiz
 		log.Infof("dump: total = %d\n", nsize+nread.Get())
 	}
 }
+
+// DumpScan writes an rdb of the keyspace of froms without a fork of the
+// master: dbs are walked in order, each by one SCAN cursor per master, and
+// keys are fetched with PTTL + DUMP in MULTI/EXEC on args.parallel
+// connections. Every key is as of the moment it was fetched, within the
+// logged window. The rdb version is the newest of the masters' DUMPs.
+func (cmd *cmdDump) DumpScan(froms []string, writer *bufio.Writer) {
+	s := newScanner(args.passwd, args.scancount)
+	targets := s.Keyspace(froms)
+	sort.Stable(scanTargetsByDB(targets))
+	version, err := s.DumpVersion(targets)
+	if err != nil {
+		log.PanicErrorf(err, "probe rdb version failed")
+	}
+
+	var nentry, wbytes atomic2.Int64
+	enc := rdb.NewEncoder(stats.NewCountWriter(writer, &wbytes))
+
+	start := time.Now()
+	wait := make(chan struct{})
+	go func() {
+		defer close(wait)
+		var err error
+		if version != 0 {
+			log.Infof("dump: rdb version = %d", version)
+			err = enc.EncodeHeaderVersion(version)
+		} else {
+			err = enc.EncodeHeader()
+		}
+		if err != nil {
+			log.PanicError(err, "write rdb header failed")
+		}
+		for len(targets) != 0 {
+			n := 1
+			for n < len(targets) && targets[n].db == targets[0].db {
+				n++
+			}
+			for e := range s.ScanTargets(targets[:n], args.parallel) {
+				if err := enc.EncodeBinEntry(e); err != nil {
+					log.PanicErrorf(err, "write rdb entry failed, db = %d", e.DB)
+				}
+				nentry.Incr()
+			}
+			targets = targets[n:]
+		}
+		if err := enc.EncodeFooter(); err != nil {
+			log.PanicError(err, "write rdb footer failed")
+		}
+		flushWriter(writer)
+	}()
+
+	for done := false; !done; {
+		select {
+		case <-wait:
+			done = true
+		case <-time.After(time.Second):
+		}
+		stat := s.Stat()
+		log.Infof("scan=%-12d entry=%-12d miss=%-8d total=%d\n", stat.nscan, nentry.Get(), stat.nmiss, wbytes.Get())
+	}
+	end := time.Now()
+	log.Infof("dump: scan done, snapshot window = [%s, %s], %v\n",
+		start.Format("2006-01-02 15:04:05.000"), end.Format("2006-01-02 15:04:05.000"), end.Sub(start))
+}
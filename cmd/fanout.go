@@ -0,0 +1,226 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"fmt"
+	"io"
+	"sync"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/bytesize"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/redis-port/pkg/libs/io/pipe"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+)
+
+// entryQueue is a fifo of rdb entries bounded by the bytes it holds. A single
+// entry larger than the limit is still accepted once the queue is empty.
+type entryQueue struct {
+	mu       sync.Mutex
+	nonempty *sync.Cond
+	nonfull  *sync.Cond
+
+	list   []*rdb.BinEntry
+	size   int64
+	limit  int64
+	closed bool
+}
+
+func newEntryQueue(limit int64) *entryQueue {
+	q := &entryQueue{limit: limit}
+	q.nonempty = sync.NewCond(&q.mu)
+	q.nonfull = sync.NewCond(&q.mu)
+	return q
+}
+
+func entrySize(e *rdb.BinEntry) int64 {
+	return int64(len(e.Key) + len(e.Value))
+}
+
+func (q *entryQueue) Push(e *rdb.BinEntry) {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	for len(q.list) != 0 && q.size+entrySize(e) > q.limit {
+		q.nonfull.Wait()
+	}
+	q.list = append(q.list, e)
+	q.size += entrySize(e)
+	q.nonempty.Signal()
+}
+
+func (q *entryQueue) Pop() *rdb.BinEntry {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	for len(q.list) == 0 && !q.closed {
+		q.nonempty.Wait()
+	}
+	if len(q.list) == 0 {
+		return nil
+	}
+	e := q.list[0]
+	q.list[0], q.list = nil, q.list[1:]
+	q.size -= entrySize(e)
+	q.nonfull.Signal()
+	return e
+}
+
+func (q *entryQueue) Close() {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	q.closed = true
+	q.nonempty.Broadcast()
+}
+
+// fanoutTarget is one of several targets fed from a single master. It has
+// its own restore workers, forwarder, buffers and counters.
+type fanoutTarget struct {
+	addr  string
+	stat  cmdSync
+	queue *entryQueue
+	done  sync.WaitGroup
+
+	r pipe.Reader
+	w pipe.Writer
+	f *forwarder
+}
+
+func (t *fanoutTarget) restore(passwd string, codis bool) {
+	t.done.Add(args.parallel)
+	for i := 0; i < args.parallel; i++ {
+		go func() {
+			defer t.done.Done()
+			c := openRedisConn(t.addr, passwd)
+			defer c.Close()
+			var lastdb uint32 = 0
+			for {
+				e := t.queue.Pop()
+				if e == nil {
+					return
+				}
+				if !acceptDB(e.DB) {
+					t.stat.ignore.Incr()
+					continue
+				}
+				t.stat.nentry.Incr()
+				if e.DB != lastdb {
+					lastdb = e.DB
+					selectDB(c, lastdb)
+				}
+				targetLimiter.Wait(len(e.Key) + len(e.Value))
+				restoreRdbEntry(c, e, codis)
+			}
+		}()
+	}
+}
+
+// SyncFanout parses the rdb once and tees the backlog to several targets. A
+// target only holds the others back once its args.fanoutsize of queued rdb
+// entries, or of buffered backlog, is used up. The backlog is replayed once
+// every target is done with the rdb, and the offset acked to the master is the
+// one applied on the slowest target, which is why --checkpoint is refused.
+func (cmd *cmdSync) SyncFanout(reader *bufio.Reader, targets []string, passwd string, state *psyncState, codis bool, backlog pipe.Reader) {
+	var ts []*fanoutTarget
+	for _, addr := range targets {
+		t := &fanoutTarget{addr: addr}
+		t.queue = newEntryQueue(args.fanoutsize)
+		ts = append(ts, t)
+	}
+
+	if state.resync {
+		for _, t := range ts {
+			t.restore(passwd, codis)
+		}
+		wait := make(chan struct{})
+		go func() {
+			defer close(wait)
+			for e := range newRDBLoader(reader, &cmd.rbytes, args.parallel*32) {
+				for _, t := range ts {
+					t.queue.Push(e)
+				}
+			}
+			for _, t := range ts {
+				t.queue.Close()
+				t.done.Wait()
+			}
+		}()
+
+		for done := false; !done; {
+			select {
+			case <-wait:
+				done = true
+			case <-time.After(time.Second):
+			}
+			var b bytes.Buffer
+			rbytes := cmd.rbytes.Get()
+			if state.nsize != 0 {
+				fmt.Fprintf(&b, "total=%d - %12d [%3d%%]", state.nsize, rbytes, 100*rbytes/state.nsize)
+			} else {
+				fmt.Fprintf(&b, "total=%12d", rbytes)
+			}
+			for _, t := range ts {
+				stat := t.stat.Stat()
+				fmt.Fprintf(&b, "  [%s] entry=%-12d", t.addr, stat.nentry)
+				if stat.ignore != 0 {
+					fmt.Fprintf(&b, " ignore=%-12d", stat.ignore)
+				}
+			}
+			log.Info(b.String())
+		}
+		log.Info("sync rdb done")
+		if s, ok := pipe.GetFlateStats(backlog); ok {
+			log.Infof("backlog deflate: raw = %d, flate = %d, ratio = %.2f, compress = %v, decompress = %v",
+				s.RawBytes, s.FlateSize, s.Ratio(), s.Compress, s.Decompress)
+		}
+	}
+
+	var fs []*forwarder
+	for _, t := range ts {
+		t.r, t.w = pipe.NewRingSize(int(args.fanoutsize))
+		t.f = newForwarder(t.addr, passwd, args.shards, state.offset, state.db, &t.stat.wbytes, &t.stat.forward, &t.stat.nbypass)
+		go t.f.Run(bufio.NewReaderSize(t.r, int(bytesize.MB)))
+		fs = append(fs, t.f)
+	}
+	cmd.WatchForwarders(fs...)
+	go func() {
+		p := make([]byte, bytesize.MB)
+		for {
+			n, err := reader.Read(p)
+			if err != nil && err != io.EOF {
+				log.PanicError(err, "read backlog failed")
+			}
+			for _, t := range ts {
+				if _, err := t.w.Write(p[:n]); err != nil {
+					log.PanicErrorf(err, "write backlog of '%s' failed", t.addr)
+				}
+			}
+			if err == io.EOF {
+				log.Panic("backlog is closed")
+			}
+		}
+	}()
+
+	lstats := make([]*cmdSyncStat, len(ts))
+	for i, t := range ts {
+		lstats[i] = t.stat.Stat()
+	}
+	for {
+		time.Sleep(time.Second)
+		cmd.SaveApplied(fs...)
+		var b bytes.Buffer
+		fmt.Fprintf(&b, "sync: ")
+		for i, t := range ts {
+			nstat, lstat := t.stat.Stat(), lstats[i]
+			offset, _ := t.f.Applied()
+			buffered, _ := t.r.Buffered()
+			fmt.Fprintf(&b, " [%s] +forward=%-6d +nbypass=%-6d +nbytes=%-8d buffered=%-8d applied=%d",
+				t.addr, nstat.forward-lstat.forward, nstat.nbypass-lstat.nbypass, nstat.wbytes-lstat.wbytes,
+				buffered, offset)
+			lstats[i] = nstat
+		}
+		log.Info(b.String())
+	}
+}
@@ -0,0 +1,325 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"net"
+	"strconv"
+	"sync"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/bytesize"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+const (
+	ForwardFlushSize = bytesize.KB * 64
+)
+
+// forwardFlushSize is the number of bytes a forward connection may buffer
+// before it is flushed, 0 flushes after every request. It starts out as
+// ForwardFlushSize and can be changed through the admin port.
+var forwardFlushSize = func() *atomic2.Int64 {
+	n := &atomic2.Int64{}
+	n.Set(ForwardFlushSize)
+	return n
+}()
+
+// Commands whose only key is the first argument. They can be replayed on
+// any connection as long as commands on the same key keep their order,
+// everything else is treated as an ordering barrier.
+var singleKeyCommands = func() map[string]bool {
+	m := make(map[string]bool)
+	for _, s := range []string{
+		"set", "setex", "psetex", "setnx", "setrange", "setbit", "getset", "append",
+		"incr", "decr", "incrby", "decrby", "incrbyfloat",
+		"expire", "pexpire", "expireat", "pexpireat", "persist", "restore",
+		"hset", "hsetnx", "hmset", "hdel", "hincrby", "hincrbyfloat",
+		"lpush", "rpush", "lpushx", "rpushx", "lpop", "rpop", "lset", "lrem", "ltrim", "linsert",
+		"sadd", "srem", "spop",
+		"zadd", "zrem", "zincrby", "zremrangebyscore", "zremrangebyrank", "zremrangebylex",
+		"pfadd", "geoadd",
+	} {
+		m[s] = true
+	}
+	return m
+}()
+
+func isSingleKeyCommand(c *redis.Command) bool {
+	if len(c.Args) < 2 {
+		return false
+	}
+	var b [32]byte
+	name := c.Args[0]
+	if len(name) > len(b) {
+		return false
+	}
+	for i, x := range name {
+		if x >= 'A' && x <= 'Z' {
+			x += 'a' - 'A'
+		}
+		b[i] = x
+	}
+	if singleKeyCommands[string(b[:len(name)])] {
+		return true
+	}
+	return c.Argc == 2 && (c.Is("del") || c.Is("unlink"))
+}
+
+func hashKey(key []byte) uint32 {
+	var h uint32 = 2166136261
+	for _, b := range key {
+		h = (h ^ uint32(b)) * 16777619
+	}
+	return h
+}
+
+// forwardMark is the position in the replication stream, and the db selected
+// there, of a request that is still waiting for its reply.
+type forwardMark struct {
+	offset int64
+	db     uint32
+}
+
+type forwardConn struct {
+	c  net.Conn
+	w  *redis.Writer
+	db uint32
+
+	sent int64
+
+	mu      sync.Mutex
+	cond    *sync.Cond
+	acked   int64
+	pending []forwardMark
+}
+
+func openForwardConn(target, passwd string, wbytes *atomic2.Int64) *forwardConn {
+	c := openNetConn(target, passwd)
+	fc := &forwardConn{c: c}
+	fc.w = redis.NewWriterSize(c, WriterBufferSize, wbytes)
+	fc.cond = sync.NewCond(&fc.mu)
+	go func() {
+		r := bufio.NewReaderSize(c, int(bytesize.KB*64))
+		for {
+			if _, err := redis.Decode(r); err != nil {
+				log.PanicError(err, "read forward reply failed")
+			}
+			fc.mu.Lock()
+			fc.acked++
+			fc.pending = fc.pending[1:]
+			fc.cond.Signal()
+			fc.mu.Unlock()
+		}
+	}()
+	return fc
+}
+
+// write pushes the mark first, a large p goes out right away and its reply
+// may be read before Write returns.
+func (fc *forwardConn) write(p []byte, m forwardMark) {
+	fc.push(m)
+	if _, err := fc.w.Write(p); err != nil {
+		log.PanicError(err, "write command failed")
+	}
+}
+
+func (fc *forwardConn) push(m forwardMark) {
+	fc.mu.Lock()
+	fc.pending = append(fc.pending, m)
+	fc.mu.Unlock()
+	fc.sent++
+}
+
+func (fc *forwardConn) flush() {
+	if fc.w.Buffered() != 0 {
+		flushWriter(fc.w.Writer)
+	}
+}
+
+func (fc *forwardConn) wait() {
+	fc.flush()
+	fc.mu.Lock()
+	for fc.acked < fc.sent {
+		fc.cond.Wait()
+	}
+	fc.mu.Unlock()
+}
+
+// forwarder replays the backlog command stream on one or more target
+// connections. Requests are flushed when the input buffer drains or when a
+// connection has buffered forwardFlushSize bytes. With more than one
+// connection, single-key commands are sharded by key hash, and other
+// commands and MULTI/EXEC blocks wait for every connection to drain.
+//
+// The forwarder also tracks the stream offset of every request in flight, so
+// Applied can tell how far the stream has been answered by the target.
+type forwarder struct {
+	conns  []*forwardConn
+	db     uint32
+	multi  bool
+	bypass bool
+
+	offset int64
+	mstart forwardMark
+
+	mu   sync.Mutex
+	done forwardMark
+
+	forward, nbypass *atomic2.Int64
+}
+
+func newForwarder(target, passwd string, nconn int, offset int64, db uint32, wbytes, forward, nbypass *atomic2.Int64) *forwarder {
+	f := &forwarder{forward: forward, nbypass: nbypass}
+	f.offset, f.db = offset, db
+	f.done = forwardMark{offset, db}
+	f.bypass = !acceptDB(db)
+	for i := 0; i < nconn; i++ {
+		f.conns = append(f.conns, openForwardConn(target, passwd, wbytes))
+	}
+	return f
+}
+
+func (f *forwarder) Run(reader *bufio.Reader) {
+	f.run(redis.NewCommandFramer(reader, 2))
+}
+
+func (f *forwarder) run(decoder *redis.CommandDecoder) {
+	for {
+		c, err := decoder.TryDecode()
+		if err != nil {
+			log.PanicError(err, "decode redis command failed")
+		}
+		if c == nil {
+			for _, fc := range f.conns {
+				fc.flush()
+			}
+			c = decoder.MustDecode()
+		}
+		f.process(c)
+		f.commit()
+	}
+}
+
+func (f *forwarder) commit() {
+	f.mu.Lock()
+	f.done = forwardMark{f.offset, f.db}
+	f.mu.Unlock()
+}
+
+func (f *forwarder) process(c *redis.Command) {
+	m := forwardMark{f.offset, f.db}
+	f.offset += int64(len(c.Raw))
+	if !c.Is("ping") {
+		if c.Is("select") {
+			if c.Argc != 2 {
+				log.Panicf("select command len(args) = %d", c.Argc-1)
+			}
+			s := string(c.Args[1])
+			n, err := parseInt(s, MinDB, MaxDB)
+			if err != nil {
+				log.PanicErrorf(err, "parse db = %s failed", s)
+			}
+			f.bypass = !acceptDB(uint32(n))
+			f.db = uint32(n)
+		}
+		if f.bypass {
+			f.nbypass.Incr()
+			return
+		}
+	}
+	f.forward.Incr()
+	if !c.Is("select") {
+		f.send(c, m)
+	}
+}
+
+// Applied returns the stream offset up to which every request has been
+// answered by the target, and the db selected at that offset.
+func (f *forwarder) Applied() (int64, uint32) {
+	f.mu.Lock()
+	m := f.done
+	f.mu.Unlock()
+	for _, fc := range f.conns {
+		fc.mu.Lock()
+		if len(fc.pending) != 0 && fc.pending[0].offset < m.offset {
+			m = fc.pending[0]
+		}
+		fc.mu.Unlock()
+	}
+	return m.offset, m.db
+}
+
+// Pending returns the number of requests waiting for their replies.
+func (f *forwarder) Pending() int {
+	var n int
+	for _, fc := range f.conns {
+		fc.mu.Lock()
+		n += len(fc.pending)
+		fc.mu.Unlock()
+	}
+	return n
+}
+
+func (f *forwarder) send(c *redis.Command, m forwardMark) {
+	if targetLimiter.Paused() {
+		for _, fc := range f.conns {
+			fc.flush()
+		}
+	}
+	if d := targetLimiter.Reserve(len(c.Raw)); d != 0 {
+		for _, fc := range f.conns {
+			fc.flush()
+		}
+		time.Sleep(d)
+	}
+	var fc = f.conns[0]
+	switch {
+	case f.multi:
+		// a block only counts as applied once EXEC has been answered
+		m = f.mstart
+		if c.Is("exec") || c.Is("discard") {
+			f.multi = false
+			if len(f.conns) != 1 {
+				defer fc.wait()
+			}
+		}
+	case c.Is("multi"):
+		f.multi, f.mstart = true, m
+		if len(f.conns) != 1 {
+			f.barrier()
+		}
+	case len(f.conns) == 1:
+	case isSingleKeyCommand(c):
+		fc = f.conns[hashKey(c.Args[1])%uint32(len(f.conns))]
+	case c.Is("ping"):
+	default:
+		f.barrier()
+		defer fc.wait()
+	}
+	if fc.db != f.db {
+		fc.db = f.db
+		fc.write(redis.MustEncodeToBytes(redis.NewCommand("SELECT", strconv.Itoa(int(f.db)))), m)
+	}
+	if c.IsInline() {
+		fc.push(m)
+		if err := fc.w.EncodeArgs(c.Args, false); err != nil {
+			log.PanicError(err, "write command failed")
+		}
+	} else {
+		fc.write(c.Raw, m)
+	}
+	if int64(fc.w.Buffered()) >= forwardFlushSize.Get() {
+		fc.flush()
+	}
+}
+
+func (f *forwarder) barrier() {
+	for _, fc := range f.conns {
+		fc.wait()
+	}
+}
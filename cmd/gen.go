@@ -0,0 +1,613 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"os"
+	"sort"
+	"strconv"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+)
+
+// genSpec describes the keyspace written by gen. Sizes are in bytes, ratios
+// are in [0,1], and weights are relative to each other.
+type genSpec struct {
+	Keys int64 `json:"keys"`
+	Seed int64 `json:"seed"`
+
+	// DBs maps db numbers to the weight of their share of keys.
+	DBs map[string]float64 `json:"dbs"`
+
+	// ValueSize is the size of string values, and ElementSize is the size
+	// of list, set and zset elements and of hash fields and values.
+	KeySize     genDist `json:"key_size"`
+	ValueSize   genDist `json:"value_size"`
+	ElementSize genDist `json:"element_size"`
+
+	// Ints is the ratio of values, and of elements, written as integers,
+	// which the rdb stores in the int encoding.
+	Ints float64 `json:"ints"`
+
+	// TTL is the ratio of keys that expire, at Time (unix ms, default is
+	// GenEpoch, -1 for the start of the current hour) plus a number of
+	// seconds within TTLRange.
+	TTL      float64  `json:"ttl"`
+	TTLRange [2]int64 `json:"ttl_range"`
+	Time     int64    `json:"time"`
+
+	Types map[string]*genType `json:"types"`
+}
+
+type genType struct {
+	Weight   float64 `json:"weight"`
+	Elements genDist `json:"elements"`
+}
+
+// genDist is a mix of uniform ranges, e.g. 95% in [1,32] and 5% in
+// [10000,50000] to have a few huge collections.
+type genDist []genRange
+
+type genRange struct {
+	Weight float64 `json:"weight"`
+	Min    int     `json:"min"`
+	Max    int     `json:"max"`
+}
+
+// GenEpoch is the default time of a spec, 2100-01-01 UTC in unix ms, so the
+// same spec and seed give the same rdb whenever they run, and its keys don't
+// expire while it is being loaded.
+const GenEpoch = 4102444800000
+
+var genTypes = []string{"string", "list", "hash", "set", "zset"}
+
+func defaultGenSpec() *genSpec {
+	return &genSpec{
+		Keys:        1000000,
+		DBs:         map[string]float64{"0": 1},
+		KeySize:     genDist{{1, 16, 48}},
+		ValueSize:   genDist{{90, 8, 128}, {10, 1024, 16384}},
+		ElementSize: genDist{{1, 8, 64}},
+		Ints:        0.1,
+		TTL:         0.4,
+		TTLRange:    [2]int64{3600, 86400 * 30},
+		Types: map[string]*genType{
+			"string": {Weight: 60},
+			"list":   {Weight: 10, Elements: genDist{{1, 1, 128}}},
+			"hash":   {Weight: 15, Elements: genDist{{95, 1, 32}, {5, 1000, 10000}}},
+			"set":    {Weight: 10, Elements: genDist{{1, 1, 64}}},
+			"zset":   {Weight: 5, Elements: genDist{{1, 1, 128}}},
+		},
+	}
+}
+
+func loadGenSpec(name string) (*genSpec, error) {
+	s := defaultGenSpec()
+	if len(name) == 0 {
+		return s, nil
+	}
+	b, err := ioutil.ReadFile(name)
+	if err != nil {
+		return nil, errors.Trace(err)
+	}
+	// maps would be merged into the defaults rather than replace them
+	dbs, types := s.DBs, s.Types
+	s.DBs, s.Types = nil, nil
+	if err := json.Unmarshal(b, s); err != nil {
+		return nil, errors.Trace(err)
+	}
+	if s.DBs == nil {
+		s.DBs = dbs
+	}
+	if s.Types == nil {
+		s.Types = types
+	}
+	return s, nil
+}
+
+// genTable picks an index with probability proportional to its weight.
+type genTable []float64
+
+func newGenTable(weights []float64) (genTable, error) {
+	var t genTable
+	var sum float64
+	for _, w := range weights {
+		if w < 0 {
+			return nil, errors.Errorf("negative weight %v", w)
+		}
+		sum += w
+		t = append(t, sum)
+	}
+	if sum <= 0 {
+		return nil, errors.Errorf("weights sum up to %v", sum)
+	}
+	for i := range t {
+		t[i] /= sum
+	}
+	return t, nil
+}
+
+func (t genTable) pick(r *genRand) int {
+	x := r.Float64()
+	for i, c := range t {
+		if x < c {
+			return i
+		}
+	}
+	return len(t) - 1
+}
+
+type genSampler struct {
+	t genTable
+	d genDist
+}
+
+func newGenSampler(d genDist, min int, what string) (*genSampler, error) {
+	var weights []float64
+	for _, r := range d {
+		if r.Min < min || r.Max < r.Min {
+			return nil, errors.Errorf("invalid %s range [%d,%d]", what, r.Min, r.Max)
+		}
+		weights = append(weights, r.Weight)
+	}
+	t, err := newGenTable(weights)
+	if err != nil {
+		return nil, errors.Errorf("invalid %s: %s", what, err)
+	}
+	return &genSampler{t, d}, nil
+}
+
+func (s *genSampler) sample(r *genRand) int {
+	x := s.d[s.t.pick(r)]
+	return x.Min + r.Intn(x.Max-x.Min+1)
+}
+
+// genRand is splitmix64, which is fast and gives the same numbers for a
+// seed on every platform and release.
+type genRand struct {
+	s uint64
+}
+
+func newGenRand(seed int64, stream int64) *genRand {
+	r := &genRand{uint64(seed)*0x9e3779b97f4a7c15 ^ uint64(stream)}
+	r.Uint64()
+	return r
+}
+
+func (r *genRand) Uint64() uint64 {
+	r.s += 0x9e3779b97f4a7c15
+	z := r.s
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb
+	return z ^ (z >> 31)
+}
+
+func (r *genRand) Float64() float64 {
+	return float64(r.Uint64()>>11) / (1 << 53)
+}
+
+func (r *genRand) Intn(n int) int {
+	return int(r.Uint64() % uint64(n))
+}
+
+// genPlan is a validated genSpec.
+type genPlan struct {
+	spec *genSpec
+
+	dbs  []uint32
+	ends []int64
+
+	types    genTable
+	elements []*genSampler
+	keys     *genSampler
+	values   *genSampler
+	elemsize *genSampler
+
+	pool []byte
+}
+
+type genDBs []uint32
+
+func (p genDBs) Len() int           { return len(p) }
+func (p genDBs) Less(i, j int) bool { return p[i] < p[j] }
+func (p genDBs) Swap(i, j int)      { p[i], p[j] = p[j], p[i] }
+
+func newGenPlan(s *genSpec) (*genPlan, error) {
+	p := &genPlan{spec: s}
+	if s.Keys <= 0 {
+		return nil, errors.Errorf("invalid keys = %d", s.Keys)
+	}
+	for _, x := range []float64{s.Ints, s.TTL} {
+		if x < 0 || x > 1 {
+			return nil, errors.Errorf("invalid ratio %v", x)
+		}
+	}
+	if s.TTL != 0 && (s.TTLRange[0] < 1 || s.TTLRange[1] < s.TTLRange[0]) {
+		return nil, errors.Errorf("invalid ttl_range [%d,%d]", s.TTLRange[0], s.TTLRange[1])
+	}
+	switch {
+	case s.Time == 0:
+		s.Time = GenEpoch
+	case s.Time == -1:
+		s.Time = time.Now().Truncate(time.Hour).UnixNano() / int64(time.Millisecond)
+	case s.Time < 0:
+		return nil, errors.Errorf("invalid time = %d", s.Time)
+	}
+
+	weights := make(map[uint32]float64)
+	for k, w := range s.DBs {
+		n, err := parseInt(k, MinDB, MaxDB)
+		if err != nil {
+			return nil, errors.Errorf("invalid db '%s'", k)
+		}
+		p.dbs, weights[uint32(n)] = append(p.dbs, uint32(n)), w
+	}
+	sort.Sort(genDBs(p.dbs))
+	var ws []float64
+	for _, db := range p.dbs {
+		ws = append(ws, weights[db])
+	}
+	t, err := newGenTable(ws)
+	if err != nil {
+		return nil, errors.Errorf("invalid dbs: %s", err)
+	}
+	for i := range t {
+		p.ends = append(p.ends, int64(t[i]*float64(s.Keys)))
+	}
+	p.ends[len(p.ends)-1] = s.Keys
+
+	ws = ws[:0]
+	for name := range s.Types {
+		var known bool
+		for _, x := range genTypes {
+			known = known || x == name
+		}
+		if !known {
+			return nil, errors.Errorf("unknown type '%s'", name)
+		}
+	}
+	for _, name := range genTypes {
+		var e *genSampler
+		if x := s.Types[name]; x == nil {
+			ws = append(ws, 0)
+		} else {
+			ws = append(ws, x.Weight)
+			if name != "string" {
+				if e, err = newGenSampler(x.Elements, 1, name+" elements"); err != nil {
+					return nil, err
+				}
+			}
+		}
+		p.elements = append(p.elements, e)
+	}
+	if p.types, err = newGenTable(ws); err != nil {
+		return nil, errors.Errorf("invalid types: %s", err)
+	}
+	if p.keys, err = newGenSampler(s.KeySize, 1, "key_size"); err != nil {
+		return nil, err
+	}
+	if p.values, err = newGenSampler(s.ValueSize, 0, "value_size"); err != nil {
+		return nil, err
+	}
+	if p.elemsize, err = newGenSampler(s.ElementSize, 0, "element_size"); err != nil {
+		return nil, err
+	}
+
+	const chars = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	r := newGenRand(s.Seed, -1)
+	p.pool = make([]byte, genPoolSize)
+	for i := range p.pool {
+		p.pool[i] = chars[r.Intn(len(chars))]
+	}
+	return p, nil
+}
+
+// genPoolSize is the size of the random bytes that values are cut from, it
+// is kept small enough to stay in cache.
+const genPoolSize = 64 * 1024
+
+// genChunkKeys is the number of keys encoded by one worker at a time, every
+// chunk has its own random stream so the output doesn't depend on --parallel.
+const genChunkKeys = 1024
+
+type genChunk struct {
+	index int64
+	buf   bytes.Buffer
+	enc   *rdb.Encoder
+	done  chan struct{}
+}
+
+// genWorker owns the scratch space of the objects it builds.
+type genWorker struct {
+	plan *genPlan
+	r    *genRand
+
+	arena []byte
+	ends  []int
+	big   []byte
+
+	list  rdb.List
+	hash  rdb.Hash
+	helem []rdb.HashElement
+	zset  rdb.ZSet
+	zelem []rdb.ZSetElement
+}
+
+// filler returns n bytes taken from the pool, the result must not be
+// modified.
+func (w *genWorker) filler(n int) []byte {
+	pool := w.plan.pool
+	if n <= len(pool) {
+		i := w.r.Intn(len(pool) - n + 1)
+		return pool[i : i+n : i+n]
+	}
+	if cap(w.big) < n {
+		w.big = make([]byte, 0, n)
+	}
+	w.big = w.big[:0]
+	for len(w.big) < n {
+		w.big = append(w.big, pool[:min(len(pool), n-len(w.big))]...)
+	}
+	return w.big
+}
+
+func min(a, b int) int {
+	if a < b {
+		return a
+	}
+	return b
+}
+
+// value appends an element of a random size to the arena, prefixed by tag
+// if tag >= 0 to keep elements distinct.
+func (w *genWorker) value(tag int) {
+	spec := w.plan.spec
+	if spec.Ints != 0 && w.r.Float64() < spec.Ints {
+		if tag >= 0 {
+			w.arena = strconv.AppendInt(w.arena, int64(tag)<<16|int64(w.r.Intn(1<<16)), 10)
+		} else {
+			w.arena = strconv.AppendInt(w.arena, int64(int32(w.r.Uint64())), 10)
+		}
+	} else {
+		n := w.plan.elemsize.sample(w.r)
+		if tag >= 0 {
+			i := len(w.arena)
+			w.arena = strconv.AppendInt(w.arena, int64(tag), 10)
+			w.arena = append(w.arena, ':')
+			n -= len(w.arena) - i
+		}
+		if n > 0 {
+			w.arena = append(w.arena, w.filler(n)...)
+		}
+	}
+	w.ends = append(w.ends, len(w.arena))
+}
+
+// element returns the i-th value appended to the arena.
+func (w *genWorker) element(i int) []byte {
+	beg := 0
+	if i != 0 {
+		beg = w.ends[i-1]
+	}
+	return w.arena[beg:w.ends[i]:w.ends[i]]
+}
+
+func (w *genWorker) object(t int) interface{} {
+	w.arena, w.ends = w.arena[:0], w.ends[:0]
+	if genTypes[t] == "string" {
+		spec := w.plan.spec
+		if spec.Ints != 0 && w.r.Float64() < spec.Ints {
+			return rdb.String(strconv.AppendInt(w.arena, int64(int32(w.r.Uint64())), 10))
+		}
+		return rdb.String(w.filler(w.plan.values.sample(w.r)))
+	}
+	n := w.plan.elements[t].sample(w.r)
+	switch genTypes[t] {
+	case "hash":
+		for i := 0; i < n; i++ {
+			w.value(i)
+			w.value(-1)
+		}
+		w.hash, w.helem = w.hash[:0], w.helem[:0]
+		for i := 0; i < n; i++ {
+			w.helem = append(w.helem, rdb.HashElement{Field: w.element(i * 2), Value: w.element(i*2 + 1)})
+		}
+		for i := range w.helem {
+			w.hash = append(w.hash, &w.helem[i])
+		}
+		return w.hash
+	case "zset":
+		for i := 0; i < n; i++ {
+			w.value(i)
+		}
+		w.zset, w.zelem = w.zset[:0], w.zelem[:0]
+		for i := 0; i < n; i++ {
+			score := float64(w.r.Intn(1<<20)) / 16
+			w.zelem = append(w.zelem, rdb.ZSetElement{Member: w.element(i), Score: score})
+		}
+		for i := range w.zelem {
+			w.zset = append(w.zset, &w.zelem[i])
+		}
+		return w.zset
+	default:
+		for i := 0; i < n; i++ {
+			w.value(i)
+		}
+		w.list = w.list[:0]
+		for i := 0; i < n; i++ {
+			w.list = append(w.list, w.element(i))
+		}
+		if genTypes[t] == "set" {
+			return rdb.Set(w.list)
+		}
+		return w.list
+	}
+}
+
+// encode writes the keys of chunk c.
+func (w *genWorker) encode(c *genChunk) {
+	plan, spec := w.plan, w.plan.spec
+	w.r = newGenRand(spec.Seed, c.index)
+	beg := c.index * genChunkKeys
+	end := beg + genChunkKeys
+	if end > spec.Keys {
+		end = spec.Keys
+	}
+	d := sort.Search(len(plan.ends), func(i int) bool {
+		return plan.ends[i] > beg
+	})
+	var key []byte
+	for k := beg; k < end; k++ {
+		for plan.ends[d] <= k {
+			d++
+		}
+		key = strconv.AppendInt(append(key[:0], "key:"...), k, 10)
+		if n := plan.keys.sample(w.r) - len(key); n > 0 {
+			key = append(append(key, ':'), w.filler(n-1)...)
+		}
+		var expireat uint64
+		if spec.TTL != 0 && w.r.Float64() < spec.TTL {
+			ttl := spec.TTLRange[0] + int64(w.r.Intn(int(spec.TTLRange[1]-spec.TTLRange[0]+1)))
+			expireat = uint64(spec.Time + ttl*1000)
+		}
+		obj := w.object(plan.types.pick(w.r))
+		if err := c.enc.EncodeObject(plan.dbs[d], key, expireat, obj); err != nil {
+			log.PanicErrorf(err, "encode key '%s' failed", key)
+		}
+	}
+}
+
+type cmdGen struct {
+	nkeys, nbytes atomic2.Int64
+}
+
+func (cmd *cmdGen) Main() {
+	spec, err := loadGenSpec(args.spec)
+	if err != nil {
+		log.PanicErrorf(err, "load spec '%s' failed", args.spec)
+	}
+	if args.keys != 0 {
+		spec.Keys = args.keys
+	}
+	if args.seed != nil {
+		spec.Seed = *args.seed
+	}
+	plan, err := newGenPlan(spec)
+	if err != nil {
+		log.PanicErrorf(err, "invalid spec '%s'", args.spec)
+	}
+
+	output := args.output
+	if len(output) == 0 {
+		output = "/dev/stdout"
+	}
+	log.Infof("gen keys = %d, seed = %d, time = %d to '%s'\n", spec.Keys, spec.Seed, spec.Time, output)
+
+	var saveto io.WriteCloser
+	if output != "/dev/stdout" {
+		saveto = openWriteFile(output)
+		defer saveto.Close()
+	} else {
+		saveto = os.Stdout
+	}
+	writer := bufio.NewWriterSize(saveto, WriterBufferSize)
+
+	wait := make(chan struct{})
+	go func() {
+		defer close(wait)
+		cmd.Generate(plan, writer)
+		flushWriter(writer)
+	}()
+
+	start := time.Now()
+	for done := false; !done; {
+		select {
+		case <-wait:
+			done = true
+		case <-time.After(time.Second):
+		}
+		nkeys, nbytes := cmd.nkeys.Get(), cmd.nbytes.Get()
+		secs := time.Since(start).Seconds()
+		var b bytes.Buffer
+		fmt.Fprintf(&b, "gen: keys = %d - %12d [%3d%%]", spec.Keys, nkeys, 100*nkeys/spec.Keys)
+		fmt.Fprintf(&b, "  bytes = %-14d %.1fmb/s", nbytes, float64(nbytes)/secs/1024/1024)
+		log.Info(b.String())
+	}
+	log.Info("gen: done")
+}
+
+// Generate encodes chunks of keys on args.parallel workers and writes them
+// in order, the checksums of the chunks are combined rather than computed
+// again by the writer.
+func (cmd *cmdGen) Generate(plan *genPlan, writer io.Writer) {
+	nchunk := (plan.spec.Keys + genChunkKeys - 1) / genChunkKeys
+	jobs := make(chan *genChunk, args.parallel)
+	order := make(chan *genChunk, args.parallel*2)
+	free := make(chan *genChunk, cap(order)+cap(jobs)+args.parallel)
+
+	go func() {
+		defer close(jobs)
+		defer close(order)
+		for i := int64(0); i < nchunk; i++ {
+			var c *genChunk
+			select {
+			case c = <-free:
+				c.buf.Reset()
+			default:
+				c = &genChunk{}
+			}
+			c.index, c.done = i, make(chan struct{})
+			c.enc = rdb.NewEncoder(&c.buf)
+			order <- c
+			jobs <- c
+		}
+	}()
+
+	for i := 0; i < args.parallel; i++ {
+		go func() {
+			w := &genWorker{plan: plan}
+			for c := range jobs {
+				w.encode(c)
+				close(c.done)
+			}
+		}()
+	}
+
+	enc := rdb.NewEncoder(writer)
+	if err := enc.EncodeHeader(); err != nil {
+		log.PanicError(err, "encode header failed")
+	}
+	for c := range order {
+		<-c.done
+		if err := enc.EncodeChunk(c.enc, c.buf.Bytes()); err != nil {
+			log.PanicError(err, "write chunk failed")
+		}
+		cmd.nbytes.Add(int64(c.buf.Len()))
+		cmd.nkeys.Add(min64(genChunkKeys, plan.spec.Keys-c.index*genChunkKeys))
+		select {
+		case free <- c:
+		default:
+		}
+	}
+	if err := enc.EncodeFooter(); err != nil {
+		log.PanicError(err, "encode footer failed")
+	}
+}
+
+func min64(a, b int64) int64 {
+	if a < b {
+		return a
+	}
+	return b
+}
@@ -0,0 +1,105 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bytes"
+	"io/ioutil"
+	"os"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+)
+
+func testGen(s *genSpec, parallel int) []byte {
+	p, err := newGenPlan(s)
+	assert.MustNoError(err)
+	defer withParallel(parallel)()
+	var b bytes.Buffer
+	new(cmdGen).Generate(p, &b)
+	return b.Bytes()
+}
+
+func TestGen(t *testing.T) {
+	s := defaultGenSpec()
+	s.Keys, s.Seed, s.Time = 5000, 1, 1e12
+	s.DBs = map[string]float64{"0": 1, "3": 1}
+	p := testGen(s, 1)
+	assert.Must(bytes.Equal(p, testGen(s, 4)))
+
+	l := rdb.NewLoader(bytes.NewReader(p))
+	assert.MustNoError(l.Header())
+	var keys, expires int
+	for {
+		e, err := l.NextBinEntry()
+		assert.MustNoError(err)
+		if e == nil {
+			break
+		}
+		assert.Must(e.DB == 0 && keys < 2500 || e.DB == 3 && keys >= 2500)
+		if e.ExpireAt != 0 {
+			expires++
+		}
+		keys++
+	}
+	assert.MustNoError(l.Footer())
+	assert.Must(keys == 5000)
+	assert.Must(expires > 1500 && expires < 2500)
+
+	s.Seed = 2
+	assert.Must(!bytes.Equal(p, testGen(s, 1)))
+}
+
+func TestGenSpec(t *testing.T) {
+	f, err := ioutil.TempFile("", "gen")
+	assert.MustNoError(err)
+	defer os.Remove(f.Name())
+	defer f.Close()
+	f.WriteString(`{"keys": 10, "types": {"set": {"weight": 1, "elements": [{"weight": 1, "min": 2, "max": 2}]}}}`)
+
+	s, err := loadGenSpec(f.Name())
+	assert.MustNoError(err)
+	assert.Must(s.Keys == 10 && len(s.Types) == 1 && len(s.DBs) == 1)
+	_, err = newGenPlan(s)
+	assert.MustNoError(err)
+
+	s.Types["list"] = &genType{Weight: 1}
+	_, err = newGenPlan(s)
+	assert.Must(err != nil)
+}
+
+func TestGenTime(t *testing.T) {
+	s := defaultGenSpec()
+	s.Keys = 10
+	_, err := newGenPlan(s)
+	assert.MustNoError(err)
+	assert.Must(s.Time == GenEpoch)
+
+	s.Time = -1
+	_, err = newGenPlan(s)
+	assert.MustNoError(err)
+	assert.Must(s.Time > 0 && s.Time < GenEpoch && s.Time%3600000 == 0)
+
+	s.Time = -2
+	_, err = newGenPlan(s)
+	assert.Must(err != nil)
+}
+
+func benchmarkGenerate(b *testing.B, parallel int) {
+	s := defaultGenSpec()
+	s.Keys, s.Seed = 20000, 1
+	p, err := newGenPlan(s)
+	assert.MustNoError(err)
+	defer withParallel(parallel)()
+	cmd := new(cmdGen)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		cmd.Generate(p, ioutil.Discard)
+	}
+	b.SetBytes(cmd.nbytes.Get() / int64(b.N))
+}
+
+func BenchmarkGenerate(b *testing.B)          { benchmarkGenerate(b, 1) }
+func BenchmarkGenerateParallel4(b *testing.B) { benchmarkGenerate(b, 4) }
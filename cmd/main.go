@@ -27,17 +27,45 @@ var args struct {
 	target string
 	extra  bool
 
+	targets []string
+	froms   []string
+
 	sockfile string
 	filesize int64
 
+	spilldir  string
+	spillsize int64
+	compress  bool
+
 	shift time.Duration
 	psync bool
 	codis bool
+
+	intern bool
+	shards int
+
+	checkpoint string
+	overlap    bool
+	fanoutsize int64
+
+	scan      bool
+	scancount int
+	scantail  bool
+
+	admin string
+
+	spec string
+	seed *int64
+	keys int64
 }
 
 const (
 	ReaderBufferSize = bytesize.MB * 32
 	WriterBufferSize = bytesize.MB * 8
+
+	OverlapPendingSize = bytesize.MB * 256
+	OverlapHeldSize    = bytesize.MB * 64
+	OverlapRdbSize     = bytesize.MB * 256
 )
 
 func parseInt(s string, min, max int) (int, error) {
@@ -51,6 +79,18 @@ func parseInt(s string, min, max int) (int, error) {
 	return 0, errors.Errorf("out of range [%d,%d], got %d", min, max, n)
 }
 
+func splitAddrs(s string) []string {
+	var addrs []string
+	for _, addr := range strings.Split(s, ",") {
+		if addr = strings.TrimSpace(addr); addr != "" {
+			addrs = append(addrs, addr)
+		}
+	}
+	return addrs
+}
+
+var targetLimiter *rateLimiter
+
 const (
 	MinDB = 0
 	MaxDB = 1023
@@ -63,10 +103,11 @@ var acceptDB = func(db uint32) bool {
 func main() {
 	usage := `
 Usage:
-	redis-port decode   [--ncpu=N]  [--parallel=M]  [--input=INPUT]  [--output=OUTPUT]
-	redis-port restore  [--ncpu=N]  [--parallel=M]  [--input=INPUT]  [--faketime=FAKETIME] [--extra] [--filterdb=DB] --target=TARGET [--auth=AUTH] [--redis|--codis]
-	redis-port sync     [--ncpu=N]  [--parallel=M]   --from=MASTER   [--password=PASSWORD] [--psync] [--filterdb=DB] --target=TARGET [--auth=AUTH] [--redis|--codis] [--sockfile=FILE [--filesize=SIZE]]
-	redis-port dump     [--ncpu=N]  [--parallel=M]   --from=MASTER   [--password=PASSWORD] [--extra] [--output=OUTPUT]
+	redis-port decode   [--ncpu=N]  [--parallel=M]  [--input=INPUT]  [--output=OUTPUT] [--intern]
+	redis-port restore  [--ncpu=N]  [--parallel=M]  [--input=INPUT]  [--faketime=FAKETIME] [--extra] [--filterdb=DB] --target=TARGET [--auth=AUTH] [--redis|--codis] [--shards=N]
+	redis-port sync     [--ncpu=N]  [--parallel=M]   --from=MASTER   [--password=PASSWORD] [--psync] [--filterdb=DB] --target=TARGET [--auth=AUTH] [--redis|--codis] [--sockfile=FILE [--filesize=SIZE]] [--spilldir=DIR [--spillsize=SIZE]|--compress] [--shards=N] [--checkpoint=FILE] [--overlap] [--fanoutsize=SIZE] [--ratelimit=SIZE] [--scan [--scancount=N] [--scantail]] [--admin=ADDR]
+	redis-port dump     [--ncpu=N]  [--parallel=M]   --from=MASTER   [--password=PASSWORD] [--extra|--scan [--scancount=N]] [--output=OUTPUT]
+	redis-port gen      [--ncpu=N]  [--parallel=M]  [--spec=FILE] [--seed=N] [--keys=N] [--output=OUTPUT]
 	redis-port --version
 
 Options:
@@ -74,18 +115,34 @@ Options:
 	-p M, --parallel=M                Set the number of parallel routines to M.
 	-i INPUT, --input=INPUT           Set input file, default is stdin ('/dev/stdin').
 	-o OUTPUT, --output=OUTPUT        Set output file, default is stdout ('/dev/stdout').
-	-f MASTER, --from=MASTER          Set host:port of master redis.
-	-t TARGET, --target=TARGET        Set host:port of slave redis.
+	-f MASTER, --from=MASTER          Set host:port of master redis, sync and dump --scan accept a comma separated list.
+	-t TARGET, --target=TARGET        Set host:port of slave redis, sync accepts a comma separated list.
 	-P PASSWORD, --password=PASSWORD  Set redis auth password.
 	-A AUTH, --auth=AUTH              Set auth password for target.
 	--faketime=FAKETIME               Set current system time to adjust key's expire time.
 	--sockfile=FILE                   Use FILE to as socket buffer, default is disabled.
 	--filesize=SIZE                   Set FILE size, default value is 1gb.
+	--spilldir=DIR                    Spill backlog that overflows memory to segment files under DIR, default is disabled.
+	--spillsize=SIZE                  Set disk budget of DIR, default value is 8gb.
+	--compress                        Deflate backlog buffered in memory while the rdb is loading.
 	-e, --extra                       Set true to send/receive following redis commands, default is false.
 	--redis                           Target is normal redis instance, default is false.
 	--codis                           Target is codis proxy, default is true.
 	--filterdb=DB                     Filter db = DB, default is *.
 	--psync                           Use PSYNC command.
+	--shards=N                        Replay backlog commands on N target connections sharded by key, default is 1.
+	--checkpoint=FILE                 Save replid and applied offset to FILE and resume from it with PSYNC on restart.
+	--fanoutsize=SIZE                 Set per target buffer when syncing to several targets, default value is 128mb.
+	--ratelimit=SIZE                  Limit bytes written to target per second, default is unlimited.
+	--overlap                         Replay backlog while the rdb is loading, ordered per key.
+	--scan                            Read the keyspace with SCAN + DUMP instead of SYNC/PSYNC.
+	--scancount=N                     Set COUNT of SCAN and keys per DUMP pipeline, default value is 1000.
+	--scantail                        Follow keyspace notifications to copy keys written during and after the scan.
+	--admin=ADDR                      Serve stats and runtime settings of sync over RESP on ADDR (loopback only, or AUTH with --auth), default is disabled.
+	--intern                          Share repeated field names and members between keys while decoding.
+	--spec=FILE                       Load the keyspace written by gen from a json FILE, default is a built-in mix.
+	--seed=N                          Override seed of the spec, the same seed and spec give the same rdb.
+	--keys=N                          Override number of keys of the spec.
 `
 	d, err := docopt.Parse(usage, nil, true, "", false)
 	if err != nil {
@@ -126,15 +183,65 @@ Options:
 	args.output, _ = d["--output"].(string)
 
 	args.from, _ = d["--from"].(string)
+	args.froms = splitAddrs(args.from)
 	args.passwd, _ = d["--password"].(string)
 	args.auth, _ = d["--auth"].(string)
 	args.target, _ = d["--target"].(string)
+	args.targets = splitAddrs(args.target)
 
 	args.sockfile, _ = d["--sockfile"].(string)
+	args.spilldir, _ = d["--spilldir"].(string)
+	args.checkpoint, _ = d["--checkpoint"].(string)
+	args.admin, _ = d["--admin"].(string)
+	args.spec, _ = d["--spec"].(string)
 
 	args.extra = d["--extra"].(bool)
 	args.psync = d["--psync"].(bool)
 	args.codis = d["--codis"].(bool) || !d["--redis"].(bool)
+	args.intern = d["--intern"].(bool)
+	args.compress = d["--compress"].(bool)
+	args.overlap = d["--overlap"].(bool)
+	args.scan = d["--scan"].(bool)
+	args.scantail = d["--scantail"].(bool)
+
+	if s, ok := d["--shards"].(string); ok && s != "" {
+		n, err := parseInt(s, 1, 1024)
+		if err != nil {
+			log.PanicErrorf(err, "parse --shards failed")
+		}
+		args.shards = n
+	} else {
+		args.shards = 1
+	}
+
+	if s, ok := d["--scancount"].(string); ok && s != "" {
+		n, err := parseInt(s, 1, 1024*1024)
+		if err != nil {
+			log.PanicErrorf(err, "parse --scancount failed")
+		}
+		args.scancount = n
+	} else {
+		args.scancount = 1000
+	}
+
+	if s, ok := d["--seed"].(string); ok && s != "" {
+		n, err := strconv.ParseInt(s, 10, 64)
+		if err != nil {
+			log.PanicError(err, "parse --seed failed")
+		}
+		args.seed = &n
+	}
+
+	if s, ok := d["--keys"].(string); ok && s != "" {
+		n, err := strconv.ParseInt(s, 10, 64)
+		if err != nil {
+			log.PanicError(err, "parse --keys failed")
+		}
+		if n <= 0 {
+			log.Panicf("parse --keys = %d, invalid number", n)
+		}
+		args.keys = n
+	}
 
 	if s, ok := d["--faketime"].(string); ok && s != "" {
 		switch s[0] {
@@ -186,6 +293,73 @@ Options:
 		args.filesize = bytesize.GB
 	}
 
+	if s, ok := d["--spillsize"].(string); ok && s != "" {
+		if len(args.spilldir) == 0 {
+			log.Panic("please specify --spilldir first")
+		}
+		n, err := bytesize.Parse(s)
+		if err != nil {
+			log.PanicError(err, "parse --spillsize failed")
+		}
+		if n <= 0 {
+			log.Panicf("parse --spillsize = %d, invalid number", n)
+		}
+		args.spillsize = n
+	} else {
+		args.spillsize = bytesize.GB * 8
+	}
+
+	if s, ok := d["--fanoutsize"].(string); ok && s != "" {
+		n, err := bytesize.Parse(s)
+		if err != nil {
+			log.PanicError(err, "parse --fanoutsize failed")
+		}
+		if n <= 0 {
+			log.Panicf("parse --fanoutsize = %d, invalid number", n)
+		}
+		args.fanoutsize = n
+	} else {
+		args.fanoutsize = bytesize.MB * 128
+	}
+
+	if s, ok := d["--ratelimit"].(string); ok && s != "" {
+		n, err := bytesize.Parse(s)
+		if err != nil {
+			log.PanicError(err, "parse --ratelimit failed")
+		}
+		if n <= 0 {
+			log.Panicf("parse --ratelimit = %d, invalid number", n)
+		}
+		targetLimiter = newRateLimiter(n)
+	}
+
+	if len(args.targets) > 1 {
+		// the targets share the rdb parse and the master's offset, a single
+		// checkpoint can't hold the offset each of them has applied
+		switch {
+		case args.overlap:
+			log.Panic("--overlap doesn't support multiple targets")
+		case len(args.checkpoint) != 0:
+			log.Panic("--checkpoint doesn't support multiple targets")
+		}
+	}
+	if args.scan {
+		switch {
+		case len(args.targets) > 1:
+			log.Panic("--scan doesn't support multiple targets")
+		case args.overlap || len(args.checkpoint) != 0 || len(args.sockfile) != 0:
+			log.Panic("--overlap, --checkpoint and --sockfile don't support --scan")
+		}
+	}
+	if len(args.froms) > 1 && !args.scan {
+		switch {
+		case len(args.targets) > 1:
+			log.Panic("can't sync from multiple masters to multiple targets")
+		case args.overlap || len(args.checkpoint) != 0 || len(args.sockfile) != 0:
+			log.Panic("--overlap, --checkpoint and --sockfile don't support multiple masters")
+		}
+	}
+
 	log.Infof("set ncpu = %d, parallel = %d\n", ncpu, args.parallel)
 
 	switch {
@@ -197,5 +371,7 @@ Options:
 		new(cmdDump).Main()
 	case d["sync"].(bool):
 		new(cmdSync).Main()
+	case d["gen"].(bool):
+		new(cmdGen).Main()
 	}
 }
@@ -0,0 +1,229 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"crypto/sha1"
+	"fmt"
+	"net"
+	"strconv"
+	"sync"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+// fakeMaster stands in for the master of sync. It answers the replication
+// handshake, sends RDB on PSYNC ? -1 or SYNC, either with its size or as a
+// diskless transfer ended by an eof mark, and then streams its backlog. PSYNC
+// of an offset that is still in the backlog is answered with +CONTINUE, and
+// the backlog is never trimmed. Writes are appended by Write and Feed.
+//
+// A replica is dropped after DropEvery bytes of backlog have been streamed to
+// it on one connection, or by Disconnect, and with CloseWhenDrained once it
+// has caught up.
+type fakeMaster struct {
+	l net.Listener
+
+	ReplID   string
+	RDB      []byte
+	Diskless bool
+
+	DropEvery        int64
+	CloseWhenDrained bool
+
+	mu      sync.Mutex
+	cond    *sync.Cond
+	base    int64
+	backlog []byte
+	epoch   int
+
+	nfull, ncontinue, acked atomic2.Int64
+}
+
+func newFakeMaster(rdb []byte, base int64) *fakeMaster {
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	m := &fakeMaster{l: l, RDB: rdb, base: base}
+	m.ReplID = fmt.Sprintf("%040x", base)
+	m.cond = sync.NewCond(&m.mu)
+	return m
+}
+
+// Start serves replicas, the settings must not be changed afterwards.
+func (m *fakeMaster) Start() *fakeMaster {
+	go func() {
+		for {
+			c, err := m.l.Accept()
+			if err != nil {
+				return
+			}
+			go m.serveConn(c)
+		}
+	}()
+	return m
+}
+
+func (m *fakeMaster) Addr() string {
+	return m.l.Addr().String()
+}
+
+// Close stops accepting replicas, the ones connected are left as they are.
+func (m *fakeMaster) Close() error {
+	return m.l.Close()
+}
+
+// Offset returns the replication offset of the last byte in the backlog.
+func (m *fakeMaster) Offset() int64 {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	return m.base + int64(len(m.backlog))
+}
+
+func (m *fakeMaster) Write(p []byte) {
+	m.mu.Lock()
+	m.backlog = append(m.backlog, p...)
+	m.cond.Broadcast()
+	m.mu.Unlock()
+}
+
+// Feed writes p in the background at rate bytes per second, the returned
+// channel is closed once p has been written.
+func (m *fakeMaster) Feed(p []byte, rate int64) <-chan struct{} {
+	done := make(chan struct{})
+	go func() {
+		defer close(done)
+		const tick = time.Millisecond * 10
+		n := int(rate * int64(tick) / int64(time.Second))
+		if n == 0 {
+			n = 1
+		}
+		for len(p) != 0 {
+			if n > len(p) {
+				n = len(p)
+			}
+			m.Write(p[:n])
+			p = p[n:]
+			time.Sleep(tick)
+		}
+	}()
+	return done
+}
+
+// Disconnect drops every replica.
+func (m *fakeMaster) Disconnect() {
+	m.mu.Lock()
+	m.epoch++
+	m.cond.Broadcast()
+	m.mu.Unlock()
+}
+
+func (m *fakeMaster) serveConn(c net.Conn) {
+	defer c.Close()
+	r := bufio.NewReader(c)
+	w := bufio.NewWriter(c)
+	d := redis.NewCommandDecoder(r)
+	var streaming bool
+	for {
+		cmd, err := d.Decode()
+		if err != nil {
+			return
+		}
+		switch {
+		case cmd.Is("replconf") && len(cmd.Args) == 3 && bytes.EqualFold(cmd.Args[1], []byte("ack")):
+			if n, err := strconv.ParseInt(string(cmd.Args[2]), 10, 64); err == nil {
+				m.acked.Set(n)
+			}
+			continue
+		case streaming:
+			return
+		case cmd.Is("ping"):
+			w.WriteString("+PONG\r\n")
+		case cmd.Is("auth"), cmd.Is("replconf"):
+			w.WriteString("+OK\r\n")
+		case cmd.Is("sync"), cmd.Is("psync"):
+			start := m.handshake(w, cmd)
+			if err := w.Flush(); err != nil {
+				return
+			}
+			streaming = true
+			go m.stream(c, start)
+			continue
+		default:
+			fmt.Fprintf(w, "-ERR unknown command '%s'\r\n", cmd.Args[0])
+		}
+		if err := w.Flush(); err != nil {
+			return
+		}
+	}
+}
+
+// handshake answers SYNC or PSYNC and returns the offset the stream starts
+// after.
+func (m *fakeMaster) handshake(w *bufio.Writer, cmd *redis.Command) int64 {
+	offset := m.Offset()
+	if cmd.Is("psync") && len(cmd.Args) == 3 && string(cmd.Args[1]) == m.ReplID {
+		n, err := strconv.ParseInt(string(cmd.Args[2]), 10, 64)
+		if err == nil && n-1 >= m.base && n-1 <= offset {
+			m.ncontinue.Incr()
+			fmt.Fprintf(w, "+CONTINUE %s\r\n", m.ReplID)
+			return n - 1
+		}
+	}
+	m.nfull.Incr()
+	if cmd.Is("psync") {
+		fmt.Fprintf(w, "+FULLRESYNC %s %d\r\n", m.ReplID, offset)
+	}
+	// a newline is what a master sends while the rdb is being saved
+	w.WriteString("\n")
+	if m.Diskless {
+		// random hex like the mark of a real master
+		mark := fmt.Sprintf("%x", sha1.Sum([]byte(m.ReplID)))
+		fmt.Fprintf(w, "$EOF:%s\r\n", mark)
+		w.Write(m.RDB)
+		w.WriteString(mark)
+	} else {
+		fmt.Fprintf(w, "$%d\r\n", len(m.RDB))
+		w.Write(m.RDB)
+	}
+	return offset
+}
+
+// stream sends the backlog after offset to c until the replica is dropped.
+func (m *fakeMaster) stream(c net.Conn, offset int64) {
+	defer c.Close()
+	m.mu.Lock()
+	epoch := m.epoch
+	m.mu.Unlock()
+	var sent int64
+	for {
+		m.mu.Lock()
+		end := m.base + int64(len(m.backlog))
+		for offset == end && m.epoch == epoch && !m.CloseWhenDrained {
+			m.cond.Wait()
+			end = m.base + int64(len(m.backlog))
+		}
+		p := m.backlog[offset-m.base : end-m.base]
+		dropped := m.epoch != epoch
+		m.mu.Unlock()
+
+		if dropped || len(p) == 0 {
+			return
+		}
+		if m.DropEvery != 0 && int64(len(p)) > m.DropEvery-sent {
+			p = p[:m.DropEvery-sent]
+		}
+		if _, err := c.Write(p); err != nil {
+			return
+		}
+		offset += int64(len(p))
+		if sent += int64(len(p)); sent == m.DropEvery {
+			return
+		}
+	}
+}
@@ -0,0 +1,122 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"fmt"
+	"sync"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+)
+
+// mergeSource is one of several masters synced into a single target. Its
+// cmdSync holds the psync session and counters of that master.
+type mergeSource struct {
+	addr string
+	sync cmdSync
+
+	nsize   atomic2.Int64
+	pending sync.WaitGroup
+
+	mu sync.Mutex
+	f  *forwarder
+}
+
+func (s *mergeSource) forwarder() *forwarder {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	return s.f
+}
+
+type mergeEntry struct {
+	src *mergeSource
+	*rdb.BinEntry
+}
+
+// SyncMerge runs a psync session per master concurrently. Rdb entries of
+// every master are restored by one shared pool of args.parallel target
+// connections; the backlog of a master is forwarded in order once all of its
+// entries have been restored. Writes to the target share targetLimiter.
+func (cmd *cmdSync) SyncMerge(froms []string, target, passwd string, codis bool) {
+	entries := make(chan *mergeEntry, args.parallel*32)
+	for i := 0; i < args.parallel; i++ {
+		go func() {
+			c := openRedisConn(target, passwd)
+			defer c.Close()
+			var lastdb uint32 = 0
+			for e := range entries {
+				if !acceptDB(e.DB) {
+					e.src.sync.ignore.Incr()
+				} else {
+					e.src.sync.nentry.Incr()
+					if e.DB != lastdb {
+						lastdb = e.DB
+						selectDB(c, lastdb)
+					}
+					targetLimiter.Wait(len(e.Key) + len(e.Value))
+					restoreRdbEntry(c, e.BinEntry, codis)
+				}
+				e.src.pending.Done()
+			}
+		}()
+	}
+
+	var srcs []*mergeSource
+	for _, addr := range froms {
+		s := &mergeSource{addr: addr}
+		srcs = append(srcs, s)
+		go func() {
+			backlog, state := s.sync.SendPSyncCmd(s.addr, args.passwd, nil)
+			s.nsize.Set(state.nsize)
+			reader := bufio.NewReaderSize(backlog, ReaderBufferSize)
+			if state.resync {
+				for e := range newRDBLoader(reader, &s.sync.rbytes, 32) {
+					s.pending.Add(1)
+					entries <- &mergeEntry{s, e}
+				}
+				s.pending.Wait()
+				log.Infof("sync rdb of '%s' done", s.addr)
+			}
+			f := newForwarder(target, passwd, args.shards, state.offset, state.db, &s.sync.wbytes, &s.sync.forward, &s.sync.nbypass)
+			s.mu.Lock()
+			s.f = f
+			s.mu.Unlock()
+			f.Run(reader)
+		}()
+	}
+
+	lstats := make([]*cmdSyncStat, len(srcs))
+	for i, s := range srcs {
+		lstats[i] = s.sync.Stat()
+	}
+	for {
+		time.Sleep(time.Second)
+		var b bytes.Buffer
+		fmt.Fprintf(&b, "sync:")
+		for i, s := range srcs {
+			nstat, lstat := s.sync.Stat(), lstats[i]
+			fmt.Fprintf(&b, " [%s]", s.addr)
+			if f := s.forwarder(); f == nil {
+				if nsize := s.nsize.Get(); nsize != 0 {
+					fmt.Fprintf(&b, " rdb=%3d%%", 100*nstat.rbytes/nsize)
+				} else {
+					fmt.Fprintf(&b, " rdb=%d", nstat.rbytes)
+				}
+				fmt.Fprintf(&b, " entry=%-10d", nstat.nentry)
+			} else {
+				s.sync.SaveApplied(f)
+				lag := s.sync.received.Get() - s.sync.applied.Get()
+				fmt.Fprintf(&b, " +forward=%-6d +nbytes=%-8d lag=%d",
+					nstat.forward-lstat.forward, nstat.wbytes-lstat.wbytes, lag)
+			}
+			lstats[i] = nstat
+		}
+		log.Info(b.String())
+	}
+}
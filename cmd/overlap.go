@@ -0,0 +1,311 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"fmt"
+	"sync"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+
+	redigo "github.com/garyburd/redigo/redis"
+)
+
+// laneItem is either an rdb entry, a backlog command, with passed the notice
+// that every entry of db has been loaded, or, with none of them set, the
+// notice that the rdb has been loaded completely.
+type laneItem struct {
+	db     uint32
+	entry  *rdb.BinEntry
+	args   [][]byte
+	size   int64
+	passed bool
+}
+
+// laneBudget bounds the bytes of backlog commands copied into the lanes and
+// not applied yet. The backlog reader waits for room, so a master that
+// outruns the rdb backs up into the backlog pipe rather than into the heap.
+type laneBudget struct {
+	mu      sync.Mutex
+	nonfull *sync.Cond
+	size    int64
+	limit   int64
+}
+
+func newLaneBudget(limit int64) *laneBudget {
+	b := &laneBudget{limit: limit}
+	b.nonfull = sync.NewCond(&b.mu)
+	return b
+}
+
+func (b *laneBudget) Acquire(n int64) {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+	for b.size != 0 && b.size+n > b.limit {
+		b.nonfull.Wait()
+	}
+	b.size += n
+}
+
+func (b *laneBudget) Release(n int64) {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+	b.size -= n
+	b.nonfull.Signal()
+}
+
+// lane restores rdb entries and replays backlog commands of the keys hashed
+// to it on a single connection. Until the rdb is past the db of its key, a
+// command is held back while the key has not been restored yet, since the
+// entry may still come and would overwrite it. Redis writes each db once and
+// in order, so a key that is not restored once its db has been passed is not
+// in the rdb. held counts the bytes of the commands held back by every lane.
+type lane struct {
+	c      redigo.Conn
+	db     uint32
+	items  chan *laneItem
+	loaded bool
+	passed map[uint32]bool
+	budget *laneBudget
+	held   *atomic2.Int64
+
+	restored map[uint64]struct{}
+	pending  map[uint64][]*laneItem
+	order    []uint64
+}
+
+func laneKey(db uint32, key []byte) uint64 {
+	var h uint64 = 14695981039346656037
+	for i := uint(0); i < 32; i += 8 {
+		h = (h ^ uint64(byte(db>>i))) * 1099511628211
+	}
+	for _, b := range key {
+		h = (h ^ uint64(b)) * 1099511628211
+	}
+	return h
+}
+
+func (l *lane) run(cmd *cmdSync, codis bool) {
+	defer l.c.Close()
+	for it := range l.items {
+		switch {
+		case it.entry != nil:
+			e := it.entry
+			if !acceptDB(e.DB) {
+				cmd.ignore.Incr()
+				continue
+			}
+			cmd.nentry.Incr()
+			l.selectDB(e.DB)
+			targetLimiter.Wait(len(e.Key) + len(e.Value))
+			restoreRdbEntry(l.c, e, codis)
+			h := laneKey(e.DB, e.Key)
+			l.restored[h] = struct{}{}
+			for _, p := range l.pending[h] {
+				l.apply(p)
+				l.held.Sub(p.size)
+			}
+			delete(l.pending, h)
+		case it.args != nil:
+			h := laneKey(it.db, it.args[1])
+			if _, ok := l.restored[h]; l.loaded || l.passed[it.db] || ok {
+				l.apply(it)
+			} else {
+				if _, ok := l.pending[h]; !ok {
+					l.order = append(l.order, h)
+				}
+				l.pending[h] = append(l.pending[h], it)
+				l.held.Add(it.size)
+			}
+		case it.passed:
+			l.passed[it.db] = true
+			l.release(func(db uint32) bool { return db == it.db })
+		default:
+			l.release(func(uint32) bool { return true })
+			l.loaded = true
+			l.restored, l.pending, l.order = nil, nil, nil
+		}
+	}
+}
+
+// release replays the commands held back for the keys of the dbs that match,
+// in the order they arrived.
+func (l *lane) release(match func(db uint32) bool) {
+	order := l.order[:0]
+	for _, h := range l.order {
+		p := l.pending[h]
+		if len(p) == 0 {
+			// restored since
+			continue
+		}
+		if !match(p[0].db) {
+			order = append(order, h)
+			continue
+		}
+		for _, it := range p {
+			l.apply(it)
+			l.held.Sub(it.size)
+		}
+		delete(l.pending, h)
+	}
+	l.order = order
+}
+
+func (l *lane) selectDB(db uint32) {
+	if l.db != db {
+		l.db = db
+		selectDB(l.c, db)
+	}
+}
+
+func (l *lane) apply(it *laneItem) {
+	l.selectDB(it.db)
+	args := make([]interface{}, len(it.args)-1)
+	size := len(it.args[0])
+	for i := range args {
+		args[i] = it.args[i+1]
+		size += len(it.args[i+1])
+	}
+	targetLimiter.Wait(size)
+	if _, err := l.c.Do(string(it.args[0]), args...); err != nil {
+		if _, ok := err.(redigo.Error); !ok {
+			log.PanicError(err, "replay backlog command failed")
+		}
+	}
+	l.budget.Release(it.size)
+}
+
+// SyncOverlap loads the rdb and replays the backlog at the same time. Rdb
+// entries and single-key commands are routed by key into args.parallel
+// ordered lanes. The first command that is not single-key, or one that comes
+// while OverlapHeldSize bytes of commands wait for keys of the db being
+// loaded, stops the replay until the rdb is loaded. At most
+// OverlapPendingSize bytes of commands are held by the lanes. Once the lanes
+// have drained, the rest of the backlog is handed over to f.
+//
+// It returns after the lanes have drained, when every entry and command they
+// were given has been answered by the target, so a checkpoint saved from f
+// afterwards never covers an rdb entry that is still in flight.
+func (cmd *cmdSync) SyncOverlap(rdbReader, reader *bufio.Reader, target, passwd string, nsize int64, codis bool, f *forwarder) {
+	lanes := make([]*lane, args.parallel)
+	budget := newLaneBudget(OverlapPendingSize)
+	held := &atomic2.Int64{}
+	wait := &sync.WaitGroup{}
+	for i := range lanes {
+		l := &lane{c: openRedisConn(target, passwd), items: make(chan *laneItem, 1024), budget: budget, held: held}
+		l.passed = make(map[uint32]bool)
+		l.restored = make(map[uint64]struct{})
+		l.pending = make(map[uint64][]*laneItem)
+		lanes[i] = l
+		wait.Add(1)
+		go func() {
+			defer wait.Done()
+			l.run(cmd, codis)
+		}()
+	}
+	route := func(it *laneItem, key []byte) {
+		lanes[laneKey(it.db, key)%uint64(len(lanes))].items <- it
+	}
+
+	// the lanes are closed and f takes over once the rdb is loaded, not when
+	// the next command of a quiet master arrives, mu guards closed and f
+	// until then
+	var mu sync.Mutex
+	var closed bool
+	drained := make(chan struct{})
+	go func() {
+		defer close(drained)
+		var db int64 = -1
+		for e := range newRDBLoader(rdbReader, &cmd.rbytes, args.parallel*32) {
+			if db != int64(e.DB) {
+				if db != -1 {
+					for _, l := range lanes {
+						l.items <- &laneItem{db: uint32(db), passed: true}
+					}
+				}
+				db = int64(e.DB)
+			}
+			route(&laneItem{db: e.DB, entry: e}, e.Key)
+		}
+		mu.Lock()
+		defer mu.Unlock()
+		for _, l := range lanes {
+			l.items <- &laneItem{}
+			close(l.items)
+		}
+		closed = true
+		wait.Wait()
+		f.commit()
+		log.Info("sync overlap: lanes drained")
+	}()
+
+	go func() {
+		var decoder = redis.NewCommandDecoder(reader)
+		var c *redis.Command
+		for {
+			c = decoder.MustDecode()
+			var it *laneItem
+			if !c.Is("ping") && !c.Is("select") && !f.bypass {
+				if !isSingleKeyCommand(c) || held.Get() >= OverlapHeldSize {
+					break
+				}
+				it = &laneItem{db: f.db, size: int64(len(c.Raw))}
+				budget.Acquire(it.size)
+			}
+			mu.Lock()
+			if closed {
+				mu.Unlock()
+				if it != nil {
+					budget.Release(it.size)
+				}
+				break
+			}
+			if it == nil {
+				f.process(c)
+			} else {
+				f.offset += int64(len(c.Raw))
+				f.forward.Incr()
+				it.args = make([][]byte, len(c.Args))
+				for i, arg := range c.Args {
+					it.args[i] = append([]byte(nil), arg...)
+				}
+				route(it, it.args[1])
+			}
+			mu.Unlock()
+		}
+		<-drained
+
+		f.process(c)
+		f.commit()
+		f.run(decoder)
+	}()
+
+	for done := false; !done; {
+		select {
+		case <-drained:
+			done = true
+		case <-time.After(time.Second):
+		}
+		stat := cmd.Stat()
+		var b bytes.Buffer
+		if nsize != 0 {
+			fmt.Fprintf(&b, "total=%d - %12d [%3d%%]", nsize, stat.rbytes, 100*stat.rbytes/nsize)
+		} else {
+			fmt.Fprintf(&b, "total=%12d", stat.rbytes)
+		}
+		fmt.Fprintf(&b, "  entry=%-12d", stat.nentry)
+		if stat.ignore != 0 {
+			fmt.Fprintf(&b, "  ignore=%-12d", stat.ignore)
+		}
+		fmt.Fprintf(&b, "  forward=%-12d", stat.forward)
+		log.Info(b.String())
+	}
+	log.Info("sync rdb done")
+}
@@ -0,0 +1,107 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"sync"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+)
+
+// rateLimiter is a token bucket of bytes per second, with a burst of one
+// second. A rate of 0 means unlimited, and a nil limiter never waits. The
+// limiter can also be paused, which holds back every write to the targets.
+type rateLimiter struct {
+	mu     sync.Mutex
+	cond   *sync.Cond
+	rate   float64
+	tokens float64
+	last   time.Time
+	paused bool
+
+	// gated is set when the limiter is paused or limited, so that an idle
+	// limiter costs an atomic load.
+	gated atomic2.Bool
+}
+
+func newRateLimiter(rate int64) *rateLimiter {
+	l := &rateLimiter{}
+	l.cond = sync.NewCond(&l.mu)
+	l.SetRate(rate)
+	return l
+}
+
+func (l *rateLimiter) SetRate(rate int64) {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	l.rate, l.tokens, l.last = float64(rate), float64(rate), time.Now()
+	l.gated.Set(l.paused || l.rate != 0)
+}
+
+func (l *rateLimiter) Rate() int64 {
+	if l == nil {
+		return 0
+	}
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	return int64(l.rate)
+}
+
+func (l *rateLimiter) Pause() {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	l.paused = true
+	l.gated.Set(true)
+}
+
+func (l *rateLimiter) Resume() {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	l.paused = false
+	l.gated.Set(l.rate != 0)
+	l.cond.Broadcast()
+}
+
+func (l *rateLimiter) Paused() bool {
+	if l == nil || !l.gated.Get() {
+		return false
+	}
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	return l.paused
+}
+
+// Reserve takes n bytes from the bucket and returns how long the caller has
+// to wait before sending them. It blocks while the limiter is paused.
+func (l *rateLimiter) Reserve(n int) time.Duration {
+	if l == nil || !l.gated.Get() {
+		return 0
+	}
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	for l.paused {
+		l.cond.Wait()
+	}
+	if l.rate == 0 {
+		return 0
+	}
+	now := time.Now()
+	l.tokens += now.Sub(l.last).Seconds() * l.rate
+	if l.tokens > l.rate {
+		l.tokens = l.rate
+	}
+	l.last = now
+	l.tokens -= float64(n)
+	if l.tokens >= 0 {
+		return 0
+	}
+	return time.Duration(-l.tokens / l.rate * float64(time.Second))
+}
+
+func (l *rateLimiter) Wait(n int) {
+	if d := l.Reserve(n); d != 0 {
+		time.Sleep(d)
+	}
+}
@@ -8,13 +8,11 @@ import (
 	"bytes"
 	"fmt"
 	"io"
-	"io/ioutil"
 	"os"
 	"time"
 
 	"github.com/CodisLabs/codis/pkg/utils/log"
 	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
-	"github.com/CodisLabs/redis-port/pkg/redis"
 )
 
 type cmdRestore struct {
@@ -132,47 +130,8 @@ func (cmd *cmdRestore) RestoreRDBFile(reader *bufio.Reader, target, passwd strin
 }
 
 func (cmd *cmdRestore) RestoreCommand(reader *bufio.Reader, target, passwd string) {
-	c := openNetConn(target, passwd)
-	defer c.Close()
-
-	writer := bufio.NewWriterSize(c, WriterBufferSize)
-	defer flushWriter(writer)
-
-	go func() {
-		p := make([]byte, ReaderBufferSize)
-		for {
-			iocopy(c, ioutil.Discard, p, len(p))
-		}
-	}()
-
-	go func() {
-		var bypass bool = false
-		for {
-			resp := redis.MustDecode(reader)
-			if scmd, args, err := redis.ParseArgs(resp); err != nil {
-				log.PanicError(err, "parse command arguments failed")
-			} else if scmd != "ping" {
-				if scmd == "select" {
-					if len(args) != 1 {
-						log.Panicf("select command len(args) = %d", len(args))
-					}
-					s := string(args[0])
-					n, err := parseInt(s, MinDB, MaxDB)
-					if err != nil {
-						log.PanicErrorf(err, "parse db = %s failed", s)
-					}
-					bypass = !acceptDB(uint32(n))
-				}
-				if bypass {
-					cmd.nbypass.Incr()
-					continue
-				}
-			}
-			cmd.forward.Incr()
-			redis.MustEncode(writer, resp)
-			flushWriter(writer)
-		}
-	}()
+	f := newForwarder(target, passwd, args.shards, 0, 0, nil, &cmd.forward, &cmd.nbypass)
+	go f.Run(reader)
 
 	for lstat := cmd.Stat(); ; {
 		time.Sleep(time.Second)
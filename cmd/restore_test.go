@@ -0,0 +1,51 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"testing"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+)
+
+// testRdb returns an rdb of n keys of the built-in mix, spread over dbs 0
+// and 2.
+func testRdb(n int64) []byte {
+	s := defaultGenSpec()
+	s.Keys, s.Seed, s.Time = n, 1, 1e12
+	s.DBs = map[string]float64{"0": 1, "2": 1}
+	return testGen(s, 4)
+}
+
+func TestRestoreRDBFile(t *testing.T) {
+	defer withParallel(4)()
+	p := testRdb(2000)
+	for _, codis := range []bool{false, true} {
+		sink := startFakeTarget(time.Microsecond*100, time.Microsecond*100, true)
+		cmd := new(cmdRestore)
+		cmd.RestoreRDBFile(bufio.NewReader(bytes.NewReader(p)), sink.Addr(), "", int64(len(p)), codis)
+		sink.Close()
+		assert.Must(cmd.rbytes.Get() == int64(len(p)))
+		assert.Must(cmd.nentry.Get() == 2000)
+		assert.Must(sink.NumKeys() == 2000 && sink.failed.Get() == 0)
+	}
+}
+
+func benchmarkRestoreRDBFile(b *testing.B, latency time.Duration) {
+	defer withParallel(8)()
+	p := testRdb(20000)
+	sink := startFakeTarget(latency, latency/4, false)
+	defer sink.Close()
+	b.SetBytes(int64(len(p)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		new(cmdRestore).RestoreRDBFile(bufio.NewReader(bytes.NewReader(p)), sink.Addr(), "", int64(len(p)), false)
+	}
+}
+
+func BenchmarkRestoreRDBFile(b *testing.B)           { benchmarkRestoreRDBFile(b, 0) }
+func BenchmarkRestoreRDBFileLatency1ms(b *testing.B) { benchmarkRestoreRDBFile(b, time.Millisecond) }
@@ -0,0 +1,550 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"os"
+	"os/signal"
+	"strconv"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+
+	redigo "github.com/garyburd/redigo/redis"
+)
+
+// scanner reads the keyspace of masters that refuse SYNC/PSYNC: each db of
+// each master is walked by its own SCAN cursor, and keys are fetched with
+// pipelined PTTL + DUMP in batches of count keys.
+type scanner struct {
+	passwd string
+	count  int
+
+	nscan, nfetch, nmiss atomic2.Int64
+
+	mu     sync.Mutex
+	notify map[string]string
+}
+
+type scanStat struct {
+	nscan, nfetch, nmiss int64
+}
+
+func newScanner(passwd string, count int) *scanner {
+	return &scanner{passwd: passwd, count: count, notify: make(map[string]string)}
+}
+
+func (s *scanner) Stat() *scanStat {
+	return &scanStat{
+		nscan:  s.nscan.Get(),
+		nfetch: s.nfetch.Get(),
+		nmiss:  s.nmiss.Get(),
+	}
+}
+
+// scanBatch is a batch of keys of one db of one master.
+type scanBatch struct {
+	addr string
+	db   uint32
+	keys [][]byte
+}
+
+// fetchConn is a connection to a master that remembers the selected db.
+type fetchConn struct {
+	c  redigo.Conn
+	db uint32
+}
+
+func (s *scanner) openFetchConn(addr string) *fetchConn {
+	return &fetchConn{c: openRedisConn(addr, s.passwd)}
+}
+
+// Fetch returns the entries of keys in db, and the keys that no longer exist.
+// PTTL and DUMP of a key are sent in a MULTI/EXEC, so the ttl is the one of
+// the dumped value.
+func (f *fetchConn) Fetch(db uint32, keys [][]byte) ([]*rdb.BinEntry, [][]byte) {
+	if db != f.db {
+		f.db = db
+		selectDB(f.c, db)
+	}
+	for _, key := range keys {
+		f.c.Send("MULTI")
+		f.c.Send("PTTL", key)
+		f.c.Send("DUMP", key)
+		if err := f.c.Send("EXEC"); err != nil {
+			log.PanicError(err, "send PTTL + DUMP commands failed")
+		}
+	}
+	if err := f.c.Flush(); err != nil {
+		log.PanicError(err, "flush DUMP commands failed")
+	}
+	var entries []*rdb.BinEntry
+	var missing [][]byte
+	for _, key := range keys {
+		for i := 0; i < 3; i++ {
+			if _, err := f.c.Receive(); err != nil {
+				log.PanicError(err, "MULTI command error")
+			}
+		}
+		r, err := redigo.Values(f.c.Receive())
+		if err != nil || len(r) != 2 {
+			log.PanicErrorf(err, "EXEC command error, %d replies", len(r))
+		}
+		now := uint64(time.Now().UnixNano() / int64(time.Millisecond))
+		ttlms, err := redigo.Int64(r[0], nil)
+		if err != nil {
+			log.PanicError(err, "PTTL command error")
+		}
+		value, err := redigo.Bytes(r[1], nil)
+		switch {
+		case ttlms == -2 || err == redigo.ErrNil:
+			missing = append(missing, key)
+			continue
+		case err != nil:
+			log.PanicError(err, "DUMP command error")
+		}
+		e := &rdb.BinEntry{DB: db, Key: key, Value: value}
+		if ttlms >= 0 {
+			e.ExpireAt = now + uint64(ttlms)
+		}
+		entries = append(entries, e)
+	}
+	return entries, missing
+}
+
+// listKeyspace returns the dbs that hold keys according to INFO keyspace.
+func listKeyspace(c redigo.Conn) []uint32 {
+	info, err := redigo.String(c.Do("INFO", "keyspace"))
+	if err != nil {
+		log.PanicError(err, "INFO command error")
+	}
+	var dbs []uint32
+	for _, line := range strings.Split(info, "\n") {
+		line = strings.TrimSpace(line)
+		if !strings.HasPrefix(line, "db") {
+			continue
+		}
+		i := strings.IndexByte(line, ':')
+		if i < 0 {
+			continue
+		}
+		n, err := strconv.ParseUint(line[2:i], 10, 32)
+		if err != nil {
+			log.PanicErrorf(err, "invalid keyspace '%s'", line)
+		}
+		if acceptDB(uint32(n)) {
+			dbs = append(dbs, uint32(n))
+		}
+	}
+	return dbs
+}
+
+// scanTarget is a db of a master, walked by one SCAN cursor.
+type scanTarget struct {
+	addr string
+	db   uint32
+}
+
+type scanTargetsByDB []scanTarget
+
+func (s scanTargetsByDB) Len() int           { return len(s) }
+func (s scanTargetsByDB) Less(i, j int) bool { return s[i].db < s[j].db }
+func (s scanTargetsByDB) Swap(i, j int)      { s[i], s[j] = s[j], s[i] }
+
+// Keyspace lists the accepted dbs of addrs that hold keys.
+func (s *scanner) Keyspace(addrs []string) []scanTarget {
+	var list []scanTarget
+	for _, addr := range addrs {
+		c := openRedisConn(addr, s.passwd)
+		dbs := listKeyspace(c)
+		c.Close()
+		log.Infof("scan '%s', db = %v", addr, dbs)
+		for _, db := range dbs {
+			list = append(list, scanTarget{addr, db})
+		}
+	}
+	return list
+}
+
+// DumpVersion returns the newest rdb version of the DUMP payloads of targets,
+// probed with a random key of each, or 0 if they hold no keys.
+func (s *scanner) DumpVersion(targets []scanTarget) (int, error) {
+	var version int
+	for _, t := range targets {
+		c := openRedisConn(t.addr, s.passwd)
+		selectDB(c, t.db)
+		// a key may be deleted between RANDOMKEY and DUMP
+		for i := 0; i < 3; i++ {
+			key, err := redigo.Bytes(c.Do("RANDOMKEY"))
+			if err == redigo.ErrNil {
+				break
+			} else if err != nil {
+				c.Close()
+				return 0, errors.Trace(err)
+			}
+			p, err := redigo.Bytes(c.Do("DUMP", key))
+			if err == redigo.ErrNil {
+				continue
+			} else if err != nil {
+				c.Close()
+				return 0, errors.Trace(err)
+			}
+			v, err := rdb.DumpVersion(p)
+			if err != nil {
+				c.Close()
+				return 0, errors.Errorf("'%s' %s", t.addr, err)
+			}
+			if v > version {
+				version = v
+			}
+			break
+		}
+		c.Close()
+	}
+	return version, nil
+}
+
+// Scan walks every accepted db of addrs concurrently, and fetches the keys on
+// nconn connections.
+func (s *scanner) Scan(addrs []string, nconn int) <-chan *rdb.BinEntry {
+	return s.ScanTargets(s.Keyspace(addrs), nconn)
+}
+
+// ScanTargets walks targets concurrently, and fetches the keys on nconn
+// connections per master. The returned channel is closed once every cursor
+// has returned to 0 and every batch has been fetched.
+func (s *scanner) ScanTargets(targets []scanTarget, nconn int) <-chan *rdb.BinEntry {
+	batches := make(chan *scanBatch, nconn*2)
+	entries := make(chan *rdb.BinEntry, nconn*s.count)
+
+	var scans sync.WaitGroup
+	for _, t := range targets {
+		scans.Add(1)
+		go func(t scanTarget) {
+			defer scans.Done()
+			s.scanDB(t.addr, t.db, batches)
+		}(t)
+	}
+	go func() {
+		scans.Wait()
+		close(batches)
+	}()
+
+	var fetches sync.WaitGroup
+	for i := 0; i < nconn; i++ {
+		fetches.Add(1)
+		go func() {
+			defer fetches.Done()
+			conns := make(map[string]*fetchConn)
+			defer func() {
+				for _, f := range conns {
+					f.c.Close()
+				}
+			}()
+			for b := range batches {
+				f := conns[b.addr]
+				if f == nil {
+					f = s.openFetchConn(b.addr)
+					conns[b.addr] = f
+				}
+				list, missing := f.Fetch(b.db, b.keys)
+				s.nfetch.Add(int64(len(list)))
+				s.nmiss.Add(int64(len(missing)))
+				for _, e := range list {
+					entries <- e
+				}
+			}
+		}()
+	}
+	go func() {
+		fetches.Wait()
+		close(entries)
+	}()
+	return entries
+}
+
+func (s *scanner) scanDB(addr string, db uint32, batches chan<- *scanBatch) {
+	c := openRedisConn(addr, s.passwd)
+	defer c.Close()
+	selectDB(c, db)
+	for cursor := "0"; ; {
+		r, err := redigo.Values(c.Do("SCAN", cursor, "COUNT", s.count))
+		if err != nil {
+			log.PanicErrorf(err, "SCAN command error, db = %d", db)
+		}
+		var keys [][]byte
+		if _, err := redigo.Scan(r, &cursor, &keys); err != nil {
+			log.PanicErrorf(err, "invalid SCAN response, db = %d", db)
+		}
+		s.nscan.Add(int64(len(keys)))
+		if len(keys) != 0 {
+			batches <- &scanBatch{addr: addr, db: db, keys: keys}
+		}
+		if cursor == "0" {
+			return
+		}
+	}
+}
+
+// tailSet collects the keys touched since they were last fetched, keyed by
+// master and db. A key is kept once however often it is written, so memory is
+// bounded by the distinct keys rather than by the writes.
+type tailSet struct {
+	mu     sync.Mutex
+	keys   map[string]*tailKeys
+	notify chan struct{}
+}
+
+type tailKeys struct {
+	addr string
+	db   uint32
+	seen map[string]struct{}
+	keys [][]byte
+}
+
+func newTailSet() *tailSet {
+	return &tailSet{
+		keys:   make(map[string]*tailKeys),
+		notify: make(chan struct{}, 1),
+	}
+}
+
+func (t *tailSet) Add(addr string, db uint32, key []byte) {
+	t.mu.Lock()
+	id := addr + "@" + strconv.FormatUint(uint64(db), 10)
+	x := t.keys[id]
+	if x == nil {
+		x = &tailKeys{addr: addr, db: db, seen: make(map[string]struct{})}
+		t.keys[id] = x
+	}
+	if _, ok := x.seen[string(key)]; !ok {
+		x.seen[string(key)] = struct{}{}
+		x.keys = append(x.keys, key)
+	}
+	t.mu.Unlock()
+	select {
+	case t.notify <- struct{}{}:
+	default:
+	}
+}
+
+// Take waits for touched keys and returns them in batches of at most count
+// keys.
+func (t *tailSet) Take(count int) []*scanBatch {
+	<-t.notify
+	t.mu.Lock()
+	keys := t.keys
+	t.keys = make(map[string]*tailKeys)
+	t.mu.Unlock()
+
+	var batches []*scanBatch
+	for _, x := range keys {
+		for len(x.keys) != 0 {
+			n := count
+			if n > len(x.keys) {
+				n = len(x.keys)
+			}
+			batches = append(batches, &scanBatch{addr: x.addr, db: x.db, keys: x.keys[:n:n]})
+			x.keys = x.keys[n:]
+		}
+	}
+	return batches
+}
+
+// Tail subscribes to keyspace notifications of addrs, so that writes made
+// while and after the keyspace is scanned can be fetched again. It enables
+// notify-keyspace-events when it is allowed to.
+func (s *scanner) Tail(addrs []string) *tailSet {
+	t := newTailSet()
+	for _, addr := range addrs {
+		if err := s.enableNotify(addr); err != nil {
+			log.Errorf("set notify-keyspace-events of '%s' failed, %s", addr, err)
+			log.Errorf("--scantail needs keyspace notifications, please run `CONFIG SET notify-keyspace-events KA` on '%s' and try again", addr)
+			s.RestoreNotify()
+			os.Exit(1)
+		}
+		c := redigo.PubSubConn{Conn: openRedisConn(addr, s.passwd)}
+		if err := c.PSubscribe("__keyspace@*__:*"); err != nil {
+			log.PanicErrorf(err, "subscribe keyspace of '%s' failed", addr)
+		}
+		ready := make(chan struct{})
+		go func(addr string, ready chan struct{}) {
+			defer c.Close()
+			for {
+				switch m := c.Receive().(type) {
+				case error:
+					log.PanicErrorf(m, "keyspace notification of '%s' is broken", addr)
+				case redigo.Subscription:
+					if ready != nil {
+						close(ready)
+						ready = nil
+					}
+				case redigo.PMessage:
+					db, key, ok := parseKeyspaceChannel(m.Channel)
+					if ok && acceptDB(db) {
+						t.Add(addr, db, key)
+					}
+				}
+			}
+		}(addr, ready)
+		<-ready
+	}
+	return t
+}
+
+// parseKeyspaceChannel splits "__keyspace@<db>__:<key>".
+func parseKeyspaceChannel(channel string) (uint32, []byte, bool) {
+	const prefix = "__keyspace@"
+	if !strings.HasPrefix(channel, prefix) {
+		return 0, nil, false
+	}
+	s := channel[len(prefix):]
+	i := strings.Index(s, "__:")
+	if i < 0 {
+		return 0, nil, false
+	}
+	n, err := strconv.ParseUint(s[:i], 10, 32)
+	if err != nil {
+		return 0, nil, false
+	}
+	return uint32(n), []byte(s[i+3:]), true
+}
+
+// enableNotify adds 'KA' to notify-keyspace-events of addr when they are
+// missing, the flags they had are kept for RestoreNotify.
+func (s *scanner) enableNotify(addr string) error {
+	c := openRedisConn(addr, s.passwd)
+	defer c.Close()
+	r, err := redigo.Strings(c.Do("CONFIG", "GET", "notify-keyspace-events"))
+	if err != nil || len(r) != 2 {
+		log.WarnErrorf(err, "get notify-keyspace-events of '%s' failed, assume it is enabled", addr)
+		return nil
+	}
+	flags := r[1]
+	if strings.ContainsRune(flags, 'K') && strings.ContainsRune(flags, 'A') {
+		return nil
+	}
+	if _, err := c.Do("CONFIG", "SET", "notify-keyspace-events", flags+"KA"); err != nil {
+		return err
+	}
+	s.mu.Lock()
+	s.notify[addr] = flags
+	s.mu.Unlock()
+	log.Infof("notify-keyspace-events of '%s' = '%sKA'", addr, flags)
+	return nil
+}
+
+// RestoreNotify sets notify-keyspace-events back to what they were before
+// enableNotify changed them.
+func (s *scanner) RestoreNotify() {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	for addr, flags := range s.notify {
+		var err = errors.Errorf("cannot connect to '%s'", addr)
+		if nc := openNetConnSoft(addr, s.passwd); nc != nil {
+			c := redigo.NewConn(nc, 0, 0)
+			_, err = c.Do("CONFIG", "SET", "notify-keyspace-events", flags)
+			c.Close()
+		}
+		if err != nil {
+			log.WarnErrorf(err, "restore notify-keyspace-events of '%s' to '%s' failed", addr, flags)
+		} else {
+			log.Infof("notify-keyspace-events of '%s' = '%s'", addr, flags)
+		}
+		delete(s.notify, addr)
+	}
+}
+
+// restoreNotifyOnExit calls RestoreNotify before sync exits on SIGINT or
+// SIGTERM, sync --scantail doesn't stop otherwise.
+func (s *scanner) restoreNotifyOnExit() {
+	c := make(chan os.Signal, 1)
+	signal.Notify(c, os.Interrupt, syscall.SIGTERM)
+	go func() {
+		sig := <-c
+		log.Infof("receive signal %s, exit", sig)
+		s.RestoreNotify()
+		os.Exit(1)
+	}()
+}
+
+// SyncScan copies the keyspace of froms to target with SCAN + DUMP. With a
+// tail, the keys touched since the scan started are fetched again after it
+// and then for as long as the notifications keep coming.
+func (cmd *cmdSync) SyncScan(froms []string, target, passwd string, codis bool) {
+	s := newScanner(args.passwd, args.scancount)
+
+	var tail *tailSet
+	if args.scantail {
+		s.restoreNotifyOnExit()
+		tail = s.Tail(froms)
+		defer s.RestoreNotify()
+	}
+
+	wait := cmd.RestoreEntries(s.Scan(froms, args.parallel), target, passwd, codis)
+	for done := false; !done; {
+		select {
+		case <-wait:
+			done = true
+		case <-time.After(time.Second):
+		}
+		stat := s.Stat()
+		log.Infof("scan=%-12d fetch=%-12d miss=%-8d entry=%-12d", stat.nscan, stat.nfetch, stat.nmiss, cmd.nentry.Get())
+	}
+	log.Info("sync scan done")
+
+	if tail != nil {
+		cmd.SyncTail(s, tail, target, passwd, codis)
+	}
+}
+
+// SyncTail fetches touched keys again and applies them on target, keys that
+// are gone are deleted.
+func (cmd *cmdSync) SyncTail(s *scanner, tail *tailSet, target, passwd string, codis bool) {
+	go func() {
+		c := openRedisConn(target, passwd)
+		defer c.Close()
+		var lastdb uint32 = 0
+		conns := make(map[string]*fetchConn)
+		for {
+			for _, b := range tail.Take(s.count) {
+				f := conns[b.addr]
+				if f == nil {
+					f = s.openFetchConn(b.addr)
+					conns[b.addr] = f
+				}
+				list, missing := f.Fetch(b.db, b.keys)
+				if b.db != lastdb {
+					lastdb = b.db
+					selectDB(c, lastdb)
+				}
+				for _, e := range list {
+					targetLimiter.Wait(len(e.Key) + len(e.Value))
+					restoreRdbEntry(c, e, codis)
+				}
+				for _, key := range missing {
+					targetLimiter.Wait(len(key))
+					if _, err := c.Do("DEL", key); err != nil {
+						log.PanicError(err, "DEL command error")
+					}
+				}
+				cmd.forward.Add(int64(len(list)))
+				cmd.nbypass.Add(int64(len(missing)))
+			}
+		}
+	}()
+
+	for lstat := cmd.Stat(); ; {
+		time.Sleep(time.Second)
+		nstat := cmd.Stat()
+		log.Infof("sync: tail +restore=%-6d +delete=%-6d", nstat.forward-lstat.forward, nstat.nbypass-lstat.nbypass)
+		lstat = nstat
+	}
+}
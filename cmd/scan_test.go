@@ -0,0 +1,254 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"encoding/binary"
+	"net"
+	"strconv"
+	"strings"
+	"sync"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+	"github.com/CodisLabs/redis-port/pkg/rdb/digest"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+// scanMaster answers what the scanner sends to a master: SELECT, MULTI/EXEC
+// of PTTL + DUMP, and CONFIG GET|SET notify-keyspace-events, which is refused
+// with Refuse. Every exported method is a command handler.
+type scanMaster struct {
+	l net.Listener
+
+	Refuse bool
+
+	mu     sync.Mutex
+	dumps  map[string][]byte
+	ttls   map[string]int64
+	multi  map[interface{}][][][]byte
+	notify string
+}
+
+func startScanMaster(notify string) *scanMaster {
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	m := &scanMaster{l: l, notify: notify}
+	m.dumps = make(map[string][]byte)
+	m.ttls = make(map[string]int64)
+	m.multi = make(map[interface{}][][][]byte)
+	go redis.MustServer(m).Serve(l)
+	return m
+}
+
+func (m *scanMaster) addr() string {
+	return m.l.Addr().String()
+}
+
+func (m *scanMaster) close() error {
+	return m.l.Close()
+}
+
+func (m *scanMaster) set(key string, value interface{}, ttl int64) {
+	p, err := rdb.EncodeDump(value)
+	assert.MustNoError(err)
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	m.dumps[key], m.ttls[key] = p, ttl
+}
+
+// setVersion rewrites the rdb version of the DUMP payload of key.
+func (m *scanMaster) setVersion(key string, v uint16) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	p := m.dumps[key]
+	binary.LittleEndian.PutUint16(p[len(p)-10:], v)
+	binary.LittleEndian.PutUint64(p[len(p)-8:], digest.Update(0, p[:len(p)-8]))
+}
+
+func (m *scanMaster) Randomkey(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	for key := range m.dumps {
+		return redis.NewBulkBytes([]byte(key)), nil
+	}
+	return nil, nil
+}
+
+func (m *scanMaster) Select(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	return redis.NewString("OK"), nil
+}
+
+func (m *scanMaster) Multi(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	m.multi[arg0] = [][][]byte{}
+	return redis.NewString("OK"), nil
+}
+
+func (m *scanMaster) Exec(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	queued, ok := m.multi[arg0]
+	if !ok {
+		return nil, errors.Errorf("EXEC without MULTI")
+	}
+	delete(m.multi, arg0)
+	r := redis.NewArray()
+	for _, c := range queued {
+		if strings.EqualFold(string(c[0]), "pttl") {
+			r.Append(m.pttl(string(c[1])))
+		} else {
+			r.Append(m.dump(string(c[1])))
+		}
+	}
+	return r, nil
+}
+
+// queue returns true if a MULTI of arg0 is open and takes args in.
+func (m *scanMaster) queue(arg0 interface{}, args [][]byte) bool {
+	queued, ok := m.multi[arg0]
+	if ok {
+		m.multi[arg0] = append(queued, args)
+	}
+	return ok
+}
+
+func (m *scanMaster) Pttl(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	if m.queue(arg0, [][]byte{[]byte("pttl"), args[0]}) {
+		return redis.NewString("QUEUED"), nil
+	}
+	return m.pttl(string(args[0])), nil
+}
+
+func (m *scanMaster) Dump(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	if m.queue(arg0, [][]byte{[]byte("dump"), args[0]}) {
+		return redis.NewString("QUEUED"), nil
+	}
+	return m.dump(string(args[0])), nil
+}
+
+func (m *scanMaster) pttl(key string) redis.Resp {
+	if _, ok := m.dumps[key]; !ok {
+		return redis.NewInt(-2)
+	}
+	return redis.NewInt(m.ttls[key])
+}
+
+func (m *scanMaster) dump(key string) redis.Resp {
+	return redis.NewBulkBytes(m.dumps[key])
+}
+
+func (m *scanMaster) Config(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	switch {
+	case len(args) == 2 && strings.EqualFold(string(args[0]), "get"):
+		r := redis.NewArray()
+		r.AppendBulkBytes(args[1])
+		r.AppendBulkBytes([]byte(m.notify))
+		return r, nil
+	case len(args) == 3 && strings.EqualFold(string(args[0]), "set"):
+		if m.Refuse {
+			return nil, errors.Errorf("unknown command 'CONFIG'")
+		}
+		m.notify = string(args[2])
+		return redis.NewString("OK"), nil
+	}
+	return nil, errors.Errorf("wrong number of arguments for 'config' command")
+}
+
+func (m *scanMaster) flags() string {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	return m.notify
+}
+
+func TestScanFetch(t *testing.T) {
+	m := startScanMaster("")
+	defer m.close()
+	m.set("a", rdb.String("1"), 100000)
+	m.set("b", rdb.String("2"), -1)
+
+	s := newScanner("", 10)
+	f := s.openFetchConn(m.addr())
+	defer f.c.Close()
+	list, missing := f.Fetch(1, [][]byte{[]byte("a"), []byte("gone"), []byte("b")})
+	assert.Must(len(list) == 2 && len(missing) == 1 && string(missing[0]) == "gone")
+	assert.Must(string(list[0].Key) == "a" && list[0].ExpireAt != 0 && list[0].DB == 1)
+	assert.Must(string(list[1].Key) == "b" && list[1].ExpireAt == 0)
+	o, err := rdb.DecodeDump(list[1].Value)
+	assert.Must(err == nil && string(o.(rdb.String)) == "2")
+}
+
+func TestScanNotify(t *testing.T) {
+	m := startScanMaster("Ex")
+	defer m.close()
+	s := newScanner("", 10)
+	assert.MustNoError(s.enableNotify(m.addr()))
+	assert.Must(m.flags() == "ExKA")
+	s.RestoreNotify()
+	assert.Must(m.flags() == "Ex")
+
+	m.mu.Lock()
+	m.Refuse = true
+	m.mu.Unlock()
+	assert.Must(s.enableNotify(m.addr()) != nil)
+	assert.Must(m.flags() == "Ex")
+}
+
+func TestScanDumpVersion(t *testing.T) {
+	m1, m2 := startScanMaster(""), startScanMaster("")
+	defer m1.close()
+	defer m2.close()
+	targets := []scanTarget{{m1.addr(), 0}, {m2.addr(), 0}}
+	s := newScanner("", 10)
+	v, err := s.DumpVersion(targets)
+	assert.Must(err == nil && v == 0)
+
+	m1.set("a", rdb.String("1"), -1)
+	v, err = s.DumpVersion(targets)
+	assert.Must(err == nil && v == 6)
+
+	m2.set("b", rdb.String("2"), -1)
+	m2.setVersion("b", rdb.Version)
+	v, err = s.DumpVersion(targets)
+	assert.Must(err == nil && v == rdb.Version)
+
+	m2.setVersion("b", rdb.Version+1)
+	_, err = s.DumpVersion(targets)
+	assert.Must(err != nil)
+}
+
+func TestTailSet(t *testing.T) {
+	s := newTailSet()
+	for i := 0; i < 10000; i++ {
+		s.Add("a", 0, []byte(strconv.Itoa(i%5)))
+		s.Add("b", 1, []byte("x"))
+	}
+	s.mu.Lock()
+	assert.Must(len(s.keys) == 2 && len(s.keys["a@0"].keys) == 5 && len(s.keys["b@1"].keys) == 1)
+	s.mu.Unlock()
+
+	var a, b int
+	for _, x := range s.Take(2) {
+		assert.Must(len(x.keys) <= 2)
+		switch {
+		case x.addr == "a" && x.db == 0:
+			a += len(x.keys)
+		case x.addr == "b" && x.db == 1:
+			b += len(x.keys)
+		}
+	}
+	assert.Must(a == 5 && b == 1)
+	s.mu.Lock()
+	assert.Must(len(s.keys) == 0)
+	s.mu.Unlock()
+}
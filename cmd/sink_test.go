@@ -0,0 +1,208 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"encoding/binary"
+	"math/rand"
+	"net"
+	"strconv"
+	"sync"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/rdb/digest"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+// fakeTarget stands in for the target redis of restore and sync. It is a
+// redis.Server that answers every request with +OK (PING with +PONG), so the
+// benchmarks measure redis-port rather than redis. The replies to the
+// requests that arrived together are held back for Latency plus up to Jitter,
+// as a round trip would. With Verify, RESTORE and SLOTSRESTORE payloads are
+// checked against their checksums and the restored keys are remembered.
+type fakeTarget struct {
+	l net.Listener
+
+	Latency, Jitter time.Duration
+	Verify          bool
+
+	// Trace, if set, sees every request as it is answered.
+	Trace func(name []byte, args [][]byte)
+
+	requests, restores, nbytes, failed atomic2.Int64
+
+	// seed is the jitter seed of the next connection.
+	seed atomic2.Int64
+
+	mu    sync.Mutex
+	keys  map[string]struct{}
+	conns map[net.Conn]*fakeTargetConn
+}
+
+// fakeTargetConn is the state of a connection to a fakeTarget.
+type fakeTargetConn struct {
+	db  int64
+	rnd *rand.Rand
+}
+
+func newFakeTarget() *fakeTarget {
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	t := &fakeTarget{l: l}
+	t.keys = make(map[string]struct{})
+	t.conns = make(map[net.Conn]*fakeTargetConn)
+	return t
+}
+
+// startFakeTarget starts a fakeTarget, its settings must not be changed once
+// it has been started.
+func startFakeTarget(latency, jitter time.Duration, verify bool) *fakeTarget {
+	t := newFakeTarget()
+	t.Latency, t.Jitter, t.Verify = latency, jitter, verify
+	return t.Start()
+}
+
+// Start serves the target, its settings must not be changed afterwards.
+func (t *fakeTarget) Start() *fakeTarget {
+	h := &fakeTargetHandler{t}
+	s := redis.MustServer(h)
+	s.Fallback = h.reply
+	s.BeforeFlush = t.delay
+	s.OnClose = t.drop
+	go s.Serve(t.l)
+	return t
+}
+
+func (t *fakeTarget) Addr() string {
+	return t.l.Addr().String()
+}
+
+// Close stops accepting connections. Connections are left open since the
+// forwarders treat a lost target as fatal.
+func (t *fakeTarget) Close() error {
+	return t.l.Close()
+}
+
+// NumKeys returns the number of distinct keys restored, with Verify.
+func (t *fakeTarget) NumKeys() int {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	return len(t.keys)
+}
+
+func (t *fakeTarget) conn(c net.Conn) *fakeTargetConn {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	x := t.conns[c]
+	if x == nil {
+		x = &fakeTargetConn{rnd: rand.New(rand.NewSource(t.seed.Incr()))}
+		t.conns[c] = x
+	}
+	return x
+}
+
+func (t *fakeTarget) drop(c net.Conn) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	delete(t.conns, c)
+}
+
+func (t *fakeTarget) delay(c net.Conn) {
+	if delay := t.Latency; delay != 0 || t.Jitter != 0 {
+		if t.Jitter != 0 {
+			delay += time.Duration(t.conn(c).rnd.Int63n(int64(t.Jitter)))
+		}
+		time.Sleep(delay)
+	}
+}
+
+var (
+	fakeReplyOK   = redis.NewString("OK")
+	fakeReplyPong = redis.NewString("PONG")
+)
+
+// fakeTargetHandler holds the commands of a fakeTarget, every exported
+// method is a handler and the rest are answered by reply.
+type fakeTargetHandler struct {
+	t *fakeTarget
+}
+
+func (h *fakeTargetHandler) count(name []byte, args [][]byte) {
+	n := len(name)
+	for _, arg := range args {
+		n += len(arg)
+	}
+	h.t.requests.Incr()
+	h.t.nbytes.Add(int64(n))
+	if h.t.Trace != nil {
+		h.t.Trace(name, args)
+	}
+}
+
+func (h *fakeTargetHandler) reply(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	h.count(args[0], args[1:])
+	return fakeReplyOK, nil
+}
+
+func (h *fakeTargetHandler) Ping(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	h.count([]byte("ping"), args)
+	return fakeReplyPong, nil
+}
+
+func (h *fakeTargetHandler) Select(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	h.count([]byte("select"), args)
+	if len(args) != 1 {
+		return h.t.fail("wrong number of arguments for 'select' command"), nil
+	}
+	n, err := strconv.ParseInt(string(args[0]), 10, 64)
+	if err != nil {
+		return h.t.fail("invalid DB index"), nil
+	}
+	h.t.conn(arg0.(net.Conn)).db = n
+	return fakeReplyOK, nil
+}
+
+func (h *fakeTargetHandler) Restore(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	h.count([]byte("restore"), args)
+	if len(args) < 3 {
+		return h.t.fail("wrong number of arguments for 'restore' command"), nil
+	}
+	return h.t.restore(h.t.conn(arg0.(net.Conn)).db, args[0], args[2]), nil
+}
+
+func (h *fakeTargetHandler) Slotsrestore(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	h.count([]byte("slotsrestore"), args)
+	if len(args) < 3 || len(args)%3 != 0 {
+		return h.t.fail("wrong number of arguments for 'slotsrestore' command"), nil
+	}
+	db := h.t.conn(arg0.(net.Conn)).db
+	for i := 0; i < len(args); i += 3 {
+		if r := h.t.restore(db, args[i], args[i+2]); r != fakeReplyOK {
+			return r, nil
+		}
+	}
+	return fakeReplyOK, nil
+}
+
+func (t *fakeTarget) restore(db int64, key, payload []byte) redis.Resp {
+	t.restores.Incr()
+	if !t.Verify {
+		return fakeReplyOK
+	}
+	n := len(payload) - 8
+	if n < 3 || digest.Update(0, payload[:n]) != binary.LittleEndian.Uint64(payload[n:]) {
+		return t.fail("DUMP payload version or checksum are wrong")
+	}
+	t.mu.Lock()
+	t.keys[strconv.FormatInt(db, 10)+":"+string(key)] = struct{}{}
+	t.mu.Unlock()
+	return fakeReplyOK
+}
+
+func (t *fakeTarget) fail(s string) redis.Resp {
+	t.failed.Incr()
+	return &redis.Error{Value: "ERR " + s}
+}
@@ -8,22 +8,55 @@ import (
 	"bytes"
 	"fmt"
 	"io"
-	"io/ioutil"
 	"net"
 	"os"
+	"sync"
 	"time"
 
+	"github.com/CodisLabs/codis/pkg/utils/errors"
 	"github.com/CodisLabs/codis/pkg/utils/log"
 	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
 	"github.com/CodisLabs/redis-port/pkg/libs/io/pipe"
-	"github.com/CodisLabs/redis-port/pkg/libs/stats"
-	"github.com/CodisLabs/redis-port/pkg/redis"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
 )
 
 type cmdSync struct {
 	rbytes, wbytes, nentry, ignore atomic2.Int64
 
 	forward, nbypass atomic2.Int64
+
+	applied  atomic2.Int64
+	received atomic2.Int64
+
+	mu     sync.Mutex
+	replid string
+
+	saved checkpoint
+
+	// parallel is the number of restore workers, 0 means args.parallel,
+	// resize is notified when it changes. fixed is set when the workers are
+	// pools of args.parallel that can't be resized, i.e. with several masters
+	// or targets, or with --overlap.
+	parallel, nworker atomic2.Int64
+	resize            chan struct{}
+	fixed             atomic2.Bool
+
+	// stages being watched by the admin port, guarded by mu.
+	backlog    pipe.Reader
+	entries    <-chan *rdb.BinEntry
+	forwarders []*forwarder
+}
+
+// psyncState tells where the command stream read from the psync pipe starts.
+// After a full resync it follows an rdb of nsize bytes (0 if diskless), or,
+// with --overlap, the rdb is read from its own pipe.
+type psyncState struct {
+	resync bool
+	nsize  int64
+	offset int64
+	db     uint32
+
+	rdb pipe.Reader
 }
 
 type cmdSyncStat struct {
@@ -49,31 +82,80 @@ func (cmd *cmdSync) Main() {
 	if len(from) == 0 {
 		log.Panic("invalid argument: from")
 	}
-	if len(target) == 0 {
+	if len(args.targets) == 0 {
 		log.Panic("invalid argument: target")
 	}
 
 	log.Infof("sync from '%s' to '%s'\n", from, target)
 
+	cmd.resize = make(chan struct{}, 1)
+	cmd.fixed.Set(!args.scan && (len(args.froms) > 1 || len(args.targets) > 1 || args.overlap))
+
+	// once per process, the segments of every session have their own names
+	if len(args.spilldir) != 0 {
+		if n, err := pipe.RemoveSpillSegments(args.spilldir); err != nil {
+			log.PanicErrorf(err, "remove stale segments under '%s' failed", args.spilldir)
+		} else if n != 0 {
+			log.Infof("removed %d stale segments under '%s'", n, args.spilldir)
+		}
+	}
+
+	if len(args.admin) != 0 {
+		if targetLimiter == nil {
+			targetLimiter = newRateLimiter(0)
+		}
+		go cmd.ServeAdmin(args.admin)
+	}
+
+	if args.scan {
+		cmd.SyncScan(args.froms, target, args.auth, args.codis)
+		return
+	}
+
+	if len(args.froms) > 1 {
+		cmd.SyncMerge(args.froms, target, args.auth, args.codis)
+		return
+	}
+
 	var sockfile *os.File
 	if len(args.sockfile) != 0 {
 		sockfile = openReadWriteFile(args.sockfile)
 		defer sockfile.Close()
 	}
 
+	var cp *checkpoint
+	if len(args.checkpoint) != 0 {
+		cp = loadCheckpoint(args.checkpoint)
+	}
+
 	var input io.ReadCloser
-	var nsize int64
+	var state *psyncState
+	var backlog pipe.Reader
 	if args.psync {
-		input, nsize = cmd.SendPSyncCmd(from, args.passwd)
+		backlog, state = cmd.SendPSyncCmd(from, args.passwd, cp)
+		input = backlog
+		cmd.mu.Lock()
+		cmd.backlog = backlog
+		cmd.mu.Unlock()
 	} else {
 		log.Panicf("SYNC mode is deprecated, please run with option '--psync'.")
 	}
 	defer input.Close()
 
-	log.Infof("rdb file = %d\n", nsize)
+	if !state.resync {
+		log.Infof("resume from offset = %d, db = %d\n", state.offset, state.db)
+	} else if state.nsize != 0 {
+		log.Infof("rdb file = %d\n", state.nsize)
+	} else {
+		log.Info("rdb file = diskless\n")
+	}
 
 	if sockfile != nil {
-		r, w := pipe.NewFilePipe(int(args.filesize), sockfile)
+		r, w, err := pipe.NewMmapFilePipe(int(args.filesize), sockfile)
+		if err != nil {
+			log.WarnErrorf(err, "mmap sockfile failed, fallback to file pipe")
+			r, w = pipe.NewFilePipe(int(args.filesize), sockfile)
+		}
 		defer r.Close()
 		go func(r io.Reader) {
 			defer w.Close()
@@ -87,56 +169,115 @@ func (cmd *cmdSync) Main() {
 
 	reader := bufio.NewReaderSize(input, ReaderBufferSize)
 
-	cmd.SyncRDBFile(reader, target, args.auth, nsize, args.codis)
-	cmd.SyncCommand(reader, target, args.auth)
-}
+	if len(args.targets) > 1 {
+		cmd.SyncFanout(reader, args.targets, args.auth, state, args.codis, backlog)
+		return
+	}
 
-func (cmd *cmdSync) SendSyncCmd(master, passwd string) (net.Conn, int64) {
-	c, wait := openSyncConn(master, passwd)
-	for {
-		select {
-		case nsize := <-wait:
-			if nsize == 0 {
-				log.Info("+")
-			} else {
-				return c, nsize
-			}
-		case <-time.After(time.Second):
-			log.Info("-")
+	if state.rdb != nil {
+		defer state.rdb.Close()
+		f := newForwarder(target, args.auth, args.shards, state.offset, state.db, &cmd.wbytes, &cmd.forward, &cmd.nbypass)
+		rdbReader := bufio.NewReaderSize(state.rdb, ReaderBufferSize)
+		cmd.SyncOverlap(rdbReader, reader, target, args.auth, state.nsize, args.codis, f)
+		cmd.ForwardLoop(f)
+		return
+	}
+
+	if state.resync {
+		cmd.SyncRDBFile(reader, target, args.auth, state.nsize, args.codis)
+		if s, ok := pipe.GetFlateStats(backlog); ok {
+			log.Infof("backlog deflate: raw = %d, flate = %d, ratio = %.2f, compress = %v, decompress = %v",
+				s.RawBytes, s.FlateSize, s.Ratio(), s.Compress, s.Decompress)
 		}
 	}
+	cmd.SyncCommand(reader, target, args.auth, state.offset, state.db)
+}
+
+func (cmd *cmdSync) ReplID() string {
+	cmd.mu.Lock()
+	defer cmd.mu.Unlock()
+	return cmd.replid
+}
+
+func (cmd *cmdSync) SetReplID(replid string) {
+	cmd.mu.Lock()
+	defer cmd.mu.Unlock()
+	cmd.replid = replid
+}
+
+func (cmd *cmdSync) SendSyncCmd(master, passwd string) (net.Conn, *bufio.Reader, *rdbHeader) {
+	c, br, wait := openSyncConn(master, passwd)
+	return c, br, waitRdbHeader(wait)
 }
 
-func (cmd *cmdSync) SendPSyncCmd(master, passwd string) (pipe.Reader, int64) {
+func (cmd *cmdSync) SendPSyncCmd(master, passwd string, cp *checkpoint) (pipe.Reader, *psyncState) {
 	c := openNetConn(master, passwd)
 	br := bufio.NewReaderSize(c, ReaderBufferSize)
 	bw := bufio.NewWriterSize(c, WriterBufferSize)
 
-	runid, offset, wait := sendPSyncFullsync(br, bw)
-	log.Infof("psync runid = %s offset = %d, fullsync", runid, offset)
+	sendReplconfCapa(br, bw)
 
-	var nsize int64
-	for nsize == 0 {
-		select {
-		case nsize = <-wait:
-			if nsize == 0 {
-				log.Info("+")
-			}
-		case <-time.After(time.Second):
-			log.Info("-")
+	state := &psyncState{resync: true}
+	runid, offset := "?", int64(-1)
+	if cp != nil {
+		runid, offset = cp.ReplID, cp.Offset
+	}
+	runid, offset, state.resync = sendPSync(br, bw, runid, offset)
+
+	var header *rdbHeader
+	if state.resync {
+		log.Infof("psync runid = %s offset = %d, fullsync", runid, offset)
+		if len(args.checkpoint) != 0 {
+			removeCheckpoint(args.checkpoint)
+		}
+		header = waitRdbHeader(waitRdbDump(br))
+		if header.mark != nil {
+			log.Infof("psync runid = %s, diskless transfer", runid)
 		}
+		state.nsize = header.size
+	} else {
+		log.Infof("psync runid = %s offset = %d, continue", runid, offset)
+		state.db = cp.DB
+	}
+	state.offset = offset
+
+	cmd.SetReplID(runid)
+	cmd.applied.Set(offset)
+	cmd.received.Set(offset)
+
+	var piper pipe.Reader
+	var pipew pipe.Writer
+	if len(args.spilldir) != 0 {
+		piper, pipew = pipe.NewSpillPipe(ReaderBufferSize, args.spilldir, args.spillsize)
+	} else if args.compress {
+		piper, pipew = pipe.NewFlatePipe(ReaderBufferSize)
+	} else {
+		piper, pipew = pipe.NewRingSize(ReaderBufferSize)
 	}
 
-	piper, pipew := pipe.NewSize(ReaderBufferSize)
+	// with --overlap the rdb is buffered ahead of the loader, so the backlog
+	// is read off the socket while the rdb is being loaded
+	var rdbw pipe.Writer = pipew
+	if header != nil && args.overlap {
+		if len(args.spilldir) != 0 {
+			state.rdb, rdbw = pipe.NewSpillPipe(ReaderBufferSize, args.spilldir, args.spillsize)
+		} else {
+			state.rdb, rdbw = pipe.NewRingSize(OverlapRdbSize)
+		}
+	}
 
 	go func() {
 		defer pipew.Close()
-		p := make([]byte, 8192)
-		for rdbsize := int(nsize); rdbsize != 0; {
-			rdbsize -= iocopy(br, pipew, p, rdbsize)
+		if header != nil {
+			if _, err := io.Copy(rdbw, header.Reader(br)); err != nil {
+				log.PanicErrorf(err, "psync runid = %s, copy rdb failed", runid)
+			}
+			if rdbw != pipew {
+				rdbw.Close()
+			}
 		}
 		for {
-			n, err := cmd.PSyncPipeCopy(c, br, bw, offset, pipew)
+			n, err := cmd.PSyncPipeCopy(c, br, bw, pipew)
 			if err != nil {
 				log.PanicErrorf(err, "psync runid = %s, offset = %d, pipe is broken", runid, offset)
 			}
@@ -154,22 +295,25 @@ func (cmd *cmdSync) SendPSyncCmd(master, passwd string) (pipe.Reader, int64) {
 			authPassword(c, passwd)
 			br = bufio.NewReaderSize(c, ReaderBufferSize)
 			bw = bufio.NewWriterSize(c, WriterBufferSize)
-			sendPSyncContinue(br, bw, runid, offset)
+			runid = sendPSyncContinue(br, bw, runid, offset)
+			cmd.SetReplID(runid)
 		}
 	}()
-	return piper, nsize
+	return piper, state
 }
 
-func (cmd *cmdSync) PSyncPipeCopy(c net.Conn, br *bufio.Reader, bw *bufio.Writer, offset int64, copyto io.Writer) (int64, error) {
+// PSyncPipeCopy copies the backlog from master into copyto, and acks the
+// offset that has been applied on the target.
+func (cmd *cmdSync) PSyncPipeCopy(c net.Conn, br *bufio.Reader, bw *bufio.Writer, copyto io.Writer) (int64, error) {
 	defer c.Close()
 	var nread atomic2.Int64
 	go func() {
 		defer c.Close()
 		for {
-			time.Sleep(time.Second * 5)
-			if err := sendPSyncAck(bw, offset+nread.Get()); err != nil {
+			if err := sendPSyncAck(bw, cmd.applied.Get()); err != nil {
 				return
 			}
+			time.Sleep(time.Second * 5)
 		}
 	}()
 
@@ -183,41 +327,13 @@ func (cmd *cmdSync) PSyncPipeCopy(c net.Conn, br *bufio.Reader, bw *bufio.Writer
 			return nread.Get(), err
 		}
 		nread.Add(int64(n))
+		cmd.received.Add(int64(n))
 	}
 }
 
 func (cmd *cmdSync) SyncRDBFile(reader *bufio.Reader, target, passwd string, nsize int64, codis bool) {
 	pipe := newRDBLoader(reader, &cmd.rbytes, args.parallel*32)
-	wait := make(chan struct{})
-	go func() {
-		defer close(wait)
-		group := make(chan int, args.parallel)
-		for i := 0; i < cap(group); i++ {
-			go func() {
-				defer func() {
-					group <- 0
-				}()
-				c := openRedisConn(target, passwd)
-				defer c.Close()
-				var lastdb uint32 = 0
-				for e := range pipe {
-					if !acceptDB(e.DB) {
-						cmd.ignore.Incr()
-					} else {
-						cmd.nentry.Incr()
-						if e.DB != lastdb {
-							lastdb = e.DB
-							selectDB(c, lastdb)
-						}
-						restoreRdbEntry(c, e, codis)
-					}
-				}
-			}()
-		}
-		for i := 0; i < cap(group); i++ {
-			<-group
-		}
-	}()
+	wait := cmd.RestoreEntries(pipe, target, passwd, codis)
 
 	for done := false; !done; {
 		select {
@@ -227,7 +343,11 @@ func (cmd *cmdSync) SyncRDBFile(reader *bufio.Reader, target, passwd string, nsi
 		}
 		stat := cmd.Stat()
 		var b bytes.Buffer
-		fmt.Fprintf(&b, "total=%d - %12d [%3d%%]", nsize, stat.rbytes, 100*stat.rbytes/nsize)
+		if nsize != 0 {
+			fmt.Fprintf(&b, "total=%d - %12d [%3d%%]", nsize, stat.rbytes, 100*stat.rbytes/nsize)
+		} else {
+			fmt.Fprintf(&b, "total=%12d", stat.rbytes)
+		}
 		fmt.Fprintf(&b, "  entry=%-12d", stat.nentry)
 		if stat.ignore != 0 {
 			fmt.Fprintf(&b, "  ignore=%-12d", stat.ignore)
@@ -237,51 +357,101 @@ func (cmd *cmdSync) SyncRDBFile(reader *bufio.Reader, target, passwd string, nsi
 	log.Info("sync rdb done")
 }
 
-func (cmd *cmdSync) SyncCommand(reader *bufio.Reader, target, passwd string) {
-	c := openNetConn(target, passwd)
-	defer c.Close()
+func (cmd *cmdSync) Parallel() int {
+	if n := cmd.parallel.Get(); n != 0 {
+		return int(n)
+	}
+	return args.parallel
+}
 
-	writer := bufio.NewWriterSize(stats.NewCountWriter(c, &cmd.wbytes), WriterBufferSize)
-	defer flushWriter(writer)
+// SetParallel changes the number of restore workers. Extra workers quit
+// after the entry at hand, missing ones are started at once.
+func (cmd *cmdSync) SetParallel(n int) error {
+	if cmd.fixed.Get() {
+		return errors.Errorf("parallel is fixed to %d with several masters or targets, or --overlap", args.parallel)
+	}
+	cmd.parallel.Set(int64(n))
+	select {
+	case cmd.resize <- struct{}{}:
+	default:
+	}
+	return nil
+}
 
-	go func() {
-		p := make([]byte, ReaderBufferSize)
+// RestoreEntries restores entries on cmd.Parallel() target connections, the
+// returned channel is closed once pipe is drained.
+func (cmd *cmdSync) RestoreEntries(pipe <-chan *rdb.BinEntry, target, passwd string, codis bool) <-chan struct{} {
+	cmd.mu.Lock()
+	cmd.entries = pipe
+	cmd.mu.Unlock()
+
+	var wg sync.WaitGroup
+	var once sync.Once
+	drained := make(chan struct{})
+	worker := func() {
+		defer wg.Done()
+		c := openRedisConn(target, passwd)
+		defer c.Close()
+		var lastdb uint32 = 0
 		for {
-			iocopy(c, ioutil.Discard, p, len(p))
+			n := cmd.nworker.Get()
+			if n > int64(cmd.Parallel()) && cmd.nworker.CompareAndSwap(n, n-1) {
+				return
+			}
+			e, ok := <-pipe
+			if !ok {
+				cmd.nworker.Decr()
+				once.Do(func() {
+					close(drained)
+				})
+				return
+			}
+			if !acceptDB(e.DB) {
+				cmd.ignore.Incr()
+			} else {
+				cmd.nentry.Incr()
+				if e.DB != lastdb {
+					lastdb = e.DB
+					selectDB(c, lastdb)
+				}
+				targetLimiter.Wait(len(e.Key) + len(e.Value))
+				restoreRdbEntry(c, e, codis)
+			}
 		}
-	}()
+	}
 
+	wait := make(chan struct{})
 	go func() {
-		var bypass bool = false
-		for {
-			resp := redis.MustDecode(reader)
-			if scmd, args, err := redis.ParseArgs(resp); err != nil {
-				log.PanicError(err, "parse command arguments failed")
-			} else if scmd != "ping" {
-				if scmd == "select" {
-					if len(args) != 1 {
-						log.Panicf("select command len(args) = %d", len(args))
-					}
-					s := string(args[0])
-					n, err := parseInt(s, MinDB, MaxDB)
-					if err != nil {
-						log.PanicErrorf(err, "parse db = %s failed", s)
-					}
-					bypass = !acceptDB(uint32(n))
-				}
-				if bypass {
-					cmd.nbypass.Incr()
-					continue
-				}
+		defer close(wait)
+		for done := false; !done; {
+			for cmd.nworker.Get() < int64(cmd.Parallel()) {
+				cmd.nworker.Incr()
+				wg.Add(1)
+				go worker()
+			}
+			select {
+			case <-cmd.resize:
+			case <-drained:
+				done = true
 			}
-			cmd.forward.Incr()
-			redis.MustEncode(writer, resp)
-			flushWriter(writer)
 		}
+		wg.Wait()
 	}()
+	return wait
+}
+
+func (cmd *cmdSync) SyncCommand(reader *bufio.Reader, target, passwd string, offset int64, db uint32) {
+	f := newForwarder(target, passwd, args.shards, offset, db, &cmd.wbytes, &cmd.forward, &cmd.nbypass)
+	go f.Run(reader)
+	cmd.ForwardLoop(f)
+}
 
+// ForwardLoop reports forwarding stats and saves the checkpoint every second.
+func (cmd *cmdSync) ForwardLoop(f *forwarder) {
+	cmd.WatchForwarders(f)
 	for lstat := cmd.Stat(); ; {
 		time.Sleep(time.Second)
+		cmd.SaveApplied(f)
 		nstat := cmd.Stat()
 		var b bytes.Buffer
 		fmt.Fprintf(&b, "sync: ")
@@ -292,3 +462,29 @@ func (cmd *cmdSync) SyncCommand(reader *bufio.Reader, target, passwd string) {
 		lstat = nstat
 	}
 }
+
+// WatchForwarders makes the forwarders visible to the admin port.
+func (cmd *cmdSync) WatchForwarders(fs ...*forwarder) {
+	cmd.mu.Lock()
+	defer cmd.mu.Unlock()
+	cmd.forwarders = fs
+}
+
+// SaveApplied publishes the offset applied on every target for REPLCONF ACK,
+// and saves it to the checkpoint file when it has moved.
+func (cmd *cmdSync) SaveApplied(fs ...*forwarder) {
+	offset, db := fs[0].Applied()
+	for _, f := range fs[1:] {
+		if o, d := f.Applied(); o < offset {
+			offset, db = o, d
+		}
+	}
+	cmd.applied.Set(offset)
+	if cp := (checkpoint{cmd.ReplID(), offset, db}); len(args.checkpoint) != 0 && cp != cmd.saved {
+		if err := cp.Save(args.checkpoint); err != nil {
+			log.WarnErrorf(err, "save checkpoint '%s' failed", args.checkpoint)
+		} else {
+			cmd.saved = cp
+		}
+	}
+}
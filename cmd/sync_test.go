@@ -0,0 +1,337 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"os"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/bytesize"
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+func TestSyncRDBFile(t *testing.T) {
+	defer withParallel(4)()
+	p := testRdb(2000)
+	sink := startFakeTarget(0, 0, true)
+	defer sink.Close()
+	cmd := new(cmdSync)
+	cmd.SyncRDBFile(bufio.NewReader(bytes.NewReader(p)), sink.Addr(), "", int64(len(p)), true)
+	assert.Must(cmd.nentry.Get() == 2000)
+	assert.Must(sink.NumKeys() == 2000 && sink.failed.Get() == 0)
+}
+
+func BenchmarkSyncRDBFile(b *testing.B) {
+	defer withParallel(8)()
+	p := testRdb(20000)
+	sink := startFakeTarget(0, 0, false)
+	defer sink.Close()
+	b.SetBytes(int64(len(p)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		new(cmdSync).SyncRDBFile(bufio.NewReader(bytes.NewReader(p)), sink.Addr(), "", int64(len(p)), false)
+	}
+}
+
+// testBacklog returns n SET commands on 1000 keys of db 0 and 1, as a
+// master would propagate them.
+func testBacklog(n int) []byte {
+	var b bytes.Buffer
+	for i := 0; i < n; i++ {
+		if i%100 == 0 {
+			b.Write(redis.MustEncodeToBytes(redis.NewCommand("SELECT", i/100%2)))
+		}
+		key, value := fmt.Sprintf("key:%d", i%1000), fmt.Sprintf("value:%032d", i)
+		b.Write(redis.MustEncodeToBytes(redis.NewCommand("SET", key, value)))
+	}
+	return b.Bytes()
+}
+
+// forward replays p like forwarder.Run, and waits for every reply.
+func forward(f *forwarder, p []byte) {
+	d := redis.NewCommandFramer(bufio.NewReaderSize(bytes.NewReader(p), 1024*64), 2)
+	for {
+		c, err := d.TryDecode()
+		assert.MustNoError(err)
+		if c == nil {
+			for _, fc := range f.conns {
+				fc.flush()
+			}
+			if c, err = d.Decode(); errors.Equal(err, io.EOF) {
+				break
+			}
+			assert.MustNoError(err)
+		}
+		f.process(c)
+		f.commit()
+	}
+	f.barrier()
+}
+
+func TestForwarder(t *testing.T) {
+	p := testBacklog(10000)
+	for _, shards := range []int{1, 4} {
+		sink := startFakeTarget(0, 0, false)
+		var wbytes, nforward, nbypass atomic2.Int64
+		f := newForwarder(sink.Addr(), "", shards, 0, 0, &wbytes, &nforward, &nbypass)
+		forward(f, p)
+		sink.Close()
+		offset, db := f.Applied()
+		assert.Must(offset == int64(len(p)) && db == 1)
+		assert.Must(nforward.Get() == 10100)
+		// every shard selects db 0 or 1 again as needed
+		assert.Must(sink.requests.Get() >= 10000+int64(shards) && sink.failed.Get() == 0)
+	}
+}
+
+// TestForwarderLargeCommands sends commands that don't fit the writer buffer
+// to a target that replies right away, the replies may be read before the
+// writes return.
+func TestForwarderLargeCommands(t *testing.T) {
+	value := bytes.Repeat([]byte("v"), WriterBufferSize)
+	var b bytes.Buffer
+	for i := 0; i < 4; i++ {
+		b.Write(redis.MustEncodeToBytes(redis.NewCommand("SET", fmt.Sprintf("key:%d", i), value)))
+		fmt.Fprintf(&b, "SET inline:%d %s\r\n", i, value)
+	}
+	p := b.Bytes()
+	sink := startFakeTarget(0, 0, false)
+	defer sink.Close()
+	var wbytes, nforward, nbypass atomic2.Int64
+	f := newForwarder(sink.Addr(), "", 1, 0, 0, &wbytes, &nforward, &nbypass)
+	forward(f, p)
+	offset, _ := f.Applied()
+	assert.Must(offset == int64(len(p)))
+	assert.Must(sink.requests.Get() == 8 && sink.failed.Get() == 0)
+}
+
+func benchmarkForwarder(b *testing.B, shards int) {
+	p := testBacklog(100000)
+	sink := startFakeTarget(0, 0, false)
+	defer sink.Close()
+	var wbytes, nforward, nbypass atomic2.Int64
+	b.SetBytes(int64(len(p)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		forward(newForwarder(sink.Addr(), "", shards, 0, 0, &wbytes, &nforward, &nbypass), p)
+	}
+}
+
+func BenchmarkForwarder(b *testing.B)        { benchmarkForwarder(b, 1) }
+func BenchmarkForwarderShards4(b *testing.B) { benchmarkForwarder(b, 4) }
+
+func readFull(r io.Reader, n int) []byte {
+	p := make([]byte, n)
+	_, err := io.ReadFull(r, p)
+	assert.MustNoError(err)
+	return p
+}
+
+func TestSendPSyncCmd(t *testing.T) {
+	rdb, stream := testRdb(500), testBacklog(20000)
+	for _, diskless := range []bool{false, true} {
+		m := newFakeMaster(rdb, 1000)
+		m.Diskless, m.DropEvery = diskless, int64(len(stream)/2+1)
+		m.Start()
+
+		cmd := new(cmdSync)
+		backlog, state := cmd.SendPSyncCmd(m.Addr(), "", nil)
+		assert.Must(state.resync && state.offset == 1000 && cmd.ReplID() == m.ReplID)
+		assert.Must(diskless && state.nsize == 0 || state.nsize == int64(len(rdb)))
+		cmd.applied.Set(1042)
+
+		m.Feed(stream, 1024*1024*8)
+		assert.Must(bytes.Equal(readFull(backlog, len(rdb)), rdb))
+		// the master drops us halfway, the rest is sent after +CONTINUE
+		assert.Must(bytes.Equal(readFull(backlog, len(stream)), stream))
+		assert.Must(cmd.received.Get() == 1000+int64(len(stream)))
+		assert.Must(m.nfull.Get() == 1 && m.ncontinue.Get() == 1)
+		for i := 0; m.acked.Get() != 1042; i++ {
+			assert.Must(i < 100)
+			time.Sleep(time.Millisecond * 10)
+		}
+
+		if !diskless {
+			cmd := new(cmdSync)
+			cp := &checkpoint{ReplID: m.ReplID, Offset: 1100, DB: 3}
+			backlog, state := cmd.SendPSyncCmd(m.Addr(), "", cp)
+			assert.Must(!state.resync && state.offset == 1100 && state.db == 3)
+			assert.Must(bytes.Equal(readFull(backlog, len(stream)-100), stream[100:]))
+			assert.Must(m.nfull.Get() == 1 && m.ncontinue.Get() == 3)
+		}
+		m.Close()
+	}
+}
+
+func BenchmarkPSyncPipeCopy(b *testing.B) {
+	stream := testBacklog(200000)
+	m := newFakeMaster(nil, 1000)
+	m.CloseWhenDrained = true
+	m.Write(stream)
+	defer m.Start().Close()
+	b.SetBytes(int64(len(stream)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		c := openNetConn(m.Addr(), "")
+		br, bw := bufio.NewReaderSize(c, 1024*64), bufio.NewWriter(c)
+		sendPSyncContinue(br, bw, m.ReplID, 1000)
+		n, err := new(cmdSync).PSyncPipeCopy(c, br, bw, ioutil.Discard)
+		assert.MustNoError(err)
+		assert.Must(n == int64(len(stream)))
+	}
+}
+
+func BenchmarkPSyncReconnect(b *testing.B) {
+	m := newFakeMaster(nil, 1000)
+	m.CloseWhenDrained = true
+	defer m.Start().Close()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		c := openNetConn(m.Addr(), "")
+		br, bw := bufio.NewReader(c), bufio.NewWriter(c)
+		sendPSyncContinue(br, bw, m.ReplID, 1000)
+		c.Close()
+	}
+}
+
+func benchmarkPSyncFullResync(b *testing.B, diskless bool) {
+	m := newFakeMaster(testRdb(5000), 1000)
+	m.Diskless, m.CloseWhenDrained = diskless, true
+	defer m.Start().Close()
+	b.SetBytes(int64(len(m.RDB)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		c := openNetConn(m.Addr(), "")
+		br, bw := bufio.NewReaderSize(c, 1024*64), bufio.NewWriter(c)
+		sendReplconfCapa(br, bw)
+		_, _, resync := sendPSync(br, bw, "?", -1)
+		assert.Must(resync)
+		h := waitRdbHeader(waitRdbDump(br))
+		n, err := io.Copy(ioutil.Discard, h.Reader(br))
+		assert.MustNoError(err)
+		assert.Must(n == int64(len(m.RDB)))
+		c.Close()
+	}
+}
+
+func BenchmarkPSyncFullResync(b *testing.B)         { benchmarkPSyncFullResync(b, false) }
+func BenchmarkPSyncFullResyncDiskless(b *testing.B) { benchmarkPSyncFullResync(b, true) }
+
+func TestSyncOverlap(t *testing.T) {
+	defer withParallel(4)()
+	p := testRdb(2000)
+	backlog := testBacklog(10000)
+	sink := startFakeTarget(0, 0, true)
+	defer sink.Close()
+	r, w := io.Pipe()
+	go w.Write(backlog)
+	cmd := new(cmdSync)
+	var wbytes, nforward, nbypass atomic2.Int64
+	f := newForwarder(sink.Addr(), "", 1, 0, 0, &wbytes, &nforward, &nbypass)
+	cmd.SyncOverlap(bufio.NewReader(bytes.NewReader(p)), bufio.NewReader(r), sink.Addr(), "", int64(len(p)), false, f)
+	// every entry has been answered once it returns
+	assert.Must(sink.restores.Get() == 2000 && cmd.nentry.Get() == 2000)
+	for i := 0; i < 100; i++ {
+		if offset, _ := f.Applied(); offset == int64(len(backlog)) {
+			break
+		}
+		time.Sleep(time.Millisecond * 50)
+	}
+	offset, _ := f.Applied()
+	assert.Must(offset == int64(len(backlog)) && sink.failed.Get() == 0)
+}
+
+// TestSyncOverlapPSync syncs from a master with --overlap and --spilldir.
+// The backlog is read off the master while the rdb loads, so commands on
+// keys of the rdb, and on keys of db 0 that it doesn't hold, are replayed
+// before its last entry has been restored.
+func TestSyncOverlapPSync(t *testing.T) {
+	defer withParallel(4)()
+	dir, err := ioutil.TempDir("", "overlap")
+	assert.MustNoError(err)
+	defer os.RemoveAll(dir)
+	overlap, spilldir, spillsize := args.overlap, args.spilldir, args.spillsize
+	args.overlap, args.spilldir, args.spillsize = true, dir, bytesize.GB
+	defer func() {
+		args.overlap, args.spilldir, args.spillsize = overlap, spilldir, spillsize
+	}()
+
+	p := testRdb(2000)
+	l := rdb.NewLoader(bytes.NewReader(p))
+	assert.MustNoError(l.Header())
+	var backlog bytes.Buffer
+	for i := 0; i < 100; i++ {
+		e, err := l.NextBinEntry()
+		assert.Must(err == nil && e.DB == 0)
+		backlog.Write(redis.MustEncodeToBytes(redis.NewCommand("SET", e.Key, "v")))
+		backlog.Write(redis.MustEncodeToBytes(redis.NewCommand("INCR", fmt.Sprintf("missing:%d", i))))
+	}
+
+	sink := newFakeTarget()
+	sink.Latency = time.Millisecond
+	var mu sync.Mutex
+	var firstSet, firstIncr int64 = -1, -1
+	sink.Trace = func(name []byte, args [][]byte) {
+		mu.Lock()
+		defer mu.Unlock()
+		switch {
+		case bytes.EqualFold(name, []byte("set")) && firstSet < 0:
+			firstSet = sink.restores.Get()
+		case bytes.EqualFold(name, []byte("incr")) && firstIncr < 0:
+			firstIncr = sink.restores.Get()
+		}
+	}
+	defer sink.Start().Close()
+	m := newFakeMaster(p, 1000)
+	defer m.Start().Close()
+
+	cmd := &cmdSync{resize: make(chan struct{}, 1)}
+	reader, state := cmd.SendPSyncCmd(m.Addr(), "", nil)
+	assert.Must(state.resync && state.rdb != nil)
+	m.Write(backlog.Bytes())
+
+	var wbytes, nforward, nbypass atomic2.Int64
+	f := newForwarder(sink.Addr(), "", 1, state.offset, state.db, &wbytes, &nforward, &nbypass)
+	cmd.SyncOverlap(bufio.NewReader(state.rdb), bufio.NewReader(reader), sink.Addr(), "", state.nsize, false, f)
+	assert.Must(sink.restores.Get() == 2000 && sink.failed.Get() == 0)
+	mu.Lock()
+	defer mu.Unlock()
+	assert.Must(firstSet >= 0 && firstSet < 2000)
+	assert.Must(firstIncr >= 0 && firstIncr < 2000)
+}
+
+// TestSendPSyncSpillSegments checks that a psync session, e.g. of one of
+// several masters, leaves the segments under --spilldir alone.
+func TestSendPSyncSpillSegments(t *testing.T) {
+	dir, err := ioutil.TempDir("", "spill")
+	assert.MustNoError(err)
+	defer os.RemoveAll(dir)
+	spilldir, spillsize := args.spilldir, args.spillsize
+	args.spilldir, args.spillsize = dir, bytesize.MB*64
+	defer func() {
+		args.spilldir, args.spillsize = spilldir, spillsize
+	}()
+	f, err := ioutil.TempFile(dir, "redis-port.spill.")
+	assert.MustNoError(err)
+	f.Close()
+
+	m := newFakeMaster(testRdb(10), 1000)
+	defer m.Start().Close()
+	cmd := &cmdSync{resize: make(chan struct{}, 1)}
+	// the session keeps reading into its pipe, closing it would be fatal
+	cmd.SendPSyncCmd(m.Addr(), "", nil)
+	_, err = os.Stat(f.Name())
+	assert.MustNoError(err)
+}
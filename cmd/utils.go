@@ -5,6 +5,7 @@ package main
 
 import (
 	"bufio"
+	"bytes"
 	"io"
 	"net"
 	"os"
@@ -25,7 +26,54 @@ import (
 )
 
 func openRedisConn(target, passwd string) redigo.Conn {
-	return redigo.NewConn(openNetConn(target, passwd), 0, 0)
+	c := openNetConn(target, passwd)
+	return &targetConn{
+		Conn: redigo.NewConn(c, 0, 0),
+		w:    redis.NewWriterSize(c, int(bytesize.KB*4), nil),
+	}
+}
+
+// targetConn is a redigo.Conn that can also send a request by itself, so that
+// large values go to the socket with writev instead of being copied into the
+// buffer of redigo. Those bypass the writer of redigo, so DoArgs must only be
+// called while no reply of Send is pending, or it would be taken for its own.
+type targetConn struct {
+	redigo.Conn
+	w *redis.Writer
+
+	pending int
+}
+
+func (c *targetConn) Do(cmd string, args ...interface{}) (interface{}, error) {
+	// Do receives the replies of every pending Send, even if it fails
+	c.pending = 0
+	return c.Conn.Do(cmd, args...)
+}
+
+func (c *targetConn) Send(cmd string, args ...interface{}) error {
+	c.pending++
+	return c.Conn.Send(cmd, args...)
+}
+
+func (c *targetConn) Receive() (interface{}, error) {
+	if c.pending != 0 {
+		c.pending--
+	}
+	return c.Conn.Receive()
+}
+
+// DoArgs sends args on an idle connection and waits for the reply.
+func (c *targetConn) DoArgs(args ...[]byte) (interface{}, error) {
+	if c.pending != 0 {
+		return nil, errors.Errorf("%d replies pending", c.pending)
+	}
+	if err := c.Conn.Flush(); err != nil {
+		return nil, err
+	}
+	if err := c.w.EncodeArgs(args, true); err != nil {
+		return nil, err
+	}
+	return c.Conn.Receive()
 }
 
 func openNetConn(target, passwd string) net.Conn {
@@ -91,16 +139,51 @@ func authPassword(c net.Conn, passwd string) {
 	}
 }
 
-func openSyncConn(target string, passwd string) (net.Conn, <-chan int64) {
+func openSyncConn(target string, passwd string) (net.Conn, *bufio.Reader, <-chan *rdbHeader) {
 	c := openNetConn(target, passwd)
-	if _, err := c.Write(redis.MustEncodeToBytes(redis.NewCommand("sync"))); err != nil {
+	br := bufio.NewReaderSize(c, ReaderBufferSize)
+	bw := bufio.NewWriterSize(c, WriterBufferSize)
+	sendReplconfCapa(br, bw)
+	if err := redis.Encode(bw, redis.NewCommand("sync"), true); err != nil {
 		log.PanicError(errors.Trace(err), "write sync command failed")
 	}
-	return c, waitRdbDump(c)
+	return c, br, waitRdbDump(br)
 }
 
-func waitRdbDump(r io.Reader) <-chan int64 {
-	size := make(chan int64)
+// sendReplconfCapa tells the master that we accept diskless transfers, an
+// error reply only means the master is too old to send one.
+func sendReplconfCapa(br *bufio.Reader, bw *bufio.Writer) {
+	cmd := redis.NewCommand("replconf", "capa", "eof")
+	if err := redis.Encode(bw, cmd, true); err != nil {
+		log.PanicError(err, "write replconf command failed")
+	}
+	r, err := redis.Decode(br)
+	if err != nil {
+		log.PanicError(err, "invalid replconf response")
+	}
+	if e, ok := r.(*redis.Error); ok {
+		log.Warnf("replconf capa eof is not supported, %s", e.Value)
+	}
+}
+
+const RdbEOFMarkLen = 40
+
+// rdbHeader describes the rdb transfer that follows a sync: either its size,
+// or the mark that terminates a diskless transfer.
+type rdbHeader struct {
+	size int64
+	mark []byte
+}
+
+func (h *rdbHeader) Reader(br *bufio.Reader) io.Reader {
+	if h.mark != nil {
+		return newEofMarkReader(br, h.mark)
+	}
+	return io.LimitReader(br, h.size)
+}
+
+func waitRdbDump(r io.Reader) <-chan *rdbHeader {
+	header := make(chan *rdbHeader)
 	go func() {
 		var rsp string
 		for {
@@ -109,7 +192,7 @@ func waitRdbDump(r io.Reader) <-chan int64 {
 				log.PanicErrorf(err, "read sync response = '%s'", rsp)
 			}
 			if len(rsp) == 0 && b[0] == '\n' {
-				size <- 0
+				header <- nil
 				continue
 			}
 			rsp += string(b)
@@ -120,63 +203,188 @@ func waitRdbDump(r io.Reader) <-chan int64 {
 		if rsp[0] != '$' {
 			log.Panicf("invalid sync response, rsp = '%s'", rsp)
 		}
+		if strings.HasPrefix(rsp, "$EOF:") {
+			mark := rsp[5 : len(rsp)-2]
+			if len(mark) != RdbEOFMarkLen {
+				log.Panicf("invalid sync response = '%s', bad eof mark", rsp)
+			}
+			header <- &rdbHeader{mark: []byte(mark)}
+			return
+		}
 		n, err := strconv.Atoi(rsp[1 : len(rsp)-2])
 		if err != nil || n <= 0 {
 			log.PanicErrorf(err, "invalid sync response = '%s', n = %d", rsp, n)
 		}
-		size <- int64(n)
+		header <- &rdbHeader{size: int64(n)}
 	}()
-	return size
+	return header
 }
 
-func sendPSyncFullsync(br *bufio.Reader, bw *bufio.Writer) (string, int64, <-chan int64) {
-	cmd := redis.NewCommand("psync", "?", -1)
-	if err := redis.Encode(bw, cmd, true); err != nil {
-		log.PanicError(err, "write psync command failed, fullsync")
+func waitRdbHeader(wait <-chan *rdbHeader) *rdbHeader {
+	for {
+		select {
+		case h := <-wait:
+			if h != nil {
+				return h
+			}
+			log.Info("+")
+		case <-time.After(time.Second):
+			log.Info("-")
+		}
 	}
-	r, err := redis.Decode(br)
-	if err != nil {
-		log.PanicError(err, "invalid psync response, fullsync")
+}
+
+// eofMarkReader returns the rdb payload of a diskless transfer and stops right
+// before the eof mark, leaving whatever follows it in br.
+type eofMarkReader struct {
+	br   *bufio.Reader
+	mark []byte
+	skip [1 << 16]uint8
+	safe int
+	done bool
+}
+
+func newEofMarkReader(br *bufio.Reader, mark []byte) *eofMarkReader {
+	r := &eofMarkReader{br: br, mark: mark}
+	last := len(mark) - 1
+	for i := range r.skip {
+		r.skip[i] = uint8(last)
 	}
-	if e, ok := r.(*redis.Error); ok {
-		log.Panicf("invalid psync response, fullsync, %s", e.Value)
+	for i := 0; i < last; i++ {
+		r.skip[int(mark[i])<<8|int(mark[i+1])] = uint8(last - 1 - i)
 	}
-	x, err := redis.AsString(r, nil)
-	if err != nil {
-		log.PanicError(err, "invalid psync response, fullsync")
+	return r
+}
+
+// index returns the index of the first mark in p, or -1. It shifts by the
+// last two bytes of the window like Horspool does by the last one: bytes.Index
+// stops at every byte of p that equals the first hex digit of the mark, while
+// few pairs of bytes are in the mark at all.
+func (r *eofMarkReader) index(p []byte) int {
+	last := len(r.mark) - 1
+	for i := last; i < len(p); {
+		if n := r.skip[int(p[i-1])<<8|int(p[i])]; n != 0 {
+			i += int(n)
+		} else if bytes.Equal(p[i-last:i+1], r.mark) {
+			return i - last
+		} else {
+			i++
+		}
 	}
-	xx := strings.Split(x, " ")
-	if len(xx) != 3 || strings.ToLower(xx[0]) != "fullresync" {
-		log.Panicf("invalid psync response = '%s', should be fullsync", x)
+	return -1
+}
+
+// next returns the buffered bytes that are known to come before the mark, or
+// io.EOF once the mark has been discarded. The first safe buffered bytes have
+// been searched already, so only the last len(mark)-1 of them are searched
+// again together with what has been buffered since.
+func (r *eofMarkReader) next() ([]byte, error) {
+	if r.done {
+		return nil, io.EOF
+	}
+	if _, err := r.br.Peek(len(r.mark)); err != nil {
+		return nil, errors.Trace(err)
+	}
+	p, _ := r.br.Peek(r.br.Buffered())
+	if i := r.index(p[r.safe:]); i < 0 {
+		r.safe = len(p) - len(r.mark) + 1
+	} else if r.safe += i; r.safe == 0 {
+		r.done = true
+		r.br.Discard(len(r.mark))
+		return nil, io.EOF
 	}
-	v, err := strconv.ParseInt(xx[2], 10, 64)
+	return p[:r.safe], nil
+}
+
+func (r *eofMarkReader) discard(n int) {
+	r.br.Discard(n)
+	r.safe -= n
+}
+
+func (r *eofMarkReader) Read(b []byte) (int, error) {
+	if len(b) == 0 && !r.done {
+		return 0, nil
+	}
+	p, err := r.next()
 	if err != nil {
-		log.PanicError(err, "parse psync offset failed")
+		return 0, err
+	}
+	n := copy(b, p)
+	r.discard(n)
+	return n, nil
+}
+
+// WriteTo lets io.Copy write straight out of the buffer of br.
+func (r *eofMarkReader) WriteTo(w io.Writer) (int64, error) {
+	var nn int64
+	for {
+		p, err := r.next()
+		if err != nil {
+			if err == io.EOF {
+				return nn, nil
+			}
+			return nn, err
+		}
+		n, err := w.Write(p)
+		r.discard(n)
+		nn += int64(n)
+		if err != nil {
+			return nn, errors.Trace(err)
+		}
 	}
-	runid, offset := xx[1], v-1
-	return runid, offset, waitRdbDump(br)
 }
 
-func sendPSyncContinue(br *bufio.Reader, bw *bufio.Writer, runid string, offset int64) {
-	cmd := redis.NewCommand("psync", runid, offset+2)
+// sendPSync asks the master for the replication stream after offset of replid,
+// or for a full resync if replid is "?". It returns the replid to follow and
+// whether the master answered with a full resync from the returned offset.
+func sendPSync(br *bufio.Reader, bw *bufio.Writer, replid string, offset int64) (string, int64, bool) {
+	cmd := redis.NewCommand("psync", replid, offset+1)
+	if replid == "?" {
+		cmd = redis.NewCommand("psync", "?", -1)
+	}
 	if err := redis.Encode(bw, cmd, true); err != nil {
-		log.PanicError(err, "write psync command failed, continue")
+		log.PanicError(err, "write psync command failed")
 	}
 	r, err := redis.Decode(br)
 	if err != nil {
-		log.PanicError(err, "invalid psync response, continue")
+		log.PanicError(err, "invalid psync response")
 	}
 	if e, ok := r.(*redis.Error); ok {
-		log.Panicf("invalid psync response, continue, %s", e.Value)
+		log.Panicf("invalid psync response, %s", e.Value)
 	}
 	x, err := redis.AsString(r, nil)
 	if err != nil {
-		log.PanicError(err, "invalid psync response, continue")
+		log.PanicError(err, "invalid psync response")
 	}
 	xx := strings.Split(x, " ")
-	if len(xx) != 1 || strings.ToLower(xx[0]) != "continue" {
-		log.Panicf("invalid psync response = '%s', should be continue", x)
+	switch strings.ToLower(xx[0]) {
+	case "fullresync":
+		if len(xx) != 3 {
+			break
+		}
+		v, err := strconv.ParseInt(xx[2], 10, 64)
+		if err != nil {
+			log.PanicError(err, "parse psync offset failed")
+		}
+		return xx[1], v, true
+	case "continue":
+		switch len(xx) {
+		case 1:
+			return replid, offset, false
+		case 2:
+			return xx[1], offset, false
+		}
 	}
+	log.Panicf("invalid psync response = '%s'", x)
+	return "", 0, false
+}
+
+func sendPSyncContinue(br *bufio.Reader, bw *bufio.Writer, runid string, offset int64) string {
+	runid, _, fullsync := sendPSync(br, bw, runid, offset)
+	if fullsync {
+		log.Panicf("invalid psync response, should be continue")
+	}
+	return runid
 }
 
 func sendPSyncAck(bw *bufio.Writer, offset int64) error {
@@ -205,7 +413,20 @@ func restoreRdbEntry(c redigo.Conn, e *rdb.BinEntry, codis bool) {
 	const MaxValueSize = bytesize.MB * 128
 
 	if len(e.Value) < MaxValueSize {
-		if codis {
+		if tc, ok := c.(*targetConn); ok && len(e.Value) >= redis.VectorSize {
+			ttl := []byte(strconv.FormatUint(ttlms, 10))
+			if codis {
+				_, err := redigo.String(tc.DoArgs([]byte("SLOTSRESTORE"), e.Key, ttl, e.Value))
+				if err != nil {
+					log.PanicError(err, "SLOTSRESTORE command error")
+				}
+			} else {
+				_, err := redigo.String(tc.DoArgs([]byte("RESTORE"), e.Key, ttl, e.Value, []byte("REPLACE")))
+				if err != nil {
+					log.PanicError(err, "RESTORE command error")
+				}
+			}
+		} else if codis {
 			_, err := redigo.String(c.Do("SLOTSRESTORE", e.Key, ttlms, e.Value))
 			if err != nil {
 				log.PanicError(err, "SLOTSRESTORE command error")
@@ -217,7 +438,10 @@ func restoreRdbEntry(c redigo.Conn, e *rdb.BinEntry, codis bool) {
 			}
 		}
 	} else {
-		o, err := e.ObjEntry()
+		o, err := e.PackedObjEntry()
+		if errors.Equal(err, rdb.ErrPackedTooLarge) {
+			o, err = e.ObjEntry()
+		}
 		if err != nil {
 			log.PanicErrorf(err, "decode object failed")
 		}
@@ -295,6 +519,18 @@ func restoreRdbEntry(c redigo.Conn, e *rdb.BinEntry, codis bool) {
 				}
 				sendCommand(args...)
 			}
+		case *rdb.PackedHash:
+			sendCommand("DEL", o.Key)
+			var hash = o.Value.(*rdb.PackedHash)
+			for i := 0; i < hash.Len(); {
+				var args = []interface{}{
+					"HMSET", o.Key,
+				}
+				for j := 0; j < 30 && i < hash.Len(); j, i = j+1, i+1 {
+					args = append(args, hash.Field(i), hash.Value(i))
+				}
+				sendCommand(args...)
+			}
 		case rdb.ZSet:
 			sendCommand("DEL", o.Key)
 			var zset = o.Value.(rdb.ZSet)
@@ -308,6 +544,18 @@ func restoreRdbEntry(c redigo.Conn, e *rdb.BinEntry, codis bool) {
 				}
 				sendCommand(args...)
 			}
+		case *rdb.PackedZSet:
+			sendCommand("DEL", o.Key)
+			var zset = o.Value.(*rdb.PackedZSet)
+			for i := 0; i < zset.Len(); {
+				var args = []interface{}{
+					"ZADD", o.Key,
+				}
+				for j := 0; j < 30 && i < zset.Len(); j, i = j+1, i+1 {
+					args = append(args, zset.Score(i), zset.Member(i))
+				}
+				sendCommand(args...)
+			}
 		case rdb.Set:
 			sendCommand("DEL", o.Key)
 			var dict = o.Value.(rdb.Set)
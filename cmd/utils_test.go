@@ -0,0 +1,119 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"io"
+	"io/ioutil"
+	"testing"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/redis-port/pkg/rdb"
+
+	redigo "github.com/garyburd/redigo/redis"
+)
+
+// withParallel sets args.parallel to n and returns a func that restores it.
+func withParallel(n int) func() {
+	old := args.parallel
+	args.parallel = n
+	return func() {
+		args.parallel = old
+	}
+}
+
+func benchmarkRestoreRdbEntry(b *testing.B, size int) {
+	t := startFakeTarget(0, 0, false)
+	defer t.Close()
+	value, err := rdb.EncodeDump(rdb.String(bytes.Repeat([]byte("v"), size)))
+	assert.MustNoError(err)
+	e := &rdb.BinEntry{Key: []byte("key:00000001"), Value: value}
+	c := openRedisConn(t.Addr(), "")
+	defer c.Close()
+	b.SetBytes(int64(len(e.Value)))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		restoreRdbEntry(c, e, false)
+	}
+}
+
+func BenchmarkRestoreRdbEntry64(b *testing.B) { benchmarkRestoreRdbEntry(b, 64) }
+func BenchmarkRestoreRdbEntry4K(b *testing.B) { benchmarkRestoreRdbEntry(b, 1024*4) }
+func BenchmarkRestoreRdbEntry1M(b *testing.B) { benchmarkRestoreRdbEntry(b, 1024*1024) }
+
+func TestEofMarkReader(t *testing.T) {
+	mark := []byte("0123456789abcdefghijklmnopqrstuvwxyzABCD")
+	var payload []byte
+	for i := 0; i < 1024; i++ {
+		payload = append(payload, mark[:i%len(mark)]...)
+	}
+	for _, n := range []int{1, 7, 64, 4096} {
+		br := bufio.NewReaderSize(bytes.NewReader(append(append(payload, mark...), "+OK"...)), 64)
+		var b bytes.Buffer
+		p := make([]byte, n)
+		r := newEofMarkReader(br, mark)
+		for {
+			k, err := r.Read(p)
+			b.Write(p[:k])
+			if err != nil {
+				break
+			}
+		}
+		assert.Must(bytes.Equal(b.Bytes(), payload))
+		rest, err := ioutil.ReadAll(br)
+		assert.Must(err == nil && string(rest) == "+OK")
+	}
+}
+
+func TestEofMarkReaderWriteTo(t *testing.T) {
+	mark := []byte("0123456789abcdefghijklmnopqrstuvwxyzABCD")
+	payload := testRdb(100)
+	br := bufio.NewReaderSize(bytes.NewReader(append(append(payload, mark...), "+OK"...)), 64)
+	var b bytes.Buffer
+	n, err := io.Copy(&b, newEofMarkReader(br, mark))
+	assert.Must(err == nil && n == int64(len(payload)) && bytes.Equal(b.Bytes(), payload))
+	rest, err := ioutil.ReadAll(br)
+	assert.Must(err == nil && string(rest) == "+OK")
+
+	br = bufio.NewReaderSize(bytes.NewReader(payload), 64)
+	_, err = io.Copy(&b, newEofMarkReader(br, mark))
+	assert.Must(err != nil)
+}
+
+func TestTargetConnDoArgs(t *testing.T) {
+	f := startFakeTarget(0, 0, false)
+	defer f.Close()
+	c := openRedisConn(f.Addr(), "").(*targetConn)
+	defer c.Close()
+	assert.MustNoError(c.Send("PING"))
+	_, err := c.DoArgs([]byte("PING"))
+	assert.Must(err != nil)
+	assert.MustNoError(c.Flush())
+	r, err := redigo.String(c.Receive())
+	assert.Must(err == nil && r == "PONG")
+
+	assert.MustNoError(c.Send("SELECT", 1))
+	assert.MustNoError(c.Send("SELECT", 2))
+	_, err = c.Do("")
+	assert.MustNoError(err)
+	r, err = redigo.String(c.DoArgs([]byte("PING")))
+	assert.Must(err == nil && r == "PONG")
+	assert.Must(f.requests.Get() == 4)
+
+	c.Close()
+	for i := 0; ; i++ {
+		f.mu.Lock()
+		n := len(f.conns)
+		f.mu.Unlock()
+		if n == 0 {
+			break
+		}
+		assert.Must(i < 100)
+		time.Sleep(time.Millisecond * 10)
+	}
+}
@@ -0,0 +1,181 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package pipe
+
+import (
+	"bytes"
+	"compress/flate"
+	"io"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+)
+
+const (
+	FlateBlockSize = 1024 * 64
+)
+
+type FlateStats struct {
+	RawBytes  int64
+	FlateSize int64
+
+	Compress   time.Duration
+	Decompress time.Duration
+}
+
+func (s *FlateStats) Ratio() float64 {
+	if s.FlateSize == 0 {
+		return 0
+	}
+	return float64(s.RawBytes) / float64(s.FlateSize)
+}
+
+// flateBuffer holds at most size bytes of deflated blocks. Writes fill a raw
+// staging block which is compressed once full; the reader inflates one block
+// at a time and takes the staging block directly when it has caught up.
+type flateBuffer struct {
+	size  int64
+	csize int64
+	craw  int64
+
+	blocks [][]byte
+
+	wblk       []byte
+	rbeg, rend int
+
+	rblk []byte
+	rpos int
+
+	zw *flate.Writer
+	zr io.ReadCloser
+	zb bytes.Buffer
+
+	stats  FlateStats
+	closed bool
+}
+
+func newFlateBuffer(buffSize int) *flateBuffer {
+	n := align(buffSize, BuffSizeAlign)
+	if n <= 0 {
+		panic("invalid pipe buffer size")
+	}
+	zw, err := flate.NewWriter(nil, flate.BestSpeed)
+	if err != nil {
+		panic(err)
+	}
+	p := &flateBuffer{size: int64(n), zw: zw}
+	p.wblk = make([]byte, FlateBlockSize)
+	p.rblk = make([]byte, 0, FlateBlockSize)
+	p.zr = flate.NewReader(nil)
+	return p
+}
+
+func (p *flateBuffer) readSome(b []byte) (int, error) {
+	if p.closed {
+		return 0, errors.Trace(io.ErrClosedPipe)
+	}
+	if p.rpos == len(p.rblk) && len(p.blocks) != 0 {
+		if err := p.inflate(); err != nil {
+			return 0, err
+		}
+	}
+	if p.rpos != len(p.rblk) {
+		n := copy(b, p.rblk[p.rpos:])
+		p.rpos += n
+		return n, nil
+	}
+	n := copy(b, p.wblk[p.rbeg:p.rend])
+	p.rbeg += n
+	if p.rbeg == p.rend {
+		p.rbeg, p.rend = 0, 0
+	}
+	return n, nil
+}
+
+func (p *flateBuffer) inflate() error {
+	start := time.Now()
+	blk := p.blocks[0]
+	p.blocks[0], p.blocks = nil, p.blocks[1:]
+	p.csize -= int64(len(blk))
+
+	if err := p.zr.(flate.Resetter).Reset(bytes.NewReader(blk), nil); err != nil {
+		return errors.Trace(err)
+	}
+	n, err := io.ReadFull(p.zr, p.rblk[:cap(p.rblk)])
+	if err != nil && err != io.ErrUnexpectedEOF {
+		return errors.Trace(err)
+	}
+	p.rblk, p.rpos = p.rblk[:n], 0
+	p.craw -= int64(n)
+	p.stats.Decompress += time.Since(start)
+	return nil
+}
+
+func (p *flateBuffer) writeSome(b []byte) (int, error) {
+	if p.closed {
+		return 0, errors.Trace(io.ErrClosedPipe)
+	}
+	if p.rend == len(p.wblk) {
+		if p.csize >= p.size {
+			return 0, nil
+		}
+		if err := p.deflate(); err != nil {
+			return 0, err
+		}
+	}
+	n := copy(p.wblk[p.rend:], b)
+	p.rend += n
+	return n, nil
+}
+
+func (p *flateBuffer) deflate() error {
+	start := time.Now()
+	raw := p.wblk[p.rbeg:p.rend]
+	p.zb.Reset()
+	p.zw.Reset(&p.zb)
+	if _, err := p.zw.Write(raw); err != nil {
+		return errors.Trace(err)
+	}
+	if err := p.zw.Close(); err != nil {
+		return errors.Trace(err)
+	}
+	blk := append([]byte(nil), p.zb.Bytes()...)
+	p.blocks = append(p.blocks, blk)
+	p.csize += int64(len(blk))
+	p.craw += int64(len(raw))
+	p.rbeg, p.rend = 0, 0
+
+	p.stats.RawBytes += int64(len(raw))
+	p.stats.FlateSize += int64(len(blk))
+	p.stats.Compress += time.Since(start)
+	return nil
+}
+
+func (p *flateBuffer) buffered() int {
+	if p.closed {
+		return 0
+	}
+	return len(p.rblk) - p.rpos + p.rend - p.rbeg + int(p.craw)
+}
+
+func (p *flateBuffer) available() int {
+	if p.closed {
+		return 0
+	}
+	n := len(p.wblk) - p.rend
+	if p.csize < p.size {
+		n += int(p.size - p.csize)
+	}
+	return n
+}
+
+func (p *flateBuffer) rclose() error {
+	p.closed = true
+	p.blocks, p.wblk, p.rblk = nil, nil, nil
+	return nil
+}
+
+func (p *flateBuffer) wclose() error {
+	return nil
+}
@@ -0,0 +1,98 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package pipe
+
+import (
+	"io"
+	"os"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+)
+
+var ErrMmapUnsupported = errors.New("mmap file buffer is not supported")
+
+// mmapBuffer is a file buffer whose ring lives in a shared mapping of the
+// whole preallocated file, so reads and writes are plain memory copies.
+type mmapBuffer struct {
+	f    *os.File
+	b    []byte
+	size uint64
+	rpos uint64
+	wpos uint64
+}
+
+func newMmapBuffer(fileSize int, f *os.File) (*mmapBuffer, error) {
+	n := align(fileSize, FileSizeAlign)
+	if n <= 0 {
+		panic("invalid pipe buffer size")
+	}
+	b, err := mmapFile(f, n)
+	if err != nil {
+		return nil, err
+	}
+	return &mmapBuffer{f: f, b: b, size: uint64(n)}, nil
+}
+
+func (p *mmapBuffer) readSome(b []byte) (int, error) {
+	if p.b == nil {
+		return 0, errors.Trace(io.ErrClosedPipe)
+	}
+	maxlen, offset := roffset(len(b), p.size, p.rpos, p.wpos)
+	if maxlen == 0 {
+		return 0, nil
+	}
+	n := copy(b, p.b[offset:offset+maxlen])
+	p.rpos += uint64(n)
+	return n, nil
+}
+
+func (p *mmapBuffer) writeSome(b []byte) (int, error) {
+	if p.b == nil {
+		return 0, errors.Trace(io.ErrClosedPipe)
+	}
+	maxlen, offset := woffset(len(b), p.size, p.rpos, p.wpos)
+	if maxlen == 0 {
+		return 0, nil
+	}
+	n := copy(p.b[offset:offset+maxlen], b)
+	p.wpos += uint64(n)
+	return n, nil
+}
+
+func (p *mmapBuffer) buffered() int {
+	if p.b == nil {
+		return 0
+	}
+	return int(p.wpos - p.rpos)
+}
+
+func (p *mmapBuffer) available() int {
+	if p.b == nil {
+		return 0
+	}
+	return int(p.size + p.rpos - p.wpos)
+}
+
+func (p *mmapBuffer) sync() error {
+	if p.b == nil {
+		return errors.Trace(io.ErrClosedPipe)
+	}
+	return msyncFile(p.b)
+}
+
+func (p *mmapBuffer) rclose() error {
+	if b := p.b; b != nil {
+		p.b = nil
+		if err := munmapFile(b); err != nil {
+			return err
+		}
+		defer p.f.Close()
+		return errors.Trace(p.f.Truncate(0))
+	}
+	return nil
+}
+
+func (p *mmapBuffer) wclose() error {
+	return nil
+}
@@ -0,0 +1,46 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package pipe
+
+import (
+	"os"
+	"syscall"
+	"unsafe"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+)
+
+func mmapFile(f *os.File, size int) ([]byte, error) {
+	fd := int(f.Fd())
+	if err := syscall.Fallocate(fd, 0, 0, int64(size)); err != nil {
+		if err != syscall.EOPNOTSUPP {
+			return nil, errors.Trace(err)
+		}
+		if err := f.Truncate(int64(size)); err != nil {
+			return nil, errors.Trace(err)
+		}
+	}
+	b, err := syscall.Mmap(fd, 0, size, syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_SHARED)
+	if err != nil {
+		return nil, errors.Trace(err)
+	}
+	if err := syscall.Madvise(b, syscall.MADV_SEQUENTIAL); err != nil {
+		syscall.Munmap(b)
+		return nil, errors.Trace(err)
+	}
+	return b, nil
+}
+
+func munmapFile(b []byte) error {
+	return errors.Trace(syscall.Munmap(b))
+}
+
+func msyncFile(b []byte) error {
+	_, _, errno := syscall.Syscall(syscall.SYS_MSYNC,
+		uintptr(unsafe.Pointer(&b[0])), uintptr(len(b)), syscall.MS_SYNC)
+	if errno != 0 {
+		return errors.Trace(errno)
+	}
+	return nil
+}
@@ -0,0 +1,25 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+//go:build !linux
+// +build !linux
+
+package pipe
+
+import (
+	"os"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+)
+
+func mmapFile(f *os.File, size int) ([]byte, error) {
+	return nil, errors.Trace(ErrMmapUnsupported)
+}
+
+func munmapFile(b []byte) error {
+	return errors.Trace(ErrMmapUnsupported)
+}
+
+func msyncFile(b []byte) error {
+	return errors.Trace(ErrMmapUnsupported)
+}
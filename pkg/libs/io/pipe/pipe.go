@@ -36,6 +36,10 @@ type pipe struct {
 	store buffer
 }
 
+// onWakeup, if set, is called every time a reader or a writer wakes up after
+// waiting for the other side. It is only set by the benchmarks.
+var onWakeup func()
+
 func roffset(blen int, size, rpos, wpos uint64) (maxlen, offset uint64) {
 	maxlen = uint64(blen)
 	if n := wpos - rpos; n < maxlen {
@@ -112,6 +116,9 @@ func (p *pipe) readSome(b []byte) (int, error) {
 		return 0, p.werr
 	}
 	p.rwait.Wait()
+	if onWakeup != nil {
+		onWakeup()
+	}
 	return 0, nil
 }
 
@@ -149,6 +156,9 @@ func (p *pipe) writeSome(b []byte) (int, error) {
 		return n, err
 	}
 	p.wwait.Wait()
+	if onWakeup != nil {
+		onWakeup()
+	}
 	return 0, nil
 }
 
@@ -204,6 +214,23 @@ func (p *pipe) Available() (int, error) {
 	return p.store.available(), nil
 }
 
+type syncer interface {
+	sync() error
+}
+
+// Sync flushes a file backed pipe's buffered data to disk; other pipes are
+// left untouched.
+func Sync(w Writer) error {
+	if p, ok := w.(*writer).p.(*pipe); ok {
+		p.mu.Lock()
+		defer p.mu.Unlock()
+		if s, ok := p.store.(syncer); ok {
+			return s.sync()
+		}
+	}
+	return nil
+}
+
 func New() (Reader, Writer) {
 	return NewSize(BuffSizeAlign)
 }
@@ -212,6 +239,46 @@ func NewSize(buffSize int) (Reader, Writer) {
 	return newPipe(newMemBuffer(buffSize))
 }
 
+func NewRing() (Reader, Writer) {
+	return NewRingSize(BuffSizeAlign)
+}
+
+func NewRingSize(buffSize int) (Reader, Writer) {
+	p := newRingPipe(buffSize)
+	return &reader{p}, &writer{p}
+}
+
 func NewFilePipe(fileSize int, f *os.File) (Reader, Writer) {
 	return newPipe(newFileBuffer(fileSize, f))
 }
+
+func NewFlatePipe(buffSize int) (Reader, Writer) {
+	return newPipe(newFlateBuffer(buffSize))
+}
+
+// GetFlateStats returns compression counters of a pipe created by
+// NewFlatePipe.
+func GetFlateStats(r Reader) (FlateStats, bool) {
+	if p, ok := r.(*reader).p.(*pipe); ok {
+		p.mu.Lock()
+		defer p.mu.Unlock()
+		if f, ok := p.store.(*flateBuffer); ok {
+			return f.stats, true
+		}
+	}
+	return FlateStats{}, false
+}
+
+func NewSpillPipe(buffSize int, dir string, diskSize int64) (Reader, Writer) {
+	p := newSpillPipe(buffSize, dir, diskSize)
+	return &reader{p}, &writer{p}
+}
+
+func NewMmapFilePipe(fileSize int, f *os.File) (Reader, Writer, error) {
+	b, err := newMmapBuffer(fileSize, f)
+	if err != nil {
+		return nil, nil, err
+	}
+	r, w := newPipe(b)
+	return r, w, nil
+}
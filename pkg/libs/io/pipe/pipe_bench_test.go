@@ -0,0 +1,116 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package pipe
+
+import (
+	"io/ioutil"
+	"os"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+)
+
+const benchBuffSize = 1024 * 1024 * 4
+
+func benchmarkPipe(b *testing.B, r Reader, w Writer, chunk int) {
+	var wakeups atomic2.Int64
+	onWakeup = func() { wakeups.Incr() }
+	defer func() { onWakeup = nil }()
+
+	done := make(chan struct{})
+	go func() {
+		defer close(done)
+		buf := make([]byte, chunk)
+		for {
+			if _, err := r.Read(buf); err != nil {
+				return
+			}
+		}
+	}()
+
+	buf := make([]byte, chunk)
+	b.SetBytes(int64(chunk))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		_, err := w.Write(buf)
+		assert.MustNoError(err)
+	}
+	assert.MustNoError(w.Close())
+	<-done
+	b.StopTimer()
+
+	if mb := float64(b.N) * float64(chunk) / (1024 * 1024); mb >= 1 {
+		reportWakeups(b, float64(wakeups.Get())/mb)
+	}
+	assert.MustNoError(r.Close())
+}
+
+func BenchmarkPipe512(b *testing.B) {
+	r, w := NewSize(benchBuffSize)
+	benchmarkPipe(b, r, w, 512)
+}
+
+func BenchmarkRing512(b *testing.B) {
+	r, w := NewRingSize(benchBuffSize)
+	benchmarkPipe(b, r, w, 512)
+}
+
+func BenchmarkPipe16K(b *testing.B) {
+	r, w := NewSize(benchBuffSize)
+	benchmarkPipe(b, r, w, 1024*16)
+}
+
+func BenchmarkRing16K(b *testing.B) {
+	r, w := NewRingSize(benchBuffSize)
+	benchmarkPipe(b, r, w, 1024*16)
+}
+
+func BenchmarkPipe1M(b *testing.B) {
+	r, w := NewSize(benchBuffSize)
+	benchmarkPipe(b, r, w, 1024*1024)
+}
+
+func BenchmarkRing1M(b *testing.B) {
+	r, w := NewRingSize(benchBuffSize)
+	benchmarkPipe(b, r, w, 1024*1024)
+}
+
+func BenchmarkFlate16K(b *testing.B) {
+	r, w := NewFlatePipe(benchBuffSize)
+	benchmarkPipe(b, r, w, 1024*16)
+}
+
+func benchmarkFilePipe(b *testing.B, mmap bool) {
+	f, err := ioutil.TempFile("", "pipe.bench")
+	assert.MustNoError(err)
+	defer os.Remove(f.Name())
+	defer f.Close()
+	var r Reader
+	var w Writer
+	if mmap {
+		r, w, err = NewMmapFilePipe(benchBuffSize, f)
+		assert.MustNoError(err)
+	} else {
+		r, w = NewFilePipe(benchBuffSize, f)
+	}
+	benchmarkPipe(b, r, w, 1024*16)
+}
+
+func BenchmarkFile16K(b *testing.B) {
+	benchmarkFilePipe(b, false)
+}
+
+func BenchmarkMmapFile16K(b *testing.B) {
+	benchmarkFilePipe(b, true)
+}
+
+func BenchmarkSpill16K(b *testing.B) {
+	dir, err := ioutil.TempDir("", "pipe.spill.bench")
+	assert.MustNoError(err)
+	defer os.RemoveAll(dir)
+	r, w := NewSpillPipe(1024*64, dir, benchBuffSize*16)
+	benchmarkPipe(b, r, w, 1024*16)
+}
@@ -0,0 +1,13 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+//go:build go1.13
+// +build go1.13
+
+package pipe
+
+import "testing"
+
+func reportWakeups(b *testing.B, perMB float64) {
+	b.ReportMetric(perMB, "wakeups/MB")
+}
@@ -9,7 +9,9 @@ import (
 	"crypto/cipher"
 	"fmt"
 	"io"
+	"io/ioutil"
 	"os"
+	"path/filepath"
 	"testing"
 	"time"
 
@@ -17,12 +19,33 @@ import (
 	"github.com/CodisLabs/codis/pkg/utils/errors"
 )
 
+const (
+	ringPipeName = "<ring>"
+	mmapPipeName = "/tmp/pipe.mmap.test"
+
+	spillPipeName = "<spill>"
+	flatePipeName = "<flate>"
+)
+
 func openPipe(t *testing.T, fileName string) (pr Reader, pw Writer, pf *os.File) {
 	buffSize := 8192
 	fileSize := 1024 * 1024 * 32
-	if fileName == "" {
+	switch fileName {
+	case "":
 		pr, pw = NewSize(buffSize)
-	} else {
+	case ringPipeName:
+		pr, pw = NewRingSize(buffSize)
+	case flatePipeName:
+		pr, pw = NewFlatePipe(buffSize)
+	case spillPipeName:
+		pr, pw = NewSpillPipe(buffSize, os.TempDir(), int64(fileSize))
+	case mmapPipeName:
+		f, err := os.OpenFile(fileName, os.O_CREATE|os.O_RDWR|os.O_TRUNC, 0600)
+		assert.MustNoError(err)
+		pr, pw, err = NewMmapFilePipe(fileSize, f)
+		assert.MustNoError(err)
+		pf = f
+	default:
 		f, err := os.OpenFile(fileName, os.O_CREATE|os.O_RDWR|os.O_TRUNC, 0600)
 		assert.MustNoError(err)
 		pr, pw = NewFilePipe(fileSize, f)
@@ -55,6 +78,10 @@ func testPipe1(t *testing.T, fileName string) {
 func TestPipe1(t *testing.T) {
 	testPipe1(t, "")
 	testPipe1(t, "/tmp/pipe.test")
+	testPipe1(t, ringPipeName)
+	testPipe1(t, mmapPipeName)
+	testPipe1(t, spillPipeName)
+	testPipe1(t, flatePipeName)
 }
 
 func testPipe2(t *testing.T, fileName string) {
@@ -93,6 +120,10 @@ func testPipe2(t *testing.T, fileName string) {
 func TestPipe2(t *testing.T) {
 	testPipe2(t, "")
 	testPipe2(t, "/tmp/pipe.test")
+	testPipe2(t, ringPipeName)
+	testPipe2(t, mmapPipeName)
+	testPipe2(t, spillPipeName)
+	testPipe2(t, flatePipeName)
 }
 
 func testPipe3(t *testing.T, fileName string) {
@@ -144,6 +175,10 @@ func testPipe3(t *testing.T, fileName string) {
 func TestPipe3(t *testing.T) {
 	testPipe3(t, "")
 	testPipe3(t, "/tmp/pipe.test")
+	testPipe3(t, ringPipeName)
+	testPipe3(t, mmapPipeName)
+	testPipe3(t, spillPipeName)
+	testPipe3(t, flatePipeName)
 }
 
 func testPipe4(t *testing.T, fileName string) {
@@ -194,6 +229,10 @@ func testPipe4(t *testing.T, fileName string) {
 func TestPipe4(t *testing.T) {
 	testPipe4(t, "")
 	testPipe4(t, "/tmp/pipe.test")
+	testPipe4(t, ringPipeName)
+	testPipe4(t, mmapPipeName)
+	testPipe4(t, spillPipeName)
+	testPipe4(t, flatePipeName)
 }
 
 type pipeTest struct {
@@ -228,8 +267,13 @@ func delayClose(t *testing.T, closer Closer, c chan int, u pipeTest) {
 }
 
 func TestPipeReadClose(t *testing.T) {
+	testPipeReadClose(t, New)
+	testPipeReadClose(t, NewRing)
+}
+
+func testPipeReadClose(t *testing.T, open func() (Reader, Writer)) {
 	for _, u := range pipeTests {
-		r, w := New()
+		r, w := open()
 		c := make(chan int, 1)
 
 		if u.async {
@@ -253,7 +297,12 @@ func TestPipeReadClose(t *testing.T) {
 }
 
 func TestPipeReadClose2(t *testing.T) {
-	r, w := New()
+	testPipeReadClose2(t, New)
+	testPipeReadClose2(t, NewRing)
+}
+
+func testPipeReadClose2(t *testing.T, open func() (Reader, Writer)) {
+	r, w := open()
 	c := make(chan int, 1)
 
 	go delayClose(t, r, c, pipeTest{})
@@ -267,8 +316,13 @@ func TestPipeReadClose2(t *testing.T) {
 }
 
 func TestPipeWriteClose(t *testing.T) {
+	testPipeWriteClose(t, New)
+	testPipeWriteClose(t, NewRing)
+}
+
+func testPipeWriteClose(t *testing.T, open func() (Reader, Writer)) {
 	for _, u := range pipeTests {
-		r, w := New()
+		r, w := open()
 		c := make(chan int, 1)
 
 		if u.async {
@@ -290,7 +344,12 @@ func TestPipeWriteClose(t *testing.T) {
 }
 
 func TestWriteEmpty(t *testing.T) {
-	r, w := New()
+	testWriteEmpty(t, New)
+	testWriteEmpty(t, NewRing)
+}
+
+func testWriteEmpty(t *testing.T, open func() (Reader, Writer)) {
+	r, w := open()
 
 	go func() {
 		n, err := w.Write([]byte{})
@@ -309,7 +368,12 @@ func TestWriteEmpty(t *testing.T) {
 }
 
 func TestWriteNil(t *testing.T) {
-	r, w := New()
+	testWriteNil(t, New)
+	testWriteNil(t, NewRing)
+}
+
+func testWriteNil(t *testing.T, open func() (Reader, Writer)) {
+	r, w := open()
 
 	go func() {
 		n, err := w.Write(nil)
@@ -328,7 +392,12 @@ func TestWriteNil(t *testing.T) {
 }
 
 func TestWriteAfterWriterClose(t *testing.T) {
-	r, w := New()
+	testWriteAfterWriterClose(t, New)
+	testWriteAfterWriterClose(t, NewRing)
+}
+
+func testWriteAfterWriterClose(t *testing.T, open func() (Reader, Writer)) {
+	r, w := open()
 
 	s := "hello"
 
@@ -354,7 +423,12 @@ func TestWriteAfterWriterClose(t *testing.T) {
 }
 
 func TestWriteRead(t *testing.T) {
-	r, w := New()
+	testWriteRead(t, New)
+	testWriteRead(t, NewRing)
+}
+
+func testWriteRead(t *testing.T, open func() (Reader, Writer)) {
+	r, w := open()
 	p := make(chan []byte, 1)
 
 	go func() {
@@ -389,3 +463,120 @@ func TestWriteRead(t *testing.T) {
 	n, err = r.Read(b)
 	assert.Must(err != nil && n == 0)
 }
+
+func TestMmapSync(t *testing.T) {
+	r, w, f := openPipe(t, mmapPipeName)
+	defer f.Close()
+
+	s := "Hello world!!"
+	n, err := w.Write([]byte(s))
+	assert.MustNoError(err)
+	assert.Must(n == len(s))
+	assert.MustNoError(Sync(w))
+
+	buf := make([]byte, len(s))
+	_, err = f.ReadAt(buf, 0)
+	assert.MustNoError(err)
+	assert.Must(string(buf) == s)
+
+	assert.MustNoError(w.Close())
+	assert.MustNoError(r.Close())
+}
+
+func TestSpillPipe(t *testing.T) {
+	dir, err := ioutil.TempDir("", "pipe.spill.test")
+	assert.MustNoError(err)
+	defer os.RemoveAll(dir)
+
+	p := newSpillPipe(BuffSizeAlign, dir, BuffSizeAlign*2)
+	p.segSize = BuffSizeAlign
+
+	files := func() int {
+		l, err := ioutil.ReadDir(dir)
+		assert.MustNoError(err)
+		return len(l)
+	}
+
+	var x []byte
+	for i := 0; i < BuffSizeAlign*3; i++ {
+		x = append(x, byte(i%251))
+	}
+	n, err := p.Write(x)
+	assert.MustNoError(err)
+	assert.Must(n == len(x))
+	assert.Must(files() == 2)
+	buffered, err := p.Buffered()
+	assert.Must(err == nil && buffered == len(x))
+	available, err := p.Available()
+	assert.Must(err == nil && available == 0)
+
+	done := make(chan struct{})
+	go func() {
+		defer close(done)
+		n, err := p.Write([]byte("full"))
+		assert.Must(err == nil && n == 4)
+	}()
+
+	var y []byte
+	for len(y) != len(x)+4 {
+		b := make([]byte, 1000)
+		n, err := p.Read(b)
+		assert.MustNoError(err)
+		y = append(y, b[:n]...)
+	}
+	<-done
+	assert.Must(bytes.Equal(x, y[:len(x)]) && string(y[len(x):]) == "full")
+
+	n, err = p.Write([]byte("hot"))
+	assert.Must(err == nil && n == 3)
+	b := make([]byte, 3)
+	n, err = io.ReadFull(&reader{p}, b)
+	assert.Must(err == nil && string(b) == "hot")
+	assert.MustNoError(p.RClose(nil))
+	assert.Must(files() == 0)
+}
+
+func TestRemoveSpillSegments(t *testing.T) {
+	dir, err := ioutil.TempDir("", "pipe.spill.test")
+	assert.MustNoError(err)
+	defer os.RemoveAll(dir)
+
+	r, w := NewSpillPipe(BuffSizeAlign, dir, BuffSizeAlign*4)
+	_, err = w.Write(make([]byte, BuffSizeAlign*2))
+	assert.MustNoError(err)
+	assert.MustNoError(ioutil.WriteFile(filepath.Join(dir, "keep"), nil, 0600))
+
+	n, err := RemoveSpillSegments(dir)
+	assert.Must(err == nil && n == 1)
+	l, err := ioutil.ReadDir(dir)
+	assert.Must(err == nil && len(l) == 1 && l[0].Name() == "keep")
+	r.Close()
+}
+
+func TestFlateBuffer(t *testing.T) {
+	p := newFlateBuffer(FlateBlockSize * 2)
+
+	var x []byte
+	for i := 0; len(x) < FlateBlockSize*8; i++ {
+		x = append(x, fmt.Sprintf("*3\r\n$3\r\nset\r\n$8\r\nkey:%04d\r\n$5\r\nvalue\r\n", i%1000)...)
+	}
+	for b := x; len(b) != 0; {
+		n, err := p.writeSome(b)
+		assert.MustNoError(err)
+		assert.Must(n != 0)
+		b = b[n:]
+	}
+	assert.Must(p.buffered() == len(x))
+	assert.Must(len(p.blocks) >= 7)
+	assert.Must(p.stats.Ratio() > 4)
+
+	var y []byte
+	for p.buffered() != 0 {
+		b := make([]byte, 1000)
+		n, err := p.readSome(b)
+		assert.MustNoError(err)
+		y = append(y, b[:n]...)
+	}
+	assert.Must(bytes.Equal(x, y))
+	assert.MustNoError(p.rclose())
+}
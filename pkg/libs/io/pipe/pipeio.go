@@ -16,8 +16,19 @@ type Reader interface {
 	Buffered() (int, error)
 }
 
+type pipeImpl interface {
+	Read(b []byte) (int, error)
+	Write(b []byte) (int, error)
+
+	RClose(err error) error
+	WClose(err error) error
+
+	Buffered() (int, error)
+	Available() (int, error)
+}
+
 type reader struct {
-	p *pipe
+	p pipeImpl
 }
 
 func (r *reader) Read(b []byte) (int, error) {
@@ -43,7 +54,7 @@ type Writer interface {
 }
 
 type writer struct {
-	p *pipe
+	p pipeImpl
 }
 
 func (w *writer) Write(b []byte) (int, error) {
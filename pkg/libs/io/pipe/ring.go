@@ -0,0 +1,245 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package pipe
+
+import (
+	"io"
+	"runtime"
+	"sync"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+)
+
+const (
+	RingSpinCount  = 64
+	RingNotifySize = 1024 * 32
+)
+
+// ringPipe is a single-producer/single-consumer memory pipe. The reader owns
+// rpos and the writer owns wpos, so the fast path needs no locks. A side that
+// can't make progress spins for a while, then parks on a channel until the
+// other side has moved RingNotifySize bytes, drained/filled the ring or
+// finished its call.
+type ringPipe struct {
+	b      []byte
+	size   int64
+	notify int64
+
+	rpos atomic2.Int64
+	wpos atomic2.Int64
+
+	rsleep, wsleep atomic2.Bool
+	rwake, wwake   chan struct{}
+
+	mu   sync.Mutex
+	rerr error
+	werr error
+
+	rclosed, wclosed atomic2.Bool
+
+	pending int64
+}
+
+func newRingPipe(buffSize int) *ringPipe {
+	n := align(buffSize, BuffSizeAlign)
+	if n <= 0 {
+		panic("invalid pipe buffer size")
+	}
+	p := &ringPipe{b: make([]byte, n), size: int64(n)}
+	p.notify = RingNotifySize
+	if p.notify > p.size/2 {
+		p.notify = p.size / 2
+	}
+	p.rwake = make(chan struct{}, 1)
+	p.wwake = make(chan struct{}, 1)
+	return p
+}
+
+func (p *ringPipe) wake(sleep *atomic2.Bool, c chan struct{}) {
+	if sleep.Get() && sleep.CompareAndSwap(true, false) {
+		select {
+		case c <- struct{}{}:
+		default:
+		}
+	}
+}
+
+func (p *ringPipe) park(sleep *atomic2.Bool, c chan struct{}, ready func() bool) {
+	sleep.Set(true)
+	if ready() {
+		sleep.Set(false)
+		return
+	}
+	<-c
+	if onWakeup != nil {
+		onWakeup()
+	}
+}
+
+func (p *ringPipe) readable() bool {
+	return p.rpos.Get() != p.wpos.Get() || p.rclosed.Get() || p.wclosed.Get()
+}
+
+func (p *ringPipe) writable() bool {
+	return p.wpos.Get()-p.rpos.Get() < p.size || p.rclosed.Get() || p.wclosed.Get()
+}
+
+func (p *ringPipe) Read(b []byte) (int, error) {
+	return p.read(b, true)
+}
+
+// read returns 0 bytes rather than waiting when the ring is empty and block
+// is false, even if the writer has been closed.
+func (p *ringPipe) read(b []byte, block bool) (int, error) {
+	for spin := 0; ; spin++ {
+		if p.rclosed.Get() {
+			return 0, errors.Trace(io.ErrClosedPipe)
+		}
+		rpos, wpos := p.rpos.Get(), p.wpos.Get()
+		if rpos != wpos {
+			if len(b) == 0 {
+				return 0, nil
+			}
+			maxlen, offset := roffset(len(b), uint64(p.size), uint64(rpos), uint64(wpos))
+			n := copy(b, p.b[offset:offset+maxlen])
+			p.rpos.Set(rpos + int64(n))
+			if free := p.size - (wpos - rpos - int64(n)); free >= p.notify || free == p.size {
+				p.wake(&p.wsleep, p.wwake)
+			}
+			return n, nil
+		}
+		if !block {
+			return 0, nil
+		}
+		if p.wclosed.Get() {
+			if p.wpos.Get() != rpos {
+				continue
+			}
+			return 0, p.werror()
+		}
+		if len(b) == 0 {
+			return 0, nil
+		}
+		p.wake(&p.wsleep, p.wwake)
+		if spin < RingSpinCount {
+			runtime.Gosched()
+			continue
+		}
+		p.park(&p.rsleep, p.rwake, p.readable)
+		spin = 0
+	}
+}
+
+func (p *ringPipe) Write(b []byte) (int, error) {
+	return p.write(b, true)
+}
+
+// write returns what fits rather than waiting when the ring is full and block
+// is false.
+func (p *ringPipe) write(b []byte, block bool) (int, error) {
+	var nn int
+	for spin := 0; ; spin++ {
+		if p.wclosed.Get() {
+			return nn, errors.Trace(io.ErrClosedPipe)
+		}
+		if p.rclosed.Get() {
+			return nn, p.rerror()
+		}
+		if len(b) == 0 {
+			p.pending = 0
+			p.wake(&p.rsleep, p.rwake)
+			return nn, nil
+		}
+		rpos, wpos := p.rpos.Get(), p.wpos.Get()
+		if wpos-rpos < p.size {
+			maxlen, offset := woffset(len(b), uint64(p.size), uint64(rpos), uint64(wpos))
+			n := copy(p.b[offset:offset+maxlen], b)
+			p.wpos.Set(wpos + int64(n))
+			nn, b = nn+n, b[n:]
+			if p.pending += int64(n); p.pending >= p.notify {
+				p.pending = 0
+				p.wake(&p.rsleep, p.rwake)
+			}
+			spin = 0
+			continue
+		}
+		p.pending = 0
+		p.wake(&p.rsleep, p.rwake)
+		if !block {
+			return nn, nil
+		}
+		if spin < RingSpinCount {
+			runtime.Gosched()
+			continue
+		}
+		p.park(&p.wsleep, p.wwake, p.writable)
+		spin = 0
+	}
+}
+
+func (p *ringPipe) rerror() error {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	return p.rerr
+}
+
+func (p *ringPipe) werror() error {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	return p.werr
+}
+
+func (p *ringPipe) RClose(err error) error {
+	if err == nil {
+		err = errors.Trace(io.ErrClosedPipe)
+	}
+	p.mu.Lock()
+	if p.rerr == nil {
+		p.rerr = err
+	}
+	p.mu.Unlock()
+	p.rclosed.Set(true)
+	p.wake(&p.rsleep, p.rwake)
+	p.wake(&p.wsleep, p.wwake)
+	return nil
+}
+
+func (p *ringPipe) WClose(err error) error {
+	if err == nil {
+		err = errors.Trace(io.EOF)
+	}
+	p.mu.Lock()
+	if p.werr == nil {
+		p.werr = err
+	}
+	p.mu.Unlock()
+	p.wclosed.Set(true)
+	p.wake(&p.rsleep, p.rwake)
+	p.wake(&p.wsleep, p.wwake)
+	return nil
+}
+
+func (p *ringPipe) Buffered() (int, error) {
+	if p.rclosed.Get() {
+		return 0, p.rerror()
+	}
+	if n := p.wpos.Get() - p.rpos.Get(); n != 0 {
+		return int(n), nil
+	}
+	if p.wclosed.Get() {
+		return 0, p.werror()
+	}
+	return 0, nil
+}
+
+func (p *ringPipe) Available() (int, error) {
+	if p.wclosed.Get() {
+		return 0, p.werror()
+	}
+	if p.rclosed.Get() {
+		return 0, p.rerror()
+	}
+	return int(p.size - (p.wpos.Get() - p.rpos.Get())), nil
+}
@@ -0,0 +1,300 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package pipe
+
+import (
+	"io"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"sync"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+)
+
+const (
+	SpillSegmentSize = 1024 * 1024 * 64
+
+	spillSegmentPrefix = "redis-port.spill."
+)
+
+// segment is a spill file, data in [rpos, wpos) is still to be read. While
+// writing is set the writer owns f and the bytes after wpos.
+type segment struct {
+	f       *os.File
+	rpos    int64
+	wpos    int64
+	writing bool
+}
+
+// spillPipe keeps data in a hot ring and, once that is full, appends the
+// overflow to segment files under dir, up to diskSize bytes in total. New
+// writes keep going to disk until every segment has been drained, so bytes
+// always come out in the order they went in. mu only guards the segment
+// list, files are read and written outside of it.
+type spillPipe struct {
+	hot *ringPipe
+	dir string
+
+	mu    sync.Mutex
+	rwait *sync.Cond
+	wwait *sync.Cond
+	segs  []*segment
+
+	segSize  int64
+	diskSize int64
+	disk     int64
+}
+
+func newSpillPipe(buffSize int, dir string, diskSize int64) *spillPipe {
+	if diskSize < 0 {
+		panic("invalid spill disk size")
+	}
+	p := &spillPipe{hot: newRingPipe(buffSize), dir: dir}
+	p.rwait = sync.NewCond(&p.mu)
+	p.wwait = sync.NewCond(&p.mu)
+	p.segSize = SpillSegmentSize
+	if p.segSize > diskSize {
+		p.segSize = diskSize
+	}
+	p.diskSize = diskSize
+	return p
+}
+
+// RemoveSpillSegments removes the segment files that a spill pipe, e.g. of a
+// process that was killed, left under dir and returns how many there were.
+func RemoveSpillSegments(dir string) (int, error) {
+	l, err := filepath.Glob(filepath.Join(dir, spillSegmentPrefix+"*"))
+	if err != nil {
+		return 0, errors.Trace(err)
+	}
+	for _, name := range l {
+		if err := os.Remove(name); err != nil {
+			return 0, errors.Trace(err)
+		}
+	}
+	return len(l), nil
+}
+
+func (p *spillPipe) spilled() bool {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+	return len(p.segs) != 0
+}
+
+// Read takes the ring first. Once the ring is empty and there are segments,
+// the writer has been sending everything since to disk.
+func (p *spillPipe) Read(b []byte) (int, error) {
+	for {
+		spilled := p.spilled()
+		n, err := p.hot.read(b, !spilled)
+		if err != nil || n != 0 || !spilled || len(b) == 0 {
+			return n, err
+		}
+		if n, err := p.readSegment(b); err != nil || n != 0 {
+			return n, err
+		}
+	}
+}
+
+func (p *spillPipe) readSegment(b []byte) (int, error) {
+	p.mu.Lock()
+	var s *segment
+	for !p.hot.rclosed.Get() {
+		if s = p.segs[0]; s.rpos != s.wpos || !s.writing {
+			break
+		}
+		p.rwait.Wait()
+	}
+	if p.hot.rclosed.Get() {
+		p.mu.Unlock()
+		return 0, errors.Trace(io.ErrClosedPipe)
+	}
+	if s.rpos == s.wpos {
+		p.segs[0], p.segs = nil, p.segs[1:]
+		p.disk -= s.wpos
+		p.wwait.Signal()
+		p.mu.Unlock()
+		return 0, p.remove(s)
+	}
+	f, rpos := s.f, s.rpos
+	if n := s.wpos - rpos; int64(len(b)) > n {
+		b = b[:n]
+	}
+	p.mu.Unlock()
+
+	n, err := f.ReadAt(b, rpos)
+
+	p.mu.Lock()
+	s.rpos += int64(n)
+	p.mu.Unlock()
+	return n, errors.Trace(err)
+}
+
+func (p *spillPipe) Write(b []byte) (int, error) {
+	if len(b) == 0 {
+		return p.hot.write(b, false)
+	}
+	var nn int
+	for len(b) != 0 {
+		n, err := p.writeSome(b)
+		if nn, b = nn+n, b[n:]; err != nil {
+			return nn, err
+		}
+	}
+	return nn, nil
+}
+
+func (p *spillPipe) writeSome(b []byte) (int, error) {
+	if !p.spilled() {
+		if n, err := p.hot.write(b, p.segSize == 0); err != nil || n != 0 {
+			return n, err
+		}
+	}
+	return p.writeSegment(b)
+}
+
+func (p *spillPipe) werror() error {
+	if p.hot.wclosed.Get() {
+		return errors.Trace(io.ErrClosedPipe)
+	}
+	if p.hot.rclosed.Get() {
+		return p.hot.rerror()
+	}
+	return nil
+}
+
+// writeSegment appends to the last segment. The first one is only added
+// while the ring is full, and a new one is added to the list before its file
+// is created, so the reader waits for it rather than going back to the ring.
+func (p *spillPipe) writeSegment(b []byte) (int, error) {
+	p.mu.Lock()
+	var s *segment
+	for s == nil {
+		if err := p.werror(); err != nil {
+			p.mu.Unlock()
+			return 0, err
+		}
+		if len(p.segs) == 0 && p.hot.wpos.Get()-p.hot.rpos.Get() < p.hot.size {
+			p.mu.Unlock()
+			return 0, nil
+		}
+		if k := len(p.segs); k != 0 && p.segs[k-1].wpos < p.segSize {
+			s = p.segs[k-1]
+		} else if p.disk+p.segSize <= p.diskSize {
+			s = &segment{}
+			p.segs = append(p.segs, s)
+		} else {
+			p.wwait.Wait()
+		}
+	}
+	s.writing = true
+	f, wpos := s.f, s.wpos
+	if n := p.segSize - wpos; int64(len(b)) > n {
+		b = b[:n]
+	}
+	p.mu.Unlock()
+
+	var n int
+	var err error
+	created := f == nil
+	if created {
+		f, err = ioutil.TempFile(p.dir, spillSegmentPrefix)
+	}
+	if err == nil {
+		n, err = f.WriteAt(b, wpos)
+	}
+
+	p.mu.Lock()
+	s.f = f
+	s.wpos += int64(n)
+	s.writing = false
+	p.disk += int64(n)
+	p.rwait.Signal()
+	k := len(p.segs)
+	dropped := k == 0 || p.segs[k-1] != s
+	p.mu.Unlock()
+
+	// RClose has dropped the segment before its file was created
+	if created && dropped && f != nil {
+		p.remove(s)
+	}
+	return n, errors.Trace(err)
+}
+
+func (p *spillPipe) remove(s *segment) error {
+	if s.f == nil {
+		return nil
+	}
+	if err := s.f.Close(); err != nil {
+		return errors.Trace(err)
+	}
+	return errors.Trace(os.Remove(s.f.Name()))
+}
+
+func (p *spillPipe) Buffered() (int, error) {
+	if p.hot.rclosed.Get() {
+		return 0, p.hot.rerror()
+	}
+	n := p.hot.wpos.Get() - p.hot.rpos.Get()
+	p.mu.Lock()
+	for _, s := range p.segs {
+		n += s.wpos - s.rpos
+	}
+	p.mu.Unlock()
+	if n != 0 {
+		return int(n), nil
+	}
+	if p.hot.wclosed.Get() {
+		return 0, p.hot.werror()
+	}
+	return 0, nil
+}
+
+func (p *spillPipe) Available() (int, error) {
+	if p.hot.wclosed.Get() {
+		return 0, p.hot.werror()
+	}
+	if p.hot.rclosed.Get() {
+		return 0, p.hot.rerror()
+	}
+	p.mu.Lock()
+	n := p.diskSize - p.disk
+	spilled := len(p.segs) != 0
+	p.mu.Unlock()
+	if !spilled {
+		n += p.hot.size - (p.hot.wpos.Get() - p.hot.rpos.Get())
+	}
+	return int(n), nil
+}
+
+func (p *spillPipe) RClose(err error) error {
+	p.hot.RClose(err)
+	p.mu.Lock()
+	var segs []*segment
+	for _, s := range p.segs {
+		segs = append(segs, &segment{f: s.f})
+	}
+	p.segs, p.disk = nil, 0
+	p.rwait.Broadcast()
+	p.wwait.Broadcast()
+	p.mu.Unlock()
+
+	var rerr error
+	for _, s := range segs {
+		if e := p.remove(s); e != nil && rerr == nil {
+			rerr = e
+		}
+	}
+	return rerr
+}
+
+func (p *spillPipe) WClose(err error) error {
+	p.hot.WClose(err)
+	p.mu.Lock()
+	p.rwait.Broadcast()
+	p.wwait.Broadcast()
+	p.mu.Unlock()
+	return nil
+}
@@ -0,0 +1,240 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package rdb
+
+import (
+	"bytes"
+	"fmt"
+	"strings"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+)
+
+const benchRdbSize = 1024 * 1024 * 4
+
+func benchString(n int) String {
+	return String(strings.Repeat("x", n))
+}
+
+func benchList(n int) List {
+	o := List{}
+	for i := 0; i < n; i++ {
+		o = append(o, []byte(fmt.Sprintf("element:%08d", i)))
+	}
+	return o
+}
+
+func benchHash(n int) Hash {
+	o := Hash{}
+	for i := 0; i < n; i++ {
+		o = append(o, &HashElement{
+			Field: []byte(fmt.Sprintf("field:%08d", i)),
+			Value: []byte(fmt.Sprintf("value:%08d", i)),
+		})
+	}
+	return o
+}
+
+func benchSet(n int) Set {
+	return Set(benchList(n))
+}
+
+func benchZSet(n int) ZSet {
+	o := ZSet{}
+	for i := 0; i < n; i++ {
+		o = append(o, &ZSetElement{
+			Member: []byte(fmt.Sprintf("member:%08d", i)),
+			Score:  float64(i) / 3,
+		})
+	}
+	return o
+}
+
+// benchRdb returns an rdb file of about benchRdbSize bytes holding copies of
+// obj, and the number of entries in it.
+func benchRdb(obj interface{}) ([]byte, int) {
+	p, err := EncodeDump(obj)
+	assert.MustNoError(err)
+	n := benchRdbSize / len(p)
+	if n == 0 {
+		n = 1
+	}
+	var b bytes.Buffer
+	enc := NewEncoder(&b)
+	assert.MustNoError(enc.EncodeHeader())
+	for i := 0; i < n; i++ {
+		key := []byte(fmt.Sprintf("key:%08d", i))
+		assert.MustNoError(enc.EncodeObject(0, key, 0, obj))
+	}
+	assert.MustNoError(enc.EncodeFooter())
+	return b.Bytes(), n
+}
+
+func benchmarkLoader(b *testing.B, obj interface{}) {
+	p, n := benchRdb(obj)
+	b.SetBytes(int64(len(p)))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		l := NewLoader(bytes.NewReader(p))
+		assert.MustNoError(l.Header())
+		for j := 0; ; j++ {
+			e, err := l.NextBinEntry()
+			assert.MustNoError(err)
+			if e == nil {
+				assert.Must(j == n)
+				break
+			}
+		}
+		assert.MustNoError(l.Footer())
+	}
+}
+
+func BenchmarkLoaderString16(b *testing.B) { benchmarkLoader(b, benchString(16)) }
+func BenchmarkLoaderString4K(b *testing.B) { benchmarkLoader(b, benchString(1024*4)) }
+func BenchmarkLoaderString1M(b *testing.B) { benchmarkLoader(b, benchString(1024*1024)) }
+func BenchmarkLoaderList128(b *testing.B)  { benchmarkLoader(b, benchList(128)) }
+func BenchmarkLoaderHash128(b *testing.B)  { benchmarkLoader(b, benchHash(128)) }
+func BenchmarkLoaderSet128(b *testing.B)   { benchmarkLoader(b, benchSet(128)) }
+func BenchmarkLoaderZSet128(b *testing.B)  { benchmarkLoader(b, benchZSet(128)) }
+
+func benchmarkDecodeDump(b *testing.B, obj interface{}) {
+	p, err := EncodeDump(obj)
+	assert.MustNoError(err)
+	b.SetBytes(int64(len(p)))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		_, err := DecodeDump(p)
+		assert.MustNoError(err)
+	}
+}
+
+func BenchmarkDecodeDumpString4K(b *testing.B) { benchmarkDecodeDump(b, benchString(1024*4)) }
+func BenchmarkDecodeDumpList1K(b *testing.B)   { benchmarkDecodeDump(b, benchList(1024)) }
+func BenchmarkDecodeDumpHash1K(b *testing.B)   { benchmarkDecodeDump(b, benchHash(1024)) }
+func BenchmarkDecodeDumpSet1K(b *testing.B)    { benchmarkDecodeDump(b, benchSet(1024)) }
+func BenchmarkDecodeDumpZSet1K(b *testing.B)   { benchmarkDecodeDump(b, benchZSet(1024)) }
+
+// benchmarkDecodeDumpPacked reports B/op next to DecodeDump's, which is the
+// heap an object of the packed layout costs compared to the pointer one.
+func benchmarkDecodeDumpPacked(b *testing.B, obj interface{}) {
+	p, err := EncodeDump(obj)
+	assert.MustNoError(err)
+	b.SetBytes(int64(len(p)))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		_, err := DecodeDumpPacked(p)
+		assert.MustNoError(err)
+	}
+}
+
+func BenchmarkDecodeDumpHash64K(b *testing.B)       { benchmarkDecodeDump(b, benchHash(65536)) }
+func BenchmarkDecodeDumpZSet64K(b *testing.B)       { benchmarkDecodeDump(b, benchZSet(65536)) }
+func BenchmarkDecodeDumpPackedHash64K(b *testing.B) { benchmarkDecodeDumpPacked(b, benchHash(65536)) }
+func BenchmarkDecodeDumpPackedZSet64K(b *testing.B) { benchmarkDecodeDumpPacked(b, benchZSet(65536)) }
+
+// benchmarkDecodeFields decodes a hash and converts its fields to strings, as
+// decode does, with or without an interner.
+func benchmarkDecodeFields(b *testing.B, intern bool) {
+	obj := Hash{}
+	for i := 0; i < 1024; i++ {
+		obj = append(obj, &HashElement{
+			Field: []byte(fmt.Sprintf("field:%04d", i%64)),
+			Value: []byte(fmt.Sprintf("value:%08d", i)),
+		})
+	}
+	p, err := EncodeDump(obj)
+	assert.MustNoError(err)
+	var in *Interner
+	if intern {
+		in = NewInterner()
+	}
+	fields := make([]string, len(obj))
+	b.SetBytes(int64(len(p)))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		o, err := DecodeDumpIntern(p, in)
+		assert.MustNoError(err)
+		for j, e := range o.(Hash) {
+			fields[j] = in.Lookup(e.Field)
+		}
+	}
+}
+
+func BenchmarkDecodeFields(b *testing.B)       { benchmarkDecodeFields(b, false) }
+func BenchmarkDecodeFieldsIntern(b *testing.B) { benchmarkDecodeFields(b, true) }
+
+func benchmarkEncodeDump(b *testing.B, obj interface{}) {
+	p, err := EncodeDump(obj)
+	assert.MustNoError(err)
+	b.SetBytes(int64(len(p)))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		_, err := EncodeDump(obj)
+		assert.MustNoError(err)
+	}
+}
+
+func BenchmarkEncodeDumpString4K(b *testing.B) { benchmarkEncodeDump(b, benchString(1024*4)) }
+func BenchmarkEncodeDumpList1K(b *testing.B)   { benchmarkEncodeDump(b, benchList(1024)) }
+func BenchmarkEncodeDumpHash1K(b *testing.B)   { benchmarkEncodeDump(b, benchHash(1024)) }
+func BenchmarkEncodeDumpSet1K(b *testing.B)    { benchmarkEncodeDump(b, benchSet(1024)) }
+func BenchmarkEncodeDumpZSet1K(b *testing.B)   { benchmarkEncodeDump(b, benchZSet(1024)) }
+
+// lzfRepeat compresses n bytes that repeat a 32 bytes pattern: one literal
+// run, followed by back references of the longest length.
+func lzfRepeat(n int) []byte {
+	const pattern = "0123456789abcdefghijklmnopqrstuv"
+	in := append([]byte{byte(len(pattern) - 1)}, pattern...)
+	for o := len(pattern); o < n; {
+		l := n - o
+		if l > 264 {
+			l = 264
+		}
+		// a back reference copies l = length + 2 bytes from offset o - 32,
+		// and needs length != 0
+		switch {
+		case l < 3:
+			in = append(in, byte(l-1))
+			for i := 0; i < l; i++ {
+				in = append(in, pattern[(o+i)%len(pattern)])
+			}
+		case l < 9:
+			in = append(in, byte((l-2)<<5), byte(len(pattern)-1))
+		default:
+			in = append(in, 7<<5, byte(l-9), byte(len(pattern)-1))
+		}
+		o += l
+	}
+	return in
+}
+
+func TestLzfRepeat(t *testing.T) {
+	for _, n := range []int{32, 33, 34, 35, 40, 41, 296, 297, 298, 4096, 1024 * 1024} {
+		out, err := lzfDecompress(lzfRepeat(n), n)
+		assert.MustNoError(err)
+		for i := range out {
+			assert.Must(out[i] == out[i%32])
+		}
+	}
+}
+
+func benchmarkLzfDecompress(b *testing.B, n int) {
+	in := lzfRepeat(n)
+	b.SetBytes(int64(n))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		_, err := lzfDecompress(in, n)
+		assert.MustNoError(err)
+	}
+}
+
+func BenchmarkLzfDecompress4K(b *testing.B) { benchmarkLzfDecompress(b, 1024*4) }
+func BenchmarkLzfDecompress1M(b *testing.B) { benchmarkLzfDecompress(b, 1024*1024) }
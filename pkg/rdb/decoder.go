@@ -5,6 +5,7 @@ package rdb
 
 import (
 	"bytes"
+	"math"
 
 	"github.com/CodisLabs/codis/pkg/utils/errors"
 	"github.com/spinlock/rdb"
@@ -19,10 +20,34 @@ func DecodeDump(p []byte) (interface{}, error) {
 	return d.obj, d.err
 }
 
+// DecodeDumpPacked decodes hashes and zsets into PackedHash and PackedZSet,
+// with arenas sized after the payload rather than grown element by element.
+func DecodeDumpPacked(p []byte) (interface{}, error) {
+	d := &decoder{packed: true, size: len(p)}
+	if err := rdb.DecodeDump(p, 0, nil, 0, d); err != nil {
+		return nil, errors.Trace(err)
+	}
+	return d.obj, d.err
+}
+
+// DecodeDumpIntern decodes like DecodeDump, with hash fields and set and zset
+// members interned by in. The interned slices are shared, read-only.
+func DecodeDumpIntern(p []byte, in *Interner) (interface{}, error) {
+	d := &decoder{intern: in}
+	if err := rdb.DecodeDump(p, 0, nil, 0, d); err != nil {
+		return nil, errors.Trace(err)
+	}
+	return d.obj, d.err
+}
+
 type decoder struct {
 	nopdecoder.NopDecoder
 	obj interface{}
 	err error
+
+	packed bool
+	size   int
+	intern *Interner
 }
 
 func (d *decoder) initObject(obj interface{}) {
@@ -41,7 +66,11 @@ func (d *decoder) Set(key, value []byte, expiry int64) {
 }
 
 func (d *decoder) StartHash(key []byte, length, expiry int64) {
-	d.initObject(Hash(nil))
+	if d.packed {
+		d.initObject(NewPackedHash(int(length), d.size))
+	} else {
+		d.initObject(Hash(nil))
+	}
 }
 
 func (d *decoder) Hset(key, field, value []byte) {
@@ -52,8 +81,10 @@ func (d *decoder) Hset(key, field, value []byte) {
 	default:
 		d.err = errors.Errorf("invalid object, not a hashmap")
 	case Hash:
-		v := &HashElement{Field: field, Value: value}
+		v := &HashElement{Field: d.intern.Bytes(field), Value: value}
 		d.obj = append(h, v)
+	case *PackedHash:
+		d.err = h.Append(field, value)
 	}
 }
 
@@ -69,7 +100,7 @@ func (d *decoder) Sadd(key, member []byte) {
 	default:
 		d.err = errors.Errorf("invalid object, not a set")
 	case Set:
-		d.obj = append(s, member)
+		d.obj = append(s, d.intern.Bytes(member))
 	}
 }
 
@@ -90,7 +121,11 @@ func (d *decoder) Rpush(key, value []byte) {
 }
 
 func (d *decoder) StartZSet(key []byte, cardinality, expiry int64) {
-	d.initObject(ZSet(nil))
+	if d.packed {
+		d.initObject(NewPackedZSet(int(cardinality), d.size))
+	} else {
+		d.initObject(ZSet(nil))
+	}
 }
 
 func (d *decoder) Zadd(key []byte, score float64, member []byte) {
@@ -101,8 +136,10 @@ func (d *decoder) Zadd(key []byte, score float64, member []byte) {
 	default:
 		d.err = errors.Errorf("invalid object, not a zset")
 	case ZSet:
-		v := &ZSetElement{Member: member, Score: score}
+		v := &ZSetElement{Member: d.intern.Bytes(member), Score: score}
 		d.obj = append(z, v)
+	case *PackedZSet:
+		d.err = z.Append(score, member)
 	}
 }
 
@@ -154,3 +191,130 @@ type ZSortByScore struct{ ZSet }
 func (by ZSortByScore) Less(i, j int) bool {
 	return by.ZSet[i].Score < by.ZSet[j].Score
 }
+
+var ErrPackedTooLarge = errors.New("packed object is too large")
+
+// PackedHash stores all fields and values in one contiguous arena, element i
+// is described by offs[i*3:i*3+3] = {field begin, value begin, value end}.
+type PackedHash struct {
+	buf  []byte
+	offs []uint32
+}
+
+// packedPrealloc bounds the number of elements and the arena size that are
+// allocated up front, the element count of a payload is not to be trusted
+// and every element takes at least 2 bytes of it.
+func packedPrealloc(n, nbytes int) (int, int) {
+	if nbytes < 0 {
+		nbytes = 0
+	}
+	if n < 0 {
+		n = 0
+	} else if n > nbytes/2 {
+		n = nbytes / 2
+	}
+	return n, nbytes
+}
+
+// NewPackedHash returns a hash with room for n elements of nbytes in total,
+// nbytes is usually the size of the DUMP payload it is decoded from.
+func NewPackedHash(n, nbytes int) *PackedHash {
+	n, nbytes = packedPrealloc(n, nbytes)
+	return &PackedHash{buf: make([]byte, 0, nbytes), offs: make([]uint32, 0, n*3)}
+}
+
+func (hash *PackedHash) Append(field, value []byte) error {
+	if uint64(len(hash.buf))+uint64(len(field))+uint64(len(value)) > math.MaxUint32 {
+		return errors.Trace(ErrPackedTooLarge)
+	}
+	f := uint32(len(hash.buf))
+	hash.buf = append(hash.buf, field...)
+	v := uint32(len(hash.buf))
+	hash.buf = append(hash.buf, value...)
+	hash.offs = append(hash.offs, f, v, uint32(len(hash.buf)))
+	return nil
+}
+
+func (hash *PackedHash) Field(i int) []byte {
+	o := hash.offs[i*3 : i*3+3]
+	return hash.buf[o[0]:o[1]:o[1]]
+}
+
+func (hash *PackedHash) Value(i int) []byte {
+	o := hash.offs[i*3 : i*3+3]
+	return hash.buf[o[1]:o[2]:o[2]]
+}
+
+func (hash *PackedHash) Len() int {
+	return len(hash.offs) / 3
+}
+
+func (hash *PackedHash) Swap(i, j int) {
+	a, b := hash.offs[i*3:i*3+3], hash.offs[j*3:j*3+3]
+	a[0], b[0] = b[0], a[0]
+	a[1], b[1] = b[1], a[1]
+	a[2], b[2] = b[2], a[2]
+}
+
+type PackedHSortByField struct{ *PackedHash }
+
+func (by PackedHSortByField) Less(i, j int) bool {
+	return bytes.Compare(by.Field(i), by.Field(j)) < 0
+}
+
+// PackedZSet stores all members in one contiguous arena, member i is
+// buf[offs[i*2]:offs[i*2+1]] and its score is kept in a parallel array.
+type PackedZSet struct {
+	buf    []byte
+	offs   []uint32
+	scores []float64
+}
+
+// NewPackedZSet returns a zset with room for n members of nbytes in total.
+func NewPackedZSet(n, nbytes int) *PackedZSet {
+	n, nbytes = packedPrealloc(n, nbytes)
+	return &PackedZSet{buf: make([]byte, 0, nbytes), offs: make([]uint32, 0, n*2), scores: make([]float64, 0, n)}
+}
+
+func (zset *PackedZSet) Append(score float64, member []byte) error {
+	if uint64(len(zset.buf))+uint64(len(member)) > math.MaxUint32 {
+		return errors.Trace(ErrPackedTooLarge)
+	}
+	m := uint32(len(zset.buf))
+	zset.buf = append(zset.buf, member...)
+	zset.offs = append(zset.offs, m, uint32(len(zset.buf)))
+	zset.scores = append(zset.scores, score)
+	return nil
+}
+
+func (zset *PackedZSet) Member(i int) []byte {
+	o := zset.offs[i*2 : i*2+2]
+	return zset.buf[o[0]:o[1]:o[1]]
+}
+
+func (zset *PackedZSet) Score(i int) float64 {
+	return zset.scores[i]
+}
+
+func (zset *PackedZSet) Len() int {
+	return len(zset.scores)
+}
+
+func (zset *PackedZSet) Swap(i, j int) {
+	a, b := zset.offs[i*2:i*2+2], zset.offs[j*2:j*2+2]
+	a[0], b[0] = b[0], a[0]
+	a[1], b[1] = b[1], a[1]
+	zset.scores[i], zset.scores[j] = zset.scores[j], zset.scores[i]
+}
+
+type PackedZSortByMember struct{ *PackedZSet }
+
+func (by PackedZSortByMember) Less(i, j int) bool {
+	return bytes.Compare(by.Member(i), by.Member(j)) < 0
+}
+
+type PackedZSortByScore struct{ *PackedZSet }
+
+func (by PackedZSortByScore) Less(i, j int) bool {
+	return by.Score(i) < by.Score(j)
+}
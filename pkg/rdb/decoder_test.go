@@ -188,3 +188,35 @@ func TestDecodeZSet(t *testing.T) {
 		assert.Must(math.Abs(score+float64(i)) < 1e-10)
 	}
 }
+
+func TestDecodeIntern(t *testing.T) {
+	hash := Hash{}
+	for i := 0; i < 16; i++ {
+		hash = append(hash, &HashElement{Field: []byte(strconv.Itoa(i)), Value: []byte(strconv.Itoa(i))})
+	}
+	p, err := EncodeDump(hash)
+	assert.MustNoError(err)
+	in := NewInterner()
+	o1, err := DecodeDumpIntern(p, in)
+	assert.MustNoError(err)
+	o2, err := DecodeDumpIntern(p, in)
+	assert.MustNoError(err)
+	h1, h2 := o1.(Hash), o2.(Hash)
+	for i := 0; i < len(hash); i++ {
+		assert.Must(bytes.Equal(h1[i].Field, hash[i].Field))
+		assert.Must(&h1[i].Field[0] == &h2[i].Field[0])
+		assert.Must(cap(h1[i].Field) == len(h1[i].Field))
+		assert.Must(in.Lookup(h1[i].Field) == string(hash[i].Field))
+	}
+	assert.Must(in.Stats.Hits == int64(len(hash)))
+}
+
+func TestInternDisable(t *testing.T) {
+	in := NewInterner()
+	for i := 0; i < internWindow; i++ {
+		in.String([]byte(strconv.Itoa(i)))
+	}
+	assert.Must(in.Stats.Disabled == 1 && in.bypass != 0)
+	b := []byte("0")
+	assert.Must(&in.Bytes(b)[0] == &b[0])
+}
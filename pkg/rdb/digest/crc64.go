@@ -74,14 +74,93 @@ var crc64_table = [256]uint64{
 	0x66e7a46c27f3aa2c, 0x1c3fd4a417c62355, 0x935745fc4798b8de, 0xe98f353477ad31a7,
 	0xa6df411fbfb21ca3, 0xdc0731d78f8795da, 0x536fa08fdfd90e51, 0x29b7d047efec8728}
 
+// crc64_slicing extends crc64_table so that Update can consume 8 bytes per
+// step, crc64_slicing[k][b] is the crc of b followed by k zero bytes.
+var crc64_slicing = func() *[8][256]uint64 {
+	t := &[8][256]uint64{}
+	t[0] = crc64_table
+	for i := 0; i < 256; i++ {
+		crc := crc64_table[i]
+		for k := 1; k < 8; k++ {
+			crc = crc64_table[byte(crc)] ^ (crc >> 8)
+			t[k][i] = crc
+		}
+	}
+	return t
+}()
+
+// Update returns the crc64 of the bytes summed up to crc followed by p.
+func Update(crc uint64, p []byte) uint64 {
+	t := crc64_slicing
+	for len(p) >= 8 {
+		crc ^= binary.LittleEndian.Uint64(p)
+		crc = t[7][byte(crc)] ^ t[6][byte(crc>>8)] ^ t[5][byte(crc>>16)] ^ t[4][byte(crc>>24)] ^
+			t[3][byte(crc>>32)] ^ t[2][byte(crc>>40)] ^ t[1][byte(crc>>48)] ^ t[0][byte(crc>>56)]
+		p = p[8:]
+	}
+	for _, b := range p {
+		crc = crc64_table[byte(crc)^b] ^ (crc >> 8)
+	}
+	return crc
+}
+
+// Combine returns the crc64 of A followed by B, given crc1 of A, and crc2 and
+// len2 of B, so that parts of a stream can be summed up in parallel. It shifts
+// crc1 over len2 zero bytes with the operator matrices of zlib's
+// crc32_combine.
+func Combine(crc1, crc2 uint64, len2 int64) uint64 {
+	if len2 <= 0 {
+		return crc1 ^ crc2
+	}
+	var even, odd [64]uint64
+	// the operator of one zero bit, crc64_table[128] is the reflected poly
+	odd[0] = crc64_table[128]
+	for n, row := 1, uint64(1); n < 64; n, row = n+1, row<<1 {
+		odd[n] = row
+	}
+	gf2MatrixSquare(&even, &odd)
+	gf2MatrixSquare(&odd, &even)
+	for {
+		gf2MatrixSquare(&even, &odd)
+		if len2&1 != 0 {
+			crc1 = gf2MatrixTimes(&even, crc1)
+		}
+		if len2 >>= 1; len2 == 0 {
+			break
+		}
+		gf2MatrixSquare(&odd, &even)
+		if len2&1 != 0 {
+			crc1 = gf2MatrixTimes(&odd, crc1)
+		}
+		if len2 >>= 1; len2 == 0 {
+			break
+		}
+	}
+	return crc1 ^ crc2
+}
+
+func gf2MatrixTimes(mat *[64]uint64, vec uint64) uint64 {
+	var sum uint64
+	for i := 0; vec != 0; i, vec = i+1, vec>>1 {
+		if vec&1 != 0 {
+			sum ^= mat[i]
+		}
+	}
+	return sum
+}
+
+func gf2MatrixSquare(square, mat *[64]uint64) {
+	for n := 0; n < 64; n++ {
+		square[n] = gf2MatrixTimes(mat, mat[n])
+	}
+}
+
 type digest struct {
 	crc uint64
 }
 
 func (d *digest) update(p []byte) {
-	for _, b := range p {
-		d.crc = crc64_table[byte(d.crc)^b] ^ (d.crc >> 8)
-	}
+	d.crc = Update(d.crc, p)
 }
 
 func New() hash.Hash64 {
@@ -0,0 +1,60 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package digest
+
+import (
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+)
+
+func TestCRC64(t *testing.T) {
+	// the check value of crc64 in redis, see crc64.c
+	d := New()
+	d.Write([]byte("123456789"))
+	assert.Must(d.Sum64() == 0xe9c6d914c4b8d9ca)
+}
+
+func TestUpdate(t *testing.T) {
+	p := make([]byte, 1024)
+	for i := range p {
+		p[i] = byte(i * 7)
+	}
+	for n := 0; n <= len(p); n += 13 {
+		var crc uint64
+		for _, b := range p[:n] {
+			crc = crc64_table[byte(crc)^b] ^ (crc >> 8)
+		}
+		assert.Must(Update(0, p[:n]) == crc)
+	}
+}
+
+func TestCombine(t *testing.T) {
+	p := make([]byte, 4096)
+	for i := range p {
+		p[i] = byte(i * 31)
+	}
+	for _, n := range []int{0, 1, 7, 8, 100, 1000, 4095, 4096} {
+		crc1, crc2 := Update(0, p[:n]), Update(0, p[n:])
+		assert.Must(Combine(crc1, crc2, int64(len(p)-n)) == Update(0, p))
+	}
+}
+
+func benchmarkCRC64(b *testing.B, n int) {
+	p := make([]byte, n)
+	for i := range p {
+		p[i] = byte(i)
+	}
+	d := New()
+	b.SetBytes(int64(n))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		d.Write(p)
+	}
+}
+
+func BenchmarkCRC64Size64(b *testing.B) { benchmarkCRC64(b, 64) }
+func BenchmarkCRC64Size4K(b *testing.B) { benchmarkCRC64(b, 1024*4) }
+func BenchmarkCRC64Size1M(b *testing.B) { benchmarkCRC64(b, 1024*1024) }
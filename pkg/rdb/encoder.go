@@ -4,98 +4,303 @@
 package rdb
 
 import (
-	"bytes"
+	"encoding/binary"
+	"fmt"
 	"io"
+	"math"
+	"strconv"
 
 	"github.com/CodisLabs/codis/pkg/utils/errors"
-	"github.com/spinlock/rdb"
+	"github.com/CodisLabs/redis-port/pkg/rdb/digest"
 )
 
+// rdbVersion is the version of the rdb and DUMP payloads written by the
+// encoders, it is understood by every redis since 2.6.
+const rdbVersion = 6
+
+// encoder writes the rdb encoding of types, lengths and strings. Unlike
+// rdb.Encoder of spinlock/rdb it doesn't checksum every byte by itself and
+// it doesn't allocate per string. Small writes are gathered in buf and passed
+// to w in one go by flush, an encoder without w only appends to buf.
+type encoder struct {
+	w   io.Writer
+	buf []byte
+}
+
+const encoderBufferSize = 4096
+
+func (e *encoder) flush() error {
+	if e.w == nil || len(e.buf) == 0 {
+		return nil
+	}
+	_, err := e.w.Write(e.buf)
+	e.buf = e.buf[:0]
+	return err
+}
+
+// grow makes room for n more bytes in buf.
+func (e *encoder) grow(n int) error {
+	if e.w != nil && len(e.buf)+n > cap(e.buf) {
+		if e.buf == nil {
+			e.buf = make([]byte, 0, encoderBufferSize)
+		}
+		return e.flush()
+	}
+	return nil
+}
+
+func (e *encoder) write(p []byte) error {
+	if e.w != nil && len(p) >= encoderBufferSize/8 {
+		if err := e.flush(); err != nil {
+			return err
+		}
+		_, err := e.w.Write(p)
+		return err
+	}
+	if err := e.grow(len(p)); err != nil {
+		return err
+	}
+	e.buf = append(e.buf, p...)
+	return nil
+}
+
+func (e *encoder) encodeType(t byte) error {
+	if err := e.grow(1); err != nil {
+		return err
+	}
+	e.buf = append(e.buf, t)
+	return nil
+}
+
+func (e *encoder) encodeDatabase(db uint32) error {
+	if err := e.grow(6); err != nil {
+		return err
+	}
+	e.buf = appendLength(append(e.buf, rdbFlagSelectDB), db)
+	return nil
+}
+
+func (e *encoder) encodeExpiry(expireat uint64) error {
+	if err := e.grow(9); err != nil {
+		return err
+	}
+	var b [8]byte
+	binary.LittleEndian.PutUint64(b[:], expireat)
+	e.buf = append(append(e.buf, rdbFlagExpiryMS), b[:]...)
+	return nil
+}
+
+func appendLength(b []byte, l uint32) []byte {
+	switch {
+	case l < 1<<6:
+		return append(b, byte(l))
+	case l < 1<<14:
+		return append(b, byte(l>>8)|rdb14bitLen<<6, byte(l))
+	default:
+		return append(b, rdb32bitLen<<6, byte(l>>24), byte(l>>16), byte(l>>8), byte(l))
+	}
+}
+
+func (e *encoder) encodeLength(l uint32) error {
+	if err := e.grow(5); err != nil {
+		return err
+	}
+	e.buf = appendLength(e.buf, l)
+	return nil
+}
+
+// encodeString writes s in the int encoding if it is an int32 that reads the
+// same once formatted back, and as a length prefixed string otherwise.
+func (e *encoder) encodeString(s []byte) error {
+	i, ok := parseInt32(s)
+	if !ok {
+		if err := e.encodeLength(uint32(len(s))); err != nil {
+			return err
+		}
+		return e.write(s)
+	}
+	if err := e.grow(5); err != nil {
+		return err
+	}
+	switch {
+	case i >= math.MinInt8 && i <= math.MaxInt8:
+		e.buf = append(e.buf, rdbEncVal<<6|rdbEncInt8, byte(i))
+	case i >= math.MinInt16 && i <= math.MaxInt16:
+		e.buf = append(e.buf, rdbEncVal<<6|rdbEncInt16, byte(i), byte(i>>8))
+	default:
+		e.buf = append(e.buf, rdbEncVal<<6|rdbEncInt32, byte(i), byte(i>>8), byte(i>>16), byte(i>>24))
+	}
+	return nil
+}
+
+func (e *encoder) encodeFloat(f float64) error {
+	if err := e.grow(32); err != nil {
+		return err
+	}
+	switch {
+	case math.IsNaN(f):
+		e.buf = append(e.buf, 253)
+	case math.IsInf(f, 1):
+		e.buf = append(e.buf, 254)
+	case math.IsInf(f, -1):
+		e.buf = append(e.buf, 255)
+	default:
+		i := len(e.buf)
+		e.buf = strconv.AppendFloat(append(e.buf, 0), f, 'g', 17, 64)
+		e.buf[i] = byte(len(e.buf) - i - 1)
+	}
+	return nil
+}
+
+// parseInt32 returns the value of s if s is the decimal form of an int32 as
+// strconv would format it, i.e. without sign '+', spaces or leading zeros.
+func parseInt32(s []byte) (int32, bool) {
+	if len(s) == 0 || len(s) > 11 {
+		return 0, false
+	}
+	d := s
+	if s[0] == '-' {
+		d = s[1:]
+	}
+	if len(d) == 0 || (d[0] == '0' && len(s) != 1) {
+		return 0, false
+	}
+	var n int64
+	for _, c := range d {
+		if c < '0' || c > '9' {
+			return 0, false
+		}
+		n = n*10 + int64(c-'0')
+	}
+	if len(d) != len(s) {
+		n = -n
+	}
+	if n < math.MinInt32 || n > math.MaxInt32 {
+		return 0, false
+	}
+	return int32(n), true
+}
+
 type objectEncoder interface {
-	encodeType(enc *rdb.Encoder) error
-	encodeValue(enc *rdb.Encoder) error
+	encodeType(enc *encoder) error
+	encodeValue(enc *encoder) error
 }
 
-func (o String) encodeType(enc *rdb.Encoder) error {
-	t := rdb.ValueType(rdbTypeString)
-	return errors.Trace(enc.EncodeType(t))
+func (o String) encodeType(enc *encoder) error {
+	return errors.Trace(enc.encodeType(rdbTypeString))
 }
 
-func (o String) encodeValue(enc *rdb.Encoder) error {
-	if err := enc.EncodeString([]byte(o)); err != nil {
+func (o String) encodeValue(enc *encoder) error {
+	if err := enc.encodeString([]byte(o)); err != nil {
 		return errors.Trace(err)
 	}
 	return nil
 }
 
-func (o Hash) encodeType(enc *rdb.Encoder) error {
-	t := rdb.ValueType(rdbTypeHash)
-	return errors.Trace(enc.EncodeType(t))
+func (o Hash) encodeType(enc *encoder) error {
+	return errors.Trace(enc.encodeType(rdbTypeHash))
 }
 
-func (o Hash) encodeValue(enc *rdb.Encoder) error {
-	if err := enc.EncodeLength(uint32(len(o))); err != nil {
+func (o Hash) encodeValue(enc *encoder) error {
+	if err := enc.encodeLength(uint32(len(o))); err != nil {
 		return errors.Trace(err)
 	}
 	for _, e := range o {
-		if err := enc.EncodeString(e.Field); err != nil {
+		if err := enc.encodeString(e.Field); err != nil {
 			return errors.Trace(err)
 		}
-		if err := enc.EncodeString(e.Value); err != nil {
+		if err := enc.encodeString(e.Value); err != nil {
 			return errors.Trace(err)
 		}
 	}
 	return nil
 }
 
-func (o List) encodeType(enc *rdb.Encoder) error {
-	t := rdb.ValueType(rdbTypeList)
-	return errors.Trace(enc.EncodeType(t))
+func (o List) encodeType(enc *encoder) error {
+	return errors.Trace(enc.encodeType(rdbTypeList))
 }
 
-func (o List) encodeValue(enc *rdb.Encoder) error {
-	if err := enc.EncodeLength(uint32(len(o))); err != nil {
+func (o List) encodeValue(enc *encoder) error {
+	if err := enc.encodeLength(uint32(len(o))); err != nil {
 		return errors.Trace(err)
 	}
 	for _, e := range o {
-		if err := enc.EncodeString(e); err != nil {
+		if err := enc.encodeString(e); err != nil {
 			return errors.Trace(err)
 		}
 	}
 	return nil
 }
 
-func (o ZSet) encodeType(enc *rdb.Encoder) error {
-	t := rdb.ValueType(rdbTypeZSet)
-	return errors.Trace(enc.EncodeType(t))
+func (o ZSet) encodeType(enc *encoder) error {
+	return errors.Trace(enc.encodeType(rdbTypeZSet))
 }
 
-func (o ZSet) encodeValue(enc *rdb.Encoder) error {
-	if err := enc.EncodeLength(uint32(len(o))); err != nil {
+func (o ZSet) encodeValue(enc *encoder) error {
+	if err := enc.encodeLength(uint32(len(o))); err != nil {
 		return errors.Trace(err)
 	}
 	for _, e := range o {
-		if err := enc.EncodeString(e.Member); err != nil {
+		if err := enc.encodeString(e.Member); err != nil {
+			return errors.Trace(err)
+		}
+		if err := enc.encodeFloat(e.Score); err != nil {
+			return errors.Trace(err)
+		}
+	}
+	return nil
+}
+
+func (o *PackedHash) encodeType(enc *encoder) error {
+	return errors.Trace(enc.encodeType(rdbTypeHash))
+}
+
+func (o *PackedHash) encodeValue(enc *encoder) error {
+	n := o.Len()
+	if err := enc.encodeLength(uint32(n)); err != nil {
+		return errors.Trace(err)
+	}
+	for i := 0; i < n; i++ {
+		if err := enc.encodeString(o.Field(i)); err != nil {
+			return errors.Trace(err)
+		}
+		if err := enc.encodeString(o.Value(i)); err != nil {
+			return errors.Trace(err)
+		}
+	}
+	return nil
+}
+
+func (o *PackedZSet) encodeType(enc *encoder) error {
+	return errors.Trace(enc.encodeType(rdbTypeZSet))
+}
+
+func (o *PackedZSet) encodeValue(enc *encoder) error {
+	n := o.Len()
+	if err := enc.encodeLength(uint32(n)); err != nil {
+		return errors.Trace(err)
+	}
+	for i := 0; i < n; i++ {
+		if err := enc.encodeString(o.Member(i)); err != nil {
 			return errors.Trace(err)
 		}
-		if err := enc.EncodeFloat(e.Score); err != nil {
+		if err := enc.encodeFloat(o.Score(i)); err != nil {
 			return errors.Trace(err)
 		}
 	}
 	return nil
 }
 
-func (o Set) encodeType(enc *rdb.Encoder) error {
-	t := rdb.ValueType(rdbTypeSet)
-	return errors.Trace(enc.EncodeType(t))
+func (o Set) encodeType(enc *encoder) error {
+	return errors.Trace(enc.encodeType(rdbTypeSet))
 }
 
-func (o Set) encodeValue(enc *rdb.Encoder) error {
-	if err := enc.EncodeLength(uint32(len(o))); err != nil {
+func (o Set) encodeValue(enc *encoder) error {
+	if err := enc.encodeLength(uint32(len(o))); err != nil {
 		return errors.Trace(err)
 	}
 	for _, e := range o {
-		if err := enc.EncodeString(e); err != nil {
+		if err := enc.encodeString(e); err != nil {
 			return errors.Trace(err)
 		}
 	}
@@ -107,64 +312,172 @@ func EncodeDump(obj interface{}) ([]byte, error) {
 	if !ok {
 		return nil, errors.Errorf("unsupported object type")
 	}
-	var b bytes.Buffer
-	enc := rdb.NewEncoder(&b)
+	enc := &encoder{}
 	if err := o.encodeType(enc); err != nil {
 		return nil, err
 	}
 	if err := o.encodeValue(enc); err != nil {
 		return nil, err
 	}
-	if err := enc.EncodeDumpFooter(); err != nil {
-		return nil, errors.Trace(err)
-	}
-	return b.Bytes(), nil
+	var footer [10]byte
+	binary.LittleEndian.PutUint16(footer[:], rdbVersion)
+	p := append(enc.buf, footer[:2]...)
+	binary.LittleEndian.PutUint64(footer[2:], digest.Update(0, p))
+	return append(p, footer[2:]...), nil
 }
 
 type Encoder struct {
-	enc *rdb.Encoder
+	enc encoder
+	w   *crcWriter
 	db  int64
+
+	// version is that of the header, DUMP payloads can't be newer.
+	version int
+}
+
+// crcWriter sums up the bytes written to w.
+type crcWriter struct {
+	w   io.Writer
+	crc uint64
+	n   int64
+}
+
+func (c *crcWriter) Write(p []byte) (int, error) {
+	n, err := c.w.Write(p)
+	c.crc = digest.Update(c.crc, p[:n])
+	c.n += int64(n)
+	return n, err
 }
 
 func NewEncoder(w io.Writer) *Encoder {
-	return &Encoder{
-		enc: rdb.NewEncoder(w),
-		db:  -1,
+	e := &Encoder{w: &crcWriter{w: w}, db: -1, version: rdbVersion}
+	e.enc.w = e.w
+	return e
+}
+
+// Sum64 returns the checksum of the bytes written so far.
+func (e *Encoder) Sum64() uint64 {
+	return e.w.crc
+}
+
+// EncodeChunk appends p, the entries written by c with neither header nor
+// footer, e.g. by one of several encoders running in parallel. The checksum
+// of c is combined into e, instead of being computed again.
+func (e *Encoder) EncodeChunk(c *Encoder, p []byte) error {
+	if int64(len(p)) != c.w.n {
+		return errors.Errorf("invalid chunk, len = %d, written = %d", len(p), c.w.n)
+	}
+	if _, err := e.w.w.Write(p); err != nil {
+		return errors.Trace(err)
+	}
+	e.w.crc = digest.Combine(e.w.crc, c.w.crc, c.w.n)
+	e.w.n += c.w.n
+	if c.db != -1 {
+		e.db = c.db
 	}
+	return nil
 }
 
 func (e *Encoder) EncodeHeader() error {
-	return errors.Trace(e.enc.EncodeHeader())
+	return e.EncodeHeaderVersion(rdbVersion)
 }
 
-func (e *Encoder) EncodeFooter() error {
-	return errors.Trace(e.enc.EncodeFooter())
+// EncodeHeaderVersion writes the header of an rdb of the given version, e.g.
+// that of the DUMP payloads to be written by EncodeBinEntry.
+func (e *Encoder) EncodeHeaderVersion(version int) error {
+	if version < 1 || version > Version {
+		return errors.Errorf("invalid rdb version %d", version)
+	}
+	e.version = version
+	_, err := fmt.Fprintf(e.w, "REDIS%04d", version)
+	return errors.Trace(err)
 }
 
-func (e *Encoder) EncodeObject(db uint32, key []byte, expireat uint64, obj interface{}) error {
-	o, ok := obj.(objectEncoder)
-	if !ok {
-		return errors.Errorf("unsupported object type")
+// DumpVersion returns the rdb version of a DUMP payload. Payloads newer than
+// the loader understands are rejected.
+func DumpVersion(p []byte) (int, error) {
+	if len(p) < 11 {
+		return 0, errors.Errorf("invalid dump payload, len = %d", len(p))
+	}
+	v := int(binary.LittleEndian.Uint16(p[len(p)-10:]))
+	if v > Version {
+		return v, errors.Errorf("dump payload of rdb version %d is newer than %d", v, Version)
+	}
+	return v, nil
+}
+
+func (e *Encoder) EncodeFooter() error {
+	if _, err := e.w.Write([]byte{rdbFlagEOF}); err != nil {
+		return errors.Trace(err)
 	}
+	return errors.Trace(binary.Write(e.w, binary.LittleEndian, e.w.crc))
+}
+
+func (e *Encoder) encodeKeyHeader(db uint32, expireat uint64) error {
 	if e.db == -1 || uint32(e.db) != db {
 		e.db = int64(db)
-		if err := e.enc.EncodeDatabase(int(db)); err != nil {
+		if err := e.enc.encodeDatabase(db); err != nil {
 			return errors.Trace(err)
 		}
 	}
 	if expireat != 0 {
-		if err := e.enc.EncodeExpiry(expireat); err != nil {
+		if err := e.enc.encodeExpiry(expireat); err != nil {
 			return errors.Trace(err)
 		}
 	}
-	if err := o.encodeType(e.enc); err != nil {
+	return nil
+}
+
+func (e *Encoder) EncodeObject(db uint32, key []byte, expireat uint64, obj interface{}) error {
+	o, ok := obj.(objectEncoder)
+	if !ok {
+		return errors.Errorf("unsupported object type")
+	}
+	if err := e.encodeKeyHeader(db, expireat); err != nil {
+		return err
+	}
+	if err := o.encodeType(&e.enc); err != nil {
 		return err
 	}
-	if err := e.enc.EncodeString(key); err != nil {
+	if err := e.enc.encodeString(key); err != nil {
 		return errors.Trace(err)
 	}
-	if err := o.encodeValue(e.enc); err != nil {
+	if err := o.encodeValue(&e.enc); err != nil {
 		return err
 	}
-	return nil
+	return errors.Trace(e.enc.flush())
+}
+
+// EncodeBinEntry writes an entry whose value is a DUMP payload as it is, the
+// checksum of the payload is verified and its footer is dropped. Payloads of
+// a newer rdb version than the header are rejected, as they may hold types or
+// encodings a loader of that version does not know.
+func (e *Encoder) EncodeBinEntry(entry *BinEntry) error {
+	p := entry.Value
+	if len(p) < 11 {
+		return errors.Errorf("invalid dump payload, len = %d", len(p))
+	}
+	c := digest.New()
+	c.Write(p[:len(p)-8])
+	if c.Sum64() != binary.LittleEndian.Uint64(p[len(p)-8:]) {
+		return errors.Errorf("invalid dump payload, checksum validation failed")
+	}
+	if v, err := DumpVersion(p); err != nil {
+		return err
+	} else if v > e.version {
+		return errors.Errorf("dump payload of rdb version %d is newer than the header, %d", v, e.version)
+	}
+	if err := e.encodeKeyHeader(entry.DB, entry.ExpireAt); err != nil {
+		return err
+	}
+	if err := e.enc.encodeType(p[0]); err != nil {
+		return errors.Trace(err)
+	}
+	if err := e.enc.encodeString(entry.Key); err != nil {
+		return errors.Trace(err)
+	}
+	if err := e.enc.write(p[1 : len(p)-10]); err != nil {
+		return errors.Trace(err)
+	}
+	return errors.Trace(e.enc.flush())
 }
@@ -5,15 +5,18 @@ package rdb
 
 import (
 	"bytes"
+	"encoding/binary"
 	"fmt"
 	"math"
 	"math/rand"
+	"sort"
 	"strconv"
 	"testing"
 
 	"github.com/CodisLabs/codis/pkg/utils/assert"
 	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
 	"github.com/CodisLabs/redis-port/pkg/libs/stats"
+	"github.com/CodisLabs/redis-port/pkg/rdb/digest"
 )
 
 func toString(text string) String {
@@ -45,6 +48,17 @@ func TestEncodeString(t *testing.T) {
 	docheck(b.String())
 }
 
+func TestParseInt32(t *testing.T) {
+	for _, s := range []string{"", "0", "-0", "00", "01", "-01", "1", "-1", "+1", " 1", "1 ", "-", "1a",
+		"2147483647", "2147483648", "-2147483648", "-2147483649", "99999999999", "-99999999999"} {
+		n, err := strconv.ParseInt(s, 10, 32)
+		expect := err == nil && strconv.FormatInt(n, 10) == s
+		i, ok := parseInt32([]byte(s))
+		assert.Must(ok == expect)
+		assert.Must(!ok || int64(i) == n)
+	}
+}
+
 func toList(list ...string) List {
 	o := List{}
 	for _, e := range list {
@@ -160,6 +174,69 @@ func TestEncodeZSet(t *testing.T) {
 	docheck(zset)
 }
 
+func TestEncodePackedHash(t *testing.T) {
+	hash := make(map[string]string)
+	for i := 0; i < 65536; i++ {
+		hash[strconv.Itoa(i)] = strconv.Itoa(i + 1)
+	}
+	p, err := EncodeDump(toHash(hash))
+	assert.MustNoError(err)
+	o, err := DecodeDumpPacked(p)
+	assert.MustNoError(err)
+	x, ok := o.(*PackedHash)
+	assert.Must(ok && x.Len() == len(hash))
+	sort.Sort(PackedHSortByField{x})
+	for i := 0; i < x.Len(); i++ {
+		assert.Must(hash[string(x.Field(i))] == string(x.Value(i)))
+		if i != 0 {
+			assert.Must(bytes.Compare(x.Field(i-1), x.Field(i)) < 0)
+		}
+	}
+	p, err = EncodeDump(x)
+	assert.MustNoError(err)
+	o, err = DecodeDump(p)
+	assert.MustNoError(err)
+	checkHash(t, o, hash)
+}
+
+func TestPackedPrealloc(t *testing.T) {
+	h := NewPackedHash(1<<40, 100)
+	assert.Must(cap(h.offs) == 50*3 && cap(h.buf) == 100)
+	z := NewPackedZSet(10, 100)
+	assert.Must(cap(z.offs) == 10*2 && cap(z.scores) == 10 && cap(z.buf) == 100)
+	z = NewPackedZSet(-1, -1)
+	assert.Must(cap(z.offs) == 0 && cap(z.buf) == 0)
+}
+
+func TestEncodePackedZSet(t *testing.T) {
+	zset := make(map[string]float64)
+	for i := -65535; i < 65536; i++ {
+		zset[strconv.Itoa(i)] = float64(i)
+	}
+	p, err := EncodeDump(toZSet(zset))
+	assert.MustNoError(err)
+	o, err := DecodeDumpPacked(p)
+	assert.MustNoError(err)
+	x, ok := o.(*PackedZSet)
+	assert.Must(ok && x.Len() == len(zset))
+	sort.Sort(PackedZSortByScore{x})
+	for i := 0; i < x.Len(); i++ {
+		assert.Must(zset[string(x.Member(i))] == x.Score(i))
+		if i != 0 {
+			assert.Must(x.Score(i-1) < x.Score(i))
+		}
+	}
+	sort.Sort(PackedZSortByMember{x})
+	for i := 1; i < x.Len(); i++ {
+		assert.Must(bytes.Compare(x.Member(i-1), x.Member(i)) < 0)
+	}
+	p, err = EncodeDump(x)
+	assert.MustNoError(err)
+	o, err = DecodeDump(p)
+	assert.MustNoError(err)
+	checkZSet(t, o, zset)
+}
+
 func toSet(set ...string) Set {
 	o := Set{}
 	for _, e := range set {
@@ -291,3 +368,108 @@ func TestEncodeRdb(t *testing.T) {
 	assert.MustNoError(l.Footer())
 	assert.Must(c.Get() == int64(len(rdb)))
 }
+
+func TestEncodeBinEntry(t *testing.T) {
+	var b bytes.Buffer
+	enc := NewEncoder(&b)
+	assert.MustNoError(enc.EncodeHeader())
+	for i := 0; i < 128; i++ {
+		p, err := EncodeDump(toList("a", strconv.Itoa(i)))
+		assert.MustNoError(err)
+		e := &BinEntry{DB: uint32(i / 32), Key: []byte(strconv.Itoa(i)), Value: p, ExpireAt: uint64(i)}
+		assert.MustNoError(enc.EncodeBinEntry(e))
+	}
+	p, err := EncodeDump(toString("x"))
+	assert.MustNoError(err)
+	p[len(p)-1]++
+	assert.Must(enc.EncodeBinEntry(&BinEntry{Key: []byte("x"), Value: p}) != nil)
+	p = dumpOfVersion(toString("x"), rdbVersion+1)
+	assert.Must(enc.EncodeBinEntry(&BinEntry{Key: []byte("x"), Value: p}) != nil)
+	assert.MustNoError(enc.EncodeFooter())
+
+	l := NewLoader(bytes.NewReader(b.Bytes()))
+	assert.MustNoError(l.Header())
+	for i := 0; i < 128; i++ {
+		e, err := l.NextBinEntry()
+		assert.MustNoError(err)
+		assert.Must(e.DB == uint32(i/32) && e.ExpireAt == uint64(i))
+		assert.Must(string(e.Key) == strconv.Itoa(i))
+		o, err := DecodeDump(e.Value)
+		assert.MustNoError(err)
+		checkList(t, o, []string{"a", strconv.Itoa(i)})
+	}
+	e, err := l.NextBinEntry()
+	assert.MustNoError(err)
+	assert.Must(e == nil)
+	assert.MustNoError(l.Footer())
+}
+
+// dumpOfVersion returns a DUMP payload of obj that claims rdb version v.
+func dumpOfVersion(obj interface{}, v int) []byte {
+	p, err := EncodeDump(obj)
+	assert.MustNoError(err)
+	binary.LittleEndian.PutUint16(p[len(p)-10:], uint16(v))
+	binary.LittleEndian.PutUint64(p[len(p)-8:], digest.Update(0, p[:len(p)-8]))
+	return p
+}
+
+func TestEncodeBinEntryVersion(t *testing.T) {
+	p := dumpOfVersion(toString("x"), Version)
+	v, err := DumpVersion(p)
+	assert.Must(err == nil && v == Version)
+	_, err = DumpVersion(dumpOfVersion(toString("x"), Version+1))
+	assert.Must(err != nil)
+
+	var b bytes.Buffer
+	enc := NewEncoder(&b)
+	assert.Must(enc.EncodeHeaderVersion(Version+1) != nil)
+	assert.MustNoError(enc.EncodeHeaderVersion(Version))
+	assert.MustNoError(enc.EncodeBinEntry(&BinEntry{Key: []byte("x"), Value: p}))
+	assert.Must(enc.EncodeBinEntry(&BinEntry{Key: []byte("y"), Value: dumpOfVersion(toString("y"), Version+1)}) != nil)
+	assert.MustNoError(enc.EncodeFooter())
+	assert.Must(bytes.HasPrefix(b.Bytes(), []byte(fmt.Sprintf("REDIS%04d", Version))))
+
+	l := NewLoader(bytes.NewReader(b.Bytes()))
+	assert.MustNoError(l.Header())
+	e, err := l.NextBinEntry()
+	assert.Must(err == nil && string(e.Key) == "x")
+	e, err = l.NextBinEntry()
+	assert.Must(err == nil && e == nil)
+	assert.MustNoError(l.Footer())
+
+	enc = NewEncoder(&b)
+	assert.MustNoError(enc.EncodeHeader())
+	assert.Must(enc.EncodeBinEntry(&BinEntry{Key: []byte("x"), Value: p}) != nil)
+}
+
+func TestEncodeChunk(t *testing.T) {
+	var b bytes.Buffer
+	out := NewEncoder(&b)
+	assert.MustNoError(out.EncodeHeader())
+	for i := 0; i < 4; i++ {
+		var p bytes.Buffer
+		c := NewEncoder(&p)
+		for j := 0; j < 10; j++ {
+			key := []byte(fmt.Sprintf("key_%d_%d", i, j))
+			assert.MustNoError(c.EncodeObject(uint32(i/2), key, 0, toString(strconv.Itoa(i*j))))
+		}
+		assert.MustNoError(out.EncodeChunk(c, p.Bytes()))
+		assert.Must(out.Sum64() == digest.Update(0, b.Bytes()))
+	}
+	assert.MustNoError(out.EncodeFooter())
+
+	l := NewLoader(bytes.NewReader(b.Bytes()))
+	assert.MustNoError(l.Header())
+	var n int
+	for {
+		e, err := l.NextBinEntry()
+		assert.MustNoError(err)
+		if e == nil {
+			break
+		}
+		assert.Must(e.DB == uint32(n/20))
+		n++
+	}
+	assert.Must(n == 40)
+	assert.MustNoError(l.Footer())
+}
@@ -0,0 +1,103 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package rdb
+
+const (
+	InternMaxEntries = 1024 * 4
+	InternMaxLength  = 64
+
+	internWindow   = 1024 * 64
+	internMinRatio = 0.5
+	internBackoff  = 16
+)
+
+type internEntry struct {
+	s string
+	b []byte
+}
+
+// Interner dedupes short, frequently repeated byte strings such as hash field
+// names. The table is bounded, and it turns itself off for a while when the
+// observed hit rate falls below internMinRatio. It is not goroutine-safe.
+type Interner struct {
+	m map[string]internEntry
+
+	lookup, hits int64
+	bypass       int64
+
+	Stats struct {
+		Lookup, Hits, Disabled int64
+	}
+}
+
+func NewInterner() *Interner {
+	return &Interner{m: make(map[string]internEntry)}
+}
+
+func (in *Interner) find(b []byte) (internEntry, bool) {
+	if in == nil || len(b) > InternMaxLength {
+		return internEntry{}, false
+	}
+	if in.bypass != 0 {
+		if in.bypass--; in.bypass == 0 {
+			in.m = make(map[string]internEntry)
+		}
+		return internEntry{}, false
+	}
+	in.lookup++
+	in.Stats.Lookup++
+	e, ok := in.m[string(b)]
+	if ok {
+		in.hits++
+		in.Stats.Hits++
+	} else if len(in.m) < InternMaxEntries {
+		s := string(b)
+		e = internEntry{s: s, b: []byte(s)[:len(s):len(s)]}
+		in.m[s] = e
+		ok = true
+	}
+	if in.lookup == internWindow {
+		if float64(in.hits) < float64(in.lookup)*internMinRatio {
+			in.m, in.bypass = nil, internWindow*internBackoff
+			in.Stats.Disabled++
+		}
+		in.lookup, in.hits = 0, 0
+	}
+	return e, ok
+}
+
+// Bytes returns the interned copy of b, or b itself. An interned copy is
+// shared and must be treated as read-only, its capacity is capped so that
+// append never writes into it.
+func (in *Interner) Bytes(b []byte) []byte {
+	if e, ok := in.find(b); ok {
+		return e.b
+	}
+	return b
+}
+
+func (in *Interner) String(b []byte) string {
+	if e, ok := in.find(b); ok {
+		return e.s
+	}
+	return string(b)
+}
+
+// Lookup returns the string of b, b being a slice returned by Bytes. Interned
+// slices are converted without allocating and without counting a lookup.
+func (in *Interner) Lookup(b []byte) string {
+	if in != nil && in.m != nil {
+		if e, ok := in.m[string(b)]; ok {
+			return e.s
+		}
+	}
+	return string(b)
+}
+
+func (in *Interner) HitRatio() float64 {
+	if in == nil || in.Stats.Lookup == 0 {
+		return 0
+	}
+	return float64(in.Stats.Hits) / float64(in.Stats.Lookup)
+}
@@ -76,6 +76,19 @@ func (e *BinEntry) ObjEntry() (*ObjEntry, error) {
 	}, nil
 }
 
+func (e *BinEntry) PackedObjEntry() (*ObjEntry, error) {
+	x, err := DecodeDumpPacked(e.Value)
+	if err != nil {
+		return nil, err
+	}
+	return &ObjEntry{
+		DB:       e.DB,
+		Key:      e.Key,
+		Value:    x,
+		ExpireAt: e.ExpireAt,
+	}, nil
+}
+
 type ObjEntry struct {
 	DB       uint32
 	Key      []byte
@@ -0,0 +1,406 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package redis
+
+import (
+	"bufio"
+	"bytes"
+	"io"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+)
+
+const (
+	MaxArrayLen     = 1024 * 1024
+	MaxBulkBytesLen = 1024 * 1024 * 512
+
+	maxScratchSize = 1024 * 1024 * 64
+)
+
+var (
+	ErrBadRespInt       = errors.New("bad resp int")
+	ErrEmptyCommand     = errors.New("empty command")
+	ErrBadCommandFormat = errors.New("bad command format, expect array of bulkbytes")
+	ErrRequestTooLarge  = errors.New("request is too large")
+)
+
+// Command is a request decoded by CommandDecoder. Args[0] is the command name
+// and Raw holds the encoded request. Both borrow from the decoder and are only
+// valid until the next call to Decode. Argc is the number of arguments in the
+// request, which may be more than len(Args) for a framer.
+type Command struct {
+	Args [][]byte
+	Raw  []byte
+	Argc int
+}
+
+// Is reports whether the command name equals name, ignoring ASCII case.
+// name is expected to be in lower case.
+func (c *Command) Is(name string) bool {
+	if len(c.Args) == 0 || len(c.Args[0]) != len(name) {
+		return false
+	}
+	for i, b := range c.Args[0] {
+		if b >= 'A' && b <= 'Z' {
+			b += 'a' - 'A'
+		}
+		if b != name[i] {
+			return false
+		}
+	}
+	return true
+}
+
+// IsInline reports whether the request was sent in the inline format.
+func (c *Command) IsInline() bool {
+	return len(c.Raw) != 0 && c.Raw[0] != byte(typeArray)
+}
+
+// CommandDecoder parses requests straight into a reused argument vector.
+// Requests that fit in the bufio.Reader are sliced from its buffer in place,
+// larger ones are copied into a scratch buffer owned by the decoder.
+type CommandDecoder struct {
+	r   *bufio.Reader
+	cmd Command
+
+	buf []byte
+	pos []int
+
+	maxArgs int
+	maxSize int
+}
+
+func NewCommandDecoder(r *bufio.Reader) *CommandDecoder {
+	return &CommandDecoder{r: r, maxArgs: MaxArrayLen}
+}
+
+// NewCommandFramer returns a decoder that only finds request boundaries. It
+// keeps at most the first n arguments of '*N' requests in Args, and callers
+// are expected to forward Raw as it is. Inline requests are always split in
+// full, so that they can be re-encoded.
+func NewCommandFramer(r *bufio.Reader, n int) *CommandDecoder {
+	if n < 1 {
+		n = 1
+	}
+	return &CommandDecoder{r: r, maxArgs: n}
+}
+
+// SetMaxRequestSize makes Decode fail with ErrRequestTooLarge as soon as a
+// request is known to be larger than n bytes, 0 means no limit.
+func (d *CommandDecoder) SetMaxRequestSize(n int) {
+	d.maxSize = n
+}
+
+func (d *CommandDecoder) checkSize(n int) error {
+	if d.maxSize != 0 && n > d.maxSize {
+		return errors.Trace(ErrRequestTooLarge)
+	}
+	return nil
+}
+
+func (d *CommandDecoder) appendArg(b []byte) {
+	if len(d.cmd.Args) < d.maxArgs {
+		d.cmd.Args = append(d.cmd.Args, b)
+	}
+}
+
+func (d *CommandDecoder) Decode() (*Command, error) {
+	d.cmd.Args, d.cmd.Raw = d.cmd.Args[:0], nil
+	if cap(d.buf) > maxScratchSize {
+		d.buf = nil
+	}
+	need := 1
+	for {
+		if _, err := d.r.Peek(need); err != nil {
+			if err == bufio.ErrBufferFull {
+				return d.decodeSlow()
+			}
+			return nil, errors.Trace(err)
+		}
+		p, _ := d.r.Peek(d.r.Buffered())
+		n, more, err := d.parse(p)
+		if err != nil {
+			return nil, err
+		}
+		if n != 0 {
+			return d.commit(p, n)
+		}
+		need = len(p) + more
+	}
+}
+
+// TryDecode is like Decode, but returns nil instead of blocking when the
+// buffered bytes don't hold a complete request.
+func (d *CommandDecoder) TryDecode() (*Command, error) {
+	if d.r.Buffered() == 0 {
+		return nil, nil
+	}
+	p, _ := d.r.Peek(d.r.Buffered())
+	n, _, err := d.parse(p)
+	if err != nil || n == 0 {
+		return nil, err
+	}
+	return d.commit(p, n)
+}
+
+func (d *CommandDecoder) commit(p []byte, n int) (*Command, error) {
+	d.cmd.Raw = p[:n:n]
+	if _, err := d.r.Discard(n); err != nil {
+		return nil, errors.Trace(err)
+	}
+	return &d.cmd, nil
+}
+
+func (d *CommandDecoder) MustDecode() *Command {
+	cmd, err := d.Decode()
+	if err != nil {
+		log.PanicError(err, "decode redis command failed")
+	}
+	return cmd
+}
+
+func parseInt(p []byte) (int64, error) {
+	var neg bool
+	if len(p) != 0 && p[0] == '-' {
+		neg, p = true, p[1:]
+	}
+	if len(p) == 0 || len(p) > 18 {
+		return 0, errors.Trace(ErrBadRespInt)
+	}
+	var n int64
+	for _, b := range p {
+		if b < '0' || b > '9' {
+			return 0, errors.Trace(ErrBadRespInt)
+		}
+		n = n*10 + int64(b-'0')
+	}
+	if neg {
+		return -n, nil
+	}
+	return n, nil
+}
+
+// parseLine returns the content of the line starting at p[i], and the offset
+// just after its CRLF, or -1 if the line is incomplete.
+func parseLine(p []byte, i int) ([]byte, int, error) {
+	j := bytes.IndexByte(p[i:], '\n')
+	if j < 0 {
+		return nil, -1, nil
+	}
+	j += i
+	if j == i || p[j-1] != '\r' {
+		return nil, 0, errors.Trace(ErrBadRespCRLFEnd)
+	}
+	return p[i : j-1], j + 1, nil
+}
+
+func checkArrayLen(n int64) (int, error) {
+	switch {
+	case n < -1 || n > MaxArrayLen:
+		return 0, errors.Trace(ErrBadRespArrayLen)
+	case n <= 0:
+		return 0, errors.Trace(ErrEmptyCommand)
+	}
+	return int(n), nil
+}
+
+func checkBulkBytesLen(n int64) (int, error) {
+	if n < -1 || n > MaxBulkBytesLen {
+		return 0, errors.Trace(ErrBadRespBytesLen)
+	}
+	return int(n), nil
+}
+
+// parse tries to decode one request from p. It returns the size of the
+// request, or 0 and a lower bound of missing bytes if p is incomplete.
+func (d *CommandDecoder) parse(p []byte) (int, int, error) {
+	d.cmd.Args = d.cmd.Args[:0]
+	if p[0] != byte(typeArray) {
+		return d.parseInline(p)
+	}
+	line, i, err := parseLine(p, 1)
+	if err != nil || i < 0 {
+		return 0, 1, err
+	}
+	x, err := parseInt(line)
+	if err != nil {
+		return 0, 0, err
+	}
+	n, err := checkArrayLen(x)
+	if err != nil {
+		return 0, 0, err
+	}
+	d.cmd.Argc = n
+	for k := 0; k < n; k++ {
+		if i >= len(p) {
+			return 0, 1, nil
+		}
+		if p[i] != byte(typeBulkBytes) {
+			return 0, 0, errors.Trace(ErrBadCommandFormat)
+		}
+		line, j, err := parseLine(p, i+1)
+		if err != nil || j < 0 {
+			return 0, 1, err
+		}
+		x, err := parseInt(line)
+		if err != nil {
+			return 0, 0, err
+		}
+		l, err := checkBulkBytesLen(x)
+		if err != nil {
+			return 0, 0, err
+		}
+		if l < 0 {
+			d.appendArg(nil)
+			i = j
+			continue
+		}
+		if err := d.checkSize(j + l + 2); err != nil {
+			return 0, 0, err
+		}
+		if end := j + l + 2; end > len(p) {
+			return 0, end - len(p), nil
+		}
+		if p[j+l] != '\r' || p[j+l+1] != '\n' {
+			return 0, 0, errors.Trace(ErrBadRespCRLFEnd)
+		}
+		d.appendArg(p[j : j+l : j+l])
+		i = j + l + 2
+	}
+	if len(d.cmd.Args[0]) == 0 {
+		return 0, 0, errors.Trace(ErrEmptyCommand)
+	}
+	return i, 0, nil
+}
+
+func (d *CommandDecoder) parseInline(p []byte) (int, int, error) {
+	j := bytes.IndexByte(p, '\n')
+	if j < 0 {
+		return 0, 1, d.checkSize(len(p))
+	}
+	if err := d.checkSize(j + 1); err != nil {
+		return 0, 0, err
+	}
+	if j == 0 || p[j-1] != '\r' {
+		return 0, 0, errors.Trace(ErrBadRespCRLFEnd)
+	}
+	d.cmd.Args = splitInline(d.cmd.Args, p[:j-1])
+	if len(d.cmd.Args) == 0 {
+		return 0, 0, errors.Trace(ErrEmptyCommand)
+	}
+	d.cmd.Argc = len(d.cmd.Args)
+	return j + 1, 0, nil
+}
+
+func splitInline(args [][]byte, b []byte) [][]byte {
+	for l, r := 0, 0; r <= len(b); r++ {
+		if r == len(b) || b[r] == ' ' {
+			if l < r {
+				args = append(args, b[l:r:r])
+			}
+			l = r + 1
+		}
+	}
+	return args
+}
+
+// decodeSlow copies a request that doesn't fit in the bufio.Reader into the
+// scratch buffer, recording argument offsets since the buffer may grow.
+func (d *CommandDecoder) decodeSlow() (*Command, error) {
+	d.cmd.Args, d.buf, d.pos = d.cmd.Args[:0], d.buf[:0], d.pos[:0]
+	beg, end, err := d.readLine()
+	if err != nil {
+		return nil, err
+	}
+	if d.buf[beg] != byte(typeArray) {
+		d.cmd.Args = splitInline(d.cmd.Args, d.buf[beg:end])
+		if len(d.cmd.Args) == 0 {
+			return nil, errors.Trace(ErrEmptyCommand)
+		}
+		d.cmd.Argc = len(d.cmd.Args)
+		d.cmd.Raw = d.buf
+		return &d.cmd, nil
+	}
+	x, err := parseInt(d.buf[beg+1 : end])
+	if err != nil {
+		return nil, err
+	}
+	n, err := checkArrayLen(x)
+	if err != nil {
+		return nil, err
+	}
+	d.cmd.Argc = n
+	for k := 0; k < n; k++ {
+		beg, end, err := d.readLine()
+		if err != nil {
+			return nil, err
+		}
+		if d.buf[beg] != byte(typeBulkBytes) {
+			return nil, errors.Trace(ErrBadCommandFormat)
+		}
+		x, err := parseInt(d.buf[beg+1 : end])
+		if err != nil {
+			return nil, err
+		}
+		l, err := checkBulkBytesLen(x)
+		if err != nil {
+			return nil, err
+		}
+		if l < 0 {
+			if len(d.pos) < d.maxArgs*2 {
+				d.pos = append(d.pos, -1, -1)
+			}
+			continue
+		}
+		i := len(d.buf)
+		if err := d.checkSize(i + l + 2); err != nil {
+			return nil, err
+		}
+		d.buf = append(d.buf, make([]byte, l+2)...)
+		if _, err := io.ReadFull(d.r, d.buf[i:]); err != nil {
+			return nil, errors.Trace(err)
+		}
+		if d.buf[i+l] != '\r' || d.buf[i+l+1] != '\n' {
+			return nil, errors.Trace(ErrBadRespCRLFEnd)
+		}
+		if len(d.pos) < d.maxArgs*2 {
+			d.pos = append(d.pos, i, i+l)
+		}
+	}
+	for k := 0; k < len(d.pos); k += 2 {
+		if d.pos[k] < 0 {
+			d.cmd.Args = append(d.cmd.Args, nil)
+		} else {
+			d.cmd.Args = append(d.cmd.Args, d.buf[d.pos[k]:d.pos[k+1]:d.pos[k+1]])
+		}
+	}
+	if len(d.cmd.Args[0]) == 0 {
+		return nil, errors.Trace(ErrEmptyCommand)
+	}
+	d.cmd.Raw = d.buf
+	return &d.cmd, nil
+}
+
+func (d *CommandDecoder) readLine() (int, int, error) {
+	beg := len(d.buf)
+	for {
+		b, err := d.r.ReadSlice('\n')
+		d.buf = append(d.buf, b...)
+		if err := d.checkSize(len(d.buf)); err != nil {
+			return 0, 0, err
+		}
+		if err == nil {
+			break
+		}
+		if err != bufio.ErrBufferFull {
+			return 0, 0, errors.Trace(err)
+		}
+	}
+	end := len(d.buf) - 2
+	if end < beg || d.buf[end] != '\r' {
+		return 0, 0, errors.Trace(ErrBadRespCRLFEnd)
+	}
+	return beg, end, nil
+}
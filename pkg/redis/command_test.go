@@ -0,0 +1,221 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package redis
+
+import (
+	"bufio"
+	"bytes"
+	"io/ioutil"
+	"strconv"
+	"strings"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+)
+
+func testDecodeCommand(t *testing.T, s string, size int) {
+	d := NewCommandDecoder(bufio.NewReaderSize(strings.NewReader(s), size))
+	c, err := d.Decode()
+	assert.MustNoError(err)
+	resp, err := DecodeFromBytes([]byte(s))
+	assert.MustNoError(err)
+	cmd, args, err := ParseArgs(resp)
+	assert.MustNoError(err)
+	assert.Must(c.Is(cmd))
+	assert.Must(len(c.Args) == len(args)+1)
+	for i, arg := range args {
+		assert.Must(bytes.Equal(c.Args[i+1], arg) && (c.Args[i+1] == nil) == (arg == nil))
+	}
+	if s[0] == '*' {
+		assert.Must(string(c.Raw) == s)
+	}
+}
+
+func TestDecodeCommand(t *testing.T) {
+	test := []string{
+		"*1\r\n$4\r\nPING\r\n",
+		"*2\r\n$6\r\nSELECT\r\n$2\r\n15\r\n",
+		"*3\r\n$3\r\nset\r\n$3\r\nfoo\r\n$0\r\n\r\n",
+		"*3\r\n$3\r\nset\r\n$3\r\nfoo\r\n$-1\r\n",
+		"*3\r\n$4\r\nEVAL\r\n$31\r\nreturn {1,2,{3,'Hello World!'}}\r\n$1\r\n0\r\n",
+		"hello world\r\n",
+		"    hello     world    \r\n",
+		"*2\r\n$3\r\nset\r\n$64\r\n" + strings.Repeat("x", 64) + "\r\n",
+	}
+	for _, s := range test {
+		testDecodeCommand(t, s, 4096)
+		testDecodeCommand(t, s, 16)
+	}
+}
+
+func TestDecodeCommandPipeline(t *testing.T) {
+	var b bytes.Buffer
+	for i := 0; i < 1024; i++ {
+		b.WriteString("*3\r\n$3\r\nset\r\n$3\r\nkey\r\n$")
+		b.WriteString(strconv.Itoa(i))
+		b.WriteString("\r\n")
+		b.WriteString(strings.Repeat("v", i))
+		b.WriteString("\r\n")
+	}
+	d := NewCommandDecoder(bufio.NewReaderSize(&b, 256))
+	for i := 0; i < 1024; i++ {
+		c, err := d.Decode()
+		assert.MustNoError(err)
+		assert.Must(c.Is("set") && len(c.Args) == 3)
+		assert.Must(string(c.Args[2]) == strings.Repeat("v", i))
+	}
+	_, err := d.Decode()
+	assert.Must(err != nil)
+}
+
+func TestDecodeInvalidCommands(t *testing.T) {
+	test := []string{
+		"*hello\r\n",
+		"*-100\r\n",
+		"*0\r\n",
+		"*-1\r\n",
+		"*3\r\nhi",
+		"*4\r\n$1",
+		"*4\r\n$1\n",
+		"*2\r\n$3\r\nget\r\n$what?\r\nx\r\n",
+		"*2\r\n$3\r\nget\r\n$1\r\nx",
+		"*2\r\n$3\r\nget\r\n$100\r\nx\r\n",
+		"*2\r\n$3\r\nget\r\n:1\r\n",
+		"*1\r\n$0\r\n\r\n",
+		"*2n$3\r\nfoo\r\n$3\r\nbar\r\n",
+		"\r\n",
+		"\n",
+		" \n",
+	}
+	for _, s := range test {
+		for _, size := range []int{16, 4096} {
+			d := NewCommandDecoder(bufio.NewReaderSize(strings.NewReader(s), size))
+			_, err := d.Decode()
+			assert.Must(err != nil)
+		}
+	}
+}
+
+func TestDecodeMaxRequestSize(t *testing.T) {
+	long := MustEncodeToBytes(NewCommand("set", "key", strings.Repeat("x", 100)))
+	test := []string{
+		string(long),
+		"set key " + strings.Repeat("x", 100) + "\r\n",
+	}
+	for _, s := range test {
+		for _, size := range []int{16, 4096} {
+			d := NewCommandDecoder(bufio.NewReaderSize(strings.NewReader(s+s), size))
+			d.SetMaxRequestSize(len(s))
+			_, err := d.Decode()
+			assert.MustNoError(err)
+			d.SetMaxRequestSize(len(s) - 1)
+			_, err = d.Decode()
+			assert.Must(errors.Equal(err, ErrRequestTooLarge))
+		}
+	}
+}
+
+func TestCommandFramer(t *testing.T) {
+	s := "*2\r\n$6\r\nselect\r\n$1\r\n1\r\n*4\r\n$4\r\nHSET\r\n$1\r\nk\r\n$1\r\nf\r\n$-1\r\nhset k f v\r\n"
+	for _, size := range []int{16, 4096} {
+		d := NewCommandFramer(bufio.NewReaderSize(strings.NewReader(s), size), 2)
+		c, err := d.Decode()
+		assert.MustNoError(err)
+		assert.Must(c.Is("select") && len(c.Args) == 2 && string(c.Args[1]) == "1")
+		assert.Must(string(c.Raw) == "*2\r\n$6\r\nselect\r\n$1\r\n1\r\n")
+		c, err = d.Decode()
+		assert.MustNoError(err)
+		assert.Must(c.Is("hset") && len(c.Args) == 2 && !c.IsInline())
+		assert.Must(string(c.Raw) == "*4\r\n$4\r\nHSET\r\n$1\r\nk\r\n$1\r\nf\r\n$-1\r\n")
+		c, err = d.Decode()
+		assert.MustNoError(err)
+		assert.Must(c.Is("hset") && len(c.Args) == 4 && c.IsInline())
+	}
+}
+
+type loopReader struct {
+	p []byte
+	i int
+}
+
+func (r *loopReader) Read(b []byte) (int, error) {
+	n := copy(b, r.p[r.i:])
+	r.i = (r.i + n) % len(r.p)
+	return n, nil
+}
+
+var benchCommand = []byte("*4\r\n$4\r\nHSET\r\n$16\r\nuser:12345678:cc\r\n$5\r\nfield\r\n$32\r\n" +
+	strings.Repeat("v", 32) + "\r\n")
+
+func BenchmarkDecode(b *testing.B) {
+	r := bufio.NewReader(&loopReader{p: bytes.Repeat(benchCommand, 64)})
+	b.SetBytes(int64(len(benchCommand)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		resp, err := Decode(r)
+		if err != nil {
+			b.Fatal(err)
+		}
+		if _, _, err := ParseArgs(resp); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkParseArgs(b *testing.B) {
+	resp, err := DecodeFromBytes(benchCommand)
+	assert.MustNoError(err)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, _, err := ParseArgs(resp); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkCommandDecoder(b *testing.B) {
+	d := NewCommandDecoder(bufio.NewReader(&loopReader{p: bytes.Repeat(benchCommand, 64)}))
+	b.SetBytes(int64(len(benchCommand)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		c, err := d.Decode()
+		if err != nil {
+			b.Fatal(err)
+		}
+		if c.Is("select") {
+			b.Fatal("unexpected select")
+		}
+	}
+}
+
+func BenchmarkCommandFramer(b *testing.B) {
+	d := NewCommandFramer(bufio.NewReader(&loopReader{p: bytes.Repeat(benchCommand, 64)}), 2)
+	w := bufio.NewWriter(ioutil.Discard)
+	b.SetBytes(int64(len(benchCommand)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		c, err := d.Decode()
+		if err != nil {
+			b.Fatal(err)
+		}
+		w.Write(c.Raw)
+	}
+}
+
+func BenchmarkDecodeEncode(b *testing.B) {
+	r := bufio.NewReader(&loopReader{p: bytes.Repeat(benchCommand, 64)})
+	w := bufio.NewWriter(ioutil.Discard)
+	b.SetBytes(int64(len(benchCommand)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		resp, err := Decode(r)
+		if err != nil {
+			b.Fatal(err)
+		}
+		if err := Encode(w, resp, false); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
@@ -8,6 +8,7 @@ import (
 	"bytes"
 	"reflect"
 	"strconv"
+	"sync"
 
 	"github.com/CodisLabs/codis/pkg/utils/errors"
 	"github.com/CodisLabs/codis/pkg/utils/log"
@@ -15,29 +16,43 @@ import (
 
 type encoder struct {
 	w *bufio.Writer
+	v *Writer
 }
 
-var (
-	imap []string
-)
-
-func init() {
-	imap = make([]string, 1024*512+1024)
-	for i := 0; i < len(imap); i++ {
-		imap[i] = strconv.Itoa(i - 1024)
-	}
+// itab holds "<n>\r\n" for the small numbers that most lengths are, it is
+// built on first use.
+var itab struct {
+	sync.Once
+	s []string
 }
 
-func itos(i int64) string {
-	if n := i + 1024; n >= 0 && n < int64(len(imap)) {
-		return imap[n]
-	} else {
-		return strconv.FormatInt(i, 10)
+const itabSize = 1024
+
+func (e *encoder) encodeInt(v int64) error {
+	if v >= -1 && v < itabSize-1 {
+		itab.Do(func() {
+			itab.s = make([]string, itabSize)
+			for i := range itab.s {
+				itab.s[i] = strconv.Itoa(i-1) + "\r\n"
+			}
+		})
+		_, err := e.w.WriteString(itab.s[v+1])
+		return errors.Trace(err)
+	}
+	var b [24]byte
+	for _, c := range strconv.AppendInt(b[:0], v, 10) {
+		if err := e.w.WriteByte(c); err != nil {
+			return errors.Trace(err)
+		}
 	}
+	if _, err := e.w.WriteString("\r\n"); err != nil {
+		return errors.Trace(err)
+	}
+	return nil
 }
 
 func Encode(w *bufio.Writer, r Resp, flush bool) error {
-	e := &encoder{w}
+	e := &encoder{w: w}
 	if err := e.encodeResp(r); err != nil {
 		return err
 	}
@@ -53,6 +68,23 @@ func MustEncode(w *bufio.Writer, r Resp) {
 	}
 }
 
+func EncodeArgs(w *bufio.Writer, args [][]byte, flush bool) error {
+	e := &encoder{w: w}
+	if err := e.encodeArgs(args); err != nil {
+		return err
+	}
+	if !flush {
+		return nil
+	}
+	return errors.Trace(w.Flush())
+}
+
+func MustEncodeArgs(w *bufio.Writer, args [][]byte) {
+	if err := EncodeArgs(w, args, true); err != nil {
+		log.PanicError(err, "encode redis args failed")
+	}
+}
+
 func EncodeToBytes(r Resp) ([]byte, error) {
 	var b bytes.Buffer
 	err := Encode(bufio.NewWriter(&b), r, true)
@@ -105,6 +137,24 @@ func (e *encoder) encodeResp(r Resp) error {
 	}
 }
 
+func (e *encoder) encodeArgs(args [][]byte) error {
+	if err := e.encodeType(typeArray); err != nil {
+		return err
+	}
+	if err := e.encodeInt(int64(len(args))); err != nil {
+		return err
+	}
+	for _, b := range args {
+		if err := e.encodeType(typeBulkBytes); err != nil {
+			return err
+		}
+		if err := e.encodeBulkBytes(b); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
 func (e *encoder) encodeType(t respType) error {
 	return errors.Trace(e.w.WriteByte(byte(t)))
 }
@@ -119,10 +169,6 @@ func (e *encoder) encodeText(s string) error {
 	return nil
 }
 
-func (e *encoder) encodeInt(v int64) error {
-	return e.encodeText(itos(v))
-}
-
 func (e *encoder) encodeBulkBytes(b []byte) error {
 	if b == nil {
 		return e.encodeInt(-1)
@@ -130,7 +176,11 @@ func (e *encoder) encodeBulkBytes(b []byte) error {
 		if err := e.encodeInt(int64(len(b))); err != nil {
 			return err
 		}
-		if _, err := e.w.Write(b); err != nil {
+		if e.v != nil && len(b) >= VectorSize {
+			if err := e.v.writeVector(b); err != nil {
+				return err
+			}
+		} else if _, err := e.w.Write(b); err != nil {
 			return errors.Trace(err)
 		}
 		if _, err := e.w.WriteString("\r\n"); err != nil {
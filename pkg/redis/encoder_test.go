@@ -4,21 +4,16 @@
 package redis
 
 import (
+	"bufio"
 	"bytes"
+	"io/ioutil"
+	"math"
 	"strconv"
 	"testing"
 
 	"github.com/CodisLabs/codis/pkg/utils/assert"
 )
 
-func TestItos(t *testing.T) {
-	for i := 0; i < len(imap)*2; i++ {
-		n, p := -i, i
-		assert.Must(strconv.Itoa(n) == itos(int64(n)))
-		assert.Must(strconv.Itoa(p) == itos(int64(p)))
-	}
-}
-
 func TestEncodeString(t *testing.T) {
 	resp := &String{"OK"}
 	testEncodeAndCheck(t, resp, []byte("+OK\r\n"))
@@ -31,9 +26,16 @@ func TestEncodeError(t *testing.T) {
 
 func TestEncodeInt(t *testing.T) {
 	resp := &Int{}
-	for _, v := range []int{-1, 0, 1024 * 1024} {
-		resp.Value = int64(v)
-		testEncodeAndCheck(t, resp, []byte(":"+strconv.FormatInt(int64(v), 10)+"\r\n"))
+	for _, v := range []int64{-1, 0, 1024 * 1024, math.MaxInt64, math.MinInt64} {
+		resp.Value = v
+		testEncodeAndCheck(t, resp, []byte(":"+strconv.FormatInt(v, 10)+"\r\n"))
+	}
+	for i := 0; i < 1024*1024; i++ {
+		n, p := -i, i
+		resp.Value = int64(n)
+		testEncodeAndCheck(t, resp, []byte(":"+strconv.Itoa(n)+"\r\n"))
+		resp.Value = int64(p)
+		testEncodeAndCheck(t, resp, []byte(":"+strconv.Itoa(p)+"\r\n"))
 	}
 }
 
@@ -66,3 +68,33 @@ func testEncodeAndCheck(t *testing.T, resp Resp, expect []byte) {
 	assert.MustNoError(err)
 	assert.Must(bytes.Equal(b, expect))
 }
+
+func BenchmarkEncodeArgs(b *testing.B) {
+	var args = [][]byte{[]byte("set"), []byte("key:000001"), bytes.Repeat([]byte("v"), 100)}
+	w := bufio.NewWriterSize(ioutil.Discard, 1024*64)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		assert.MustNoError(EncodeArgs(w, args, false))
+	}
+}
+
+func BenchmarkEncodeInt(b *testing.B) {
+	resp := &Int{}
+	w := bufio.NewWriterSize(ioutil.Discard, 1024*64)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		resp.Value = int64(i)
+		assert.MustNoError(Encode(w, resp, false))
+	}
+}
+
+func BenchmarkEncode(b *testing.B) {
+	resp, err := DecodeFromBytes(benchCommand)
+	assert.MustNoError(err)
+	w := bufio.NewWriterSize(ioutil.Discard, 1024*64)
+	b.SetBytes(int64(len(benchCommand)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		assert.MustNoError(Encode(w, resp, false))
+	}
+}
@@ -20,14 +20,14 @@ func NewHandlerTable(o interface{}) (map[string]HandlerFunc, error) {
 		return nil, errors.Errorf("handler is nil")
 	}
 	t := make(map[string]HandlerFunc)
-	r := reflect.TypeOf(o)
+	r, v := reflect.TypeOf(o), reflect.ValueOf(o)
 	for i := 0; i < r.NumMethod(); i++ {
 		m := r.Method(i)
-		if m.Name[0] < 'A' || m.Name[0] > 'Z' {
+		if m.Name[0] < 'A' || m.Name[0] > 'Z' || m.Name == "HandlerTable" {
 			continue
 		}
 		n := strings.ToLower(m.Name)
-		if h, err := createHandlerFunc(o, &m.Func); err != nil {
+		if h, err := createHandlerFunc(v.Method(i)); err != nil {
 			return nil, err
 		} else if _, exists := t[n]; exists {
 			return nil, errors.Errorf("func.name = '%s' has already exists", m.Name)
@@ -46,42 +46,20 @@ func MustHandlerTable(o interface{}) map[string]HandlerFunc {
 	return t
 }
 
-func createHandlerFunc(o interface{}, f *reflect.Value) (HandlerFunc, error) {
-	t := f.Type()
-	arg0Type := reflect.TypeOf((*interface{})(nil)).Elem()
-	argsType := reflect.TypeOf([][]byte{})
-	if t.NumIn() != 3 || t.In(1) != arg0Type || t.In(2) != argsType {
-		return nil, errors.Errorf("register with invalid func type = '%s'", t)
+// createHandlerFunc turns a method value into a typed func once, so calling
+// a handler doesn't build []reflect.Value for reflect.Value.Call. The method
+// value still goes through a reflect trampoline, see handlergen for a table
+// without it.
+func createHandlerFunc(m reflect.Value) (HandlerFunc, error) {
+	switch f := m.Interface().(type) {
+	case func(arg0 interface{}, args ...[]byte) (Resp, error):
+		return f, nil
+	case func(arg0 interface{}, args [][]byte) (Resp, error):
+		return func(arg0 interface{}, args ...[]byte) (Resp, error) {
+			return f(arg0, args)
+		}, nil
 	}
-	ret0Type := reflect.TypeOf((*Resp)(nil)).Elem()
-	ret1Type := reflect.TypeOf((*error)(nil)).Elem()
-	if t.NumOut() != 2 || t.Out(0) != ret0Type || t.Out(1) != ret1Type {
-		return nil, errors.Errorf("register with invalid func type = '%s'", t)
-	}
-	return func(arg0 interface{}, args ...[]byte) (Resp, error) {
-		var arg0Value reflect.Value
-		if arg0 == nil {
-			arg0Value = reflect.ValueOf((*interface{})(nil))
-		} else {
-			arg0Value = reflect.ValueOf(arg0)
-		}
-		var input, output []reflect.Value
-		input = []reflect.Value{reflect.ValueOf(o), arg0Value, reflect.ValueOf(args)}
-		if t.IsVariadic() {
-			output = f.CallSlice(input)
-		} else {
-			output = f.Call(input)
-		}
-		var ret0 Resp
-		var ret1 error
-		if i := output[0].Interface(); i != nil {
-			ret0 = i.(Resp)
-		}
-		if i := output[1].Interface(); i != nil {
-			ret1 = i.(error)
-		}
-		return ret0, ret1
-	}, nil
+	return nil, errors.Errorf("register with invalid func type = '%s'", m.Type())
 }
 
 func ParseArgs(resp Resp) (cmd string, args [][]byte, err error) {
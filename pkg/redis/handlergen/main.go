@@ -0,0 +1,182 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+// Command handlergen writes a HandlerTable method for a handler type, so that
+// redis.NewServer registers its methods as typed funcs instead of reflection:
+//
+//	//go:generate handlergen -type=Handler
+package main
+
+import (
+	"bytes"
+	"flag"
+	"fmt"
+	"go/ast"
+	"go/format"
+	"go/parser"
+	"go/token"
+	"io/ioutil"
+	"log"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+)
+
+type method struct {
+	name     string
+	variadic bool
+}
+
+type byName []method
+
+func (s byName) Len() int           { return len(s) }
+func (s byName) Less(i, j int) bool { return s[i].name < s[j].name }
+func (s byName) Swap(i, j int)      { s[i], s[j] = s[j], s[i] }
+
+func main() {
+	typ := flag.String("type", "", "handler type name")
+	dir := flag.String("dir", ".", "package directory")
+	output := flag.String("output", "", "output file, default is <type>_handlers.go")
+	flag.Parse()
+	if *typ == "" {
+		log.Fatal("please specify -type")
+	}
+	if *output == "" {
+		*output = filepath.Join(*dir, strings.ToLower(*typ)+"_handlers.go")
+	}
+	src, err := generate(*dir, *typ)
+	if err != nil {
+		log.Fatal(err)
+	}
+	if err := ioutil.WriteFile(*output, src, 0644); err != nil {
+		log.Fatal(err)
+	}
+}
+
+// generate returns the source of the HandlerTable method of typ, a type of
+// the package in dir.
+func generate(dir, typ string) ([]byte, error) {
+	fset := token.NewFileSet()
+	pkgs, err := parser.ParseDir(fset, dir, func(fi os.FileInfo) bool {
+		return !strings.HasSuffix(fi.Name(), "_test.go")
+	}, 0)
+	if err != nil {
+		return nil, err
+	}
+	if len(pkgs) != 1 {
+		return nil, fmt.Errorf("expect one package in '%s', got %d", dir, len(pkgs))
+	}
+	var pkg *ast.Package
+	for _, p := range pkgs {
+		pkg = p
+	}
+
+	var ptr bool
+	var methods []method
+	for _, f := range pkg.Files {
+		for _, d := range f.Decls {
+			fn, ok := d.(*ast.FuncDecl)
+			if !ok || fn.Recv == nil || !fn.Name.IsExported() || fn.Name.Name == "HandlerTable" {
+				continue
+			}
+			recv, isptr := receiverName(fn.Recv.List[0].Type)
+			if recv != typ {
+				continue
+			}
+			variadic, ok := handlerShape(fn.Type)
+			if !ok {
+				return nil, fmt.Errorf("%s.%s is not a handler", typ, fn.Name.Name)
+			}
+			ptr = ptr || isptr
+			methods = append(methods, method{fn.Name.Name, variadic})
+		}
+	}
+	if len(methods) == 0 {
+		return nil, fmt.Errorf("no handler of type %s", typ)
+	}
+	sort.Sort(byName(methods))
+
+	q := "redis."
+	if pkg.Name == "redis" {
+		q = ""
+	}
+	var b bytes.Buffer
+	fmt.Fprintf(&b, "// Code generated by handlergen -type=%s; DO NOT EDIT.\n\n", typ)
+	fmt.Fprintf(&b, "package %s\n\n", pkg.Name)
+	if q != "" {
+		fmt.Fprintf(&b, "import \"github.com/CodisLabs/redis-port/pkg/redis\"\n\n")
+	}
+	recv := typ
+	if ptr {
+		recv = "*" + recv
+	}
+	fmt.Fprintf(&b, "func (h %s) HandlerTable() %sHandlerTable {\n", recv, q)
+	fmt.Fprintf(&b, "\treturn %sHandlerTable{\n", q)
+	for _, m := range methods {
+		if m.variadic {
+			fmt.Fprintf(&b, "\t\t%q: h.%s,\n", strings.ToLower(m.name), m.name)
+		} else {
+			fmt.Fprintf(&b, "\t\t%q: func(arg0 interface{}, args ...[]byte) (%sResp, error) {\n", strings.ToLower(m.name), q)
+			fmt.Fprintf(&b, "\t\t\treturn h.%s(arg0, args)\n\t\t},\n", m.name)
+		}
+	}
+	fmt.Fprintf(&b, "\t}\n}\n")
+	return format.Source(b.Bytes())
+}
+
+func receiverName(x ast.Expr) (string, bool) {
+	if star, ok := x.(*ast.StarExpr); ok {
+		name, _ := receiverName(star.X)
+		return name, true
+	}
+	if id, ok := x.(*ast.Ident); ok {
+		return id.Name, false
+	}
+	return "", false
+}
+
+// handlerShape checks for func(interface{}, ...[]byte) (Resp, error), with
+// either a variadic or a [][]byte last parameter.
+func handlerShape(t *ast.FuncType) (bool, bool) {
+	var params []ast.Expr
+	for _, f := range t.Params.List {
+		n := len(f.Names)
+		if n == 0 {
+			n = 1
+		}
+		for i := 0; i < n; i++ {
+			params = append(params, f.Type)
+		}
+	}
+	if len(params) != 2 || t.Results == nil || len(t.Results.List) != 2 {
+		return false, false
+	}
+	if it, ok := params[0].(*ast.InterfaceType); !ok || len(it.Methods.List) != 0 {
+		return false, false
+	}
+	var variadic bool
+	switch x := params[1].(type) {
+	case *ast.Ellipsis:
+		variadic = true
+		if !isBytes(x.Elt) {
+			return false, false
+		}
+	case *ast.ArrayType:
+		if x.Len != nil || !isBytes(x.Elt) {
+			return false, false
+		}
+	default:
+		return false, false
+	}
+	return variadic, true
+}
+
+func isBytes(x ast.Expr) bool {
+	a, ok := x.(*ast.ArrayType)
+	if !ok || a.Len != nil {
+		return false
+	}
+	id, ok := a.Elt.(*ast.Ident)
+	return ok && id.Name == "byte"
+}
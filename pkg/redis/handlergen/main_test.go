@@ -0,0 +1,68 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bytes"
+	"io/ioutil"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+)
+
+func TestGenerate(t *testing.T) {
+	src, err := generate("testdata", "Handler")
+	assert.MustNoError(err)
+	assert.Must(bytes.HasPrefix(src, []byte("// Code generated by handlergen -type=Handler; DO NOT EDIT.")))
+	assert.Must(bytes.Contains(src, []byte("func (h *Handler) HandlerTable() redis.HandlerTable {")))
+	assert.Must(bytes.Contains(src, []byte(`"get":  h.Get,`)))
+	assert.Must(bytes.Contains(src, []byte("return h.Set(arg0, args)")))
+	assert.Must(!bytes.Contains(src, []byte("unexported")))
+
+	_, err = generate("testdata", "Missing")
+	assert.Must(err != nil)
+}
+
+// TestGenerateBuild builds the fixture with its generated table and runs it,
+// the fixture dispatches through both the table and reflection.
+func TestGenerateBuild(t *testing.T) {
+	if testing.Short() {
+		t.Skip("skip building the fixture in short mode")
+	}
+	src, err := generate("testdata", "Handler")
+	assert.MustNoError(err)
+
+	dir, err := ioutil.TempDir("", "handlergen")
+	assert.MustNoError(err)
+	defer os.RemoveAll(dir)
+	files := []string{"handler_handlers.go"}
+	assert.MustNoError(ioutil.WriteFile(filepath.Join(dir, files[0]), src, 0644))
+	for _, name := range []string{"handler.go", "main.go"} {
+		b, err := ioutil.ReadFile(filepath.Join("testdata", name))
+		assert.MustNoError(err)
+		assert.MustNoError(ioutil.WriteFile(filepath.Join(dir, name), b, 0644))
+		files = append(files, name)
+	}
+
+	cmd := exec.Command(filepath.Join(runtime.GOROOT(), "bin", "go"), append([]string{"run"}, files...)...)
+	cmd.Dir = dir
+	out, err := cmd.CombinedOutput()
+	if err != nil {
+		t.Fatalf("run fixture failed: %s\n%s", err, out)
+	}
+	assert.Must(strings.Join([]string{
+		`3 handlers`,
+		`[PING]: "+PONG\r\n"`,
+		`[set k v]: "+OK\r\n"`,
+		`[GET k]: "$1\r\nv\r\n"`,
+		`[get x]: ""`,
+		`[get]: error`,
+		`[del k]: error`,
+	}, "\n")+"\n" == string(out))
+}
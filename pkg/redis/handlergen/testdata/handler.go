@@ -0,0 +1,41 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"errors"
+
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+// Handler is the fixture of TestGenerate, with both forms of handlers.
+type Handler struct {
+	values map[string][]byte
+}
+
+func (h *Handler) Get(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	if len(args) != 1 {
+		return nil, errors.New("wrong number of arguments for 'get' command")
+	}
+	if v, ok := h.values[string(args[0])]; ok {
+		return redis.NewBulkBytes(v), nil
+	}
+	return nil, nil
+}
+
+func (h *Handler) Set(arg0 interface{}, args [][]byte) (redis.Resp, error) {
+	if len(args) != 2 {
+		return nil, errors.New("wrong number of arguments for 'set' command")
+	}
+	h.values[string(args[0])] = args[1]
+	return redis.NewString("OK"), nil
+}
+
+func (h *Handler) Ping(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	return redis.NewString("PONG"), nil
+}
+
+func (h *Handler) unexported(arg0 interface{}, args ...[]byte) (redis.Resp, error) {
+	return nil, nil
+}
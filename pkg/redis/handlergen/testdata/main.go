@@ -0,0 +1,53 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package main
+
+import (
+	"bytes"
+	"fmt"
+	"os"
+
+	"github.com/CodisLabs/redis-port/pkg/redis"
+)
+
+// main dispatches through the table written by handlergen and through the
+// one built by reflection, and prints the replies once they agree.
+func main() {
+	g := &Handler{values: make(map[string][]byte)}
+	r := &Handler{values: make(map[string][]byte)}
+	gs := redis.MustServer(g)
+	rs, err := redis.NewServerWithTable(redis.MustHandlerTable(r))
+	if err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(1)
+	}
+	fmt.Printf("%d handlers\n", len(g.HandlerTable()))
+	for _, c := range [][]string{
+		{"PING"}, {"set", "k", "v"}, {"GET", "k"}, {"get", "x"}, {"get"}, {"del", "k"},
+	} {
+		var args []interface{}
+		for _, a := range c[1:] {
+			args = append(args, a)
+		}
+		cmd := redis.NewCommand(c[0], args...)
+		a, aerr := gs.Dispatch(nil, cmd)
+		b, berr := rs.Dispatch(nil, cmd)
+		if (aerr == nil) != (berr == nil) || !bytes.Equal(encode(a), encode(b)) {
+			fmt.Fprintf(os.Stderr, "%v: %q %v != %q %v\n", c, encode(a), aerr, encode(b), berr)
+			os.Exit(1)
+		}
+		if aerr != nil {
+			fmt.Printf("%v: error\n", c)
+		} else {
+			fmt.Printf("%v: %q\n", c, encode(a))
+		}
+	}
+}
+
+func encode(r redis.Resp) []byte {
+	if r == nil {
+		return nil
+	}
+	return redis.MustEncodeToBytes(r)
+}
@@ -0,0 +1,125 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package redis
+
+import (
+	"bufio"
+	"io"
+	"net"
+	"time"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+)
+
+const (
+	DefaultMaxConns       = 10000
+	DefaultMaxRequestSize = MaxBulkBytesLen
+
+	serveBufferSize = 64 * 1024
+)
+
+var nullBulk = &BulkBytes{}
+
+// Serve accepts connections on l and serves each of them in its own goroutine
+// until l is closed. Handlers get the net.Conn as arg0. Pipelined requests are
+// dispatched as they are decoded, and the replies to all requests that arrived
+// together are sent with a single flush. A handler that returns a nil Resp
+// replies with a null bulk, and an error is sent back as '-ERR'.
+func (s *Server) Serve(l net.Listener) error {
+	maxConns := s.MaxConns
+	if maxConns <= 0 {
+		maxConns = DefaultMaxConns
+	}
+	var delay time.Duration
+	for {
+		c, err := l.Accept()
+		if err != nil {
+			if e, ok := err.(net.Error); ok && e.Temporary() {
+				if delay == 0 {
+					delay = 5 * time.Millisecond
+				} else if delay *= 2; delay > time.Second {
+					delay = time.Second
+				}
+				log.WarnErrorf(err, "accept failed, retry in %v", delay)
+				time.Sleep(delay)
+				continue
+			}
+			return errors.Trace(err)
+		}
+		delay = 0
+		if s.conns.Incr() > int64(maxConns) {
+			s.conns.Decr()
+			go func() {
+				defer c.Close()
+				c.SetWriteDeadline(time.Now().Add(time.Second))
+				io.WriteString(c, "-ERR max number of clients reached\r\n")
+			}()
+			continue
+		}
+		go func() {
+			defer s.conns.Decr()
+			s.serveConn(c)
+		}()
+	}
+}
+
+// NumConns returns the number of connections being served.
+func (s *Server) NumConns() int {
+	return int(s.conns.Get())
+}
+
+func (s *Server) serveConn(c net.Conn) {
+	defer func() {
+		c.Close()
+		if s.OnClose != nil {
+			s.OnClose(c)
+		}
+	}()
+	r := bufio.NewReaderSize(c, serveBufferSize)
+	w := NewWriterSize(c, serveBufferSize, nil)
+	d := NewCommandDecoder(r)
+	if s.MaxRequestSize > 0 {
+		d.SetMaxRequestSize(s.MaxRequestSize)
+	} else {
+		d.SetMaxRequestSize(DefaultMaxRequestSize)
+	}
+	for {
+		cmd, err := d.Decode()
+		for err == nil && cmd != nil {
+			if err := w.Encode(s.call(c, cmd), false); err != nil {
+				return
+			}
+			cmd, err = d.TryDecode()
+		}
+		if err != nil {
+			if errors.Equal(err, io.EOF) {
+				return
+			}
+			if _, ok := errors.Cause(err).(net.Error); ok {
+				return
+			}
+			log.WarnErrorf(err, "serve %s failed", c.RemoteAddr())
+			w.Encode(&Error{"ERR Protocol error: " + errors.Cause(err).Error()}, true)
+			return
+		}
+		if s.BeforeFlush != nil {
+			s.BeforeFlush(c)
+		}
+		if err := w.Flush(); err != nil {
+			return
+		}
+	}
+}
+
+func (s *Server) call(c net.Conn, cmd *Command) Resp {
+	r, err := s.DispatchCommand(c, cmd)
+	switch {
+	case err != nil:
+		return &Error{"ERR " + errors.Cause(err).Error()}
+	case r == nil:
+		return nullBulk
+	}
+	return r
+}
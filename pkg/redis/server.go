@@ -3,37 +3,196 @@
 
 package redis
 
-import "github.com/CodisLabs/codis/pkg/utils/errors"
+import (
+	"net"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/log"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+)
 
 type Server struct {
 	t HandlerTable
+	x *handlerIndex
+
+	// MaxConns and MaxRequestSize bound Serve, zero means the defaults.
+	MaxConns       int
+	MaxRequestSize int
+
+	// Fallback, if set, handles the commands that have no handler, with the
+	// name of the command as args[0].
+	Fallback HandlerFunc
+
+	// BeforeFlush, if set, is called by Serve before the replies to the
+	// requests that arrived together are flushed, e.g. to inject latency.
+	BeforeFlush func(c net.Conn)
+
+	// OnClose, if set, is called by Serve once a connection has been closed,
+	// e.g. to drop the state kept for it.
+	OnClose func(c net.Conn)
+
+	conns atomic2.Int64
 }
 
+// NewServer registers the exported methods of o. If o has a HandlerTable
+// method, e.g. one written by handlergen, its table is used instead of
+// reflection, which keeps every call free of allocations.
 func NewServer(o interface{}) (*Server, error) {
+	if x, ok := o.(interface {
+		HandlerTable() HandlerTable
+	}); ok {
+		return NewServerWithTable(x.HandlerTable())
+	}
 	t, err := NewHandlerTable(o)
 	if err != nil {
 		return nil, err
 	}
-	return &Server{t}, nil
+	return NewServerWithTable(t)
 }
 
 func NewServerWithTable(t HandlerTable) (*Server, error) {
 	if t == nil {
 		return nil, errors.Errorf("handler table is nil")
 	}
-	return &Server{t}, nil
+	x, err := newHandlerIndex(t)
+	if err != nil {
+		return nil, err
+	}
+	return &Server{t: t, x: x}, nil
 }
 
 func MustServer(o interface{}) *Server {
-	return &Server{MustHandlerTable(o)}
+	s, err := NewServer(o)
+	if err != nil {
+		log.PanicError(err, "create redis server failed")
+	}
+	return s
+}
+
+// Lookup returns the handler of command name, regardless of its case.
+func (s *Server) Lookup(name []byte) HandlerFunc {
+	return s.x.lookup(name)
 }
 
 func (s *Server) Dispatch(arg0 interface{}, resp Resp) (Resp, error) {
-	if cmd, args, err := ParseArgs(resp); err != nil {
+	a, err := AsArray(resp, nil)
+	if err != nil {
 		return nil, err
-	} else if f := s.t[cmd]; f == nil {
-		return nil, errors.Errorf("unknown command '%s'", cmd)
-	} else {
-		return f(arg0, args...)
+	} else if len(a) == 0 {
+		return nil, errors.Errorf("empty array")
+	}
+	bs := make([][]byte, len(a))
+	for i := 0; i < len(a); i++ {
+		b, err := AsBulkBytes(a[i], nil)
+		if err != nil {
+			return nil, err
+		}
+		bs[i] = b
+	}
+	return s.dispatch(arg0, bs)
+}
+
+// DispatchCommand calls the handler of a decoded command, it doesn't allocate
+// unless the handler does.
+func (s *Server) DispatchCommand(arg0 interface{}, c *Command) (Resp, error) {
+	if len(c.Args) == 0 {
+		return nil, errors.Errorf("empty array")
+	}
+	return s.dispatch(arg0, c.Args)
+}
+
+func (s *Server) dispatch(arg0 interface{}, args [][]byte) (Resp, error) {
+	if len(args[0]) == 0 {
+		return nil, errors.Errorf("empty command")
+	}
+	f := s.x.lookup(args[0])
+	if f == nil && s.Fallback != nil {
+		return s.Fallback(arg0, args...)
+	}
+	if f == nil {
+		return nil, errors.Errorf("unknown command '%s'", args[0])
+	}
+	return f(arg0, args[1:]...)
+}
+
+// handlerIndex is a perfect hash of the handler names: seed is picked so that
+// no two names fall into the same slot, a lookup hashes the name folded to
+// lower case and compares it with the only candidate.
+type handlerIndex struct {
+	seed  uint32
+	mask  uint32
+	slots []handlerSlot
+}
+
+type handlerSlot struct {
+	name []byte
+	f    HandlerFunc
+}
+
+func newHandlerIndex(t HandlerTable) (*handlerIndex, error) {
+	size := uint32(1)
+	for size < uint32(len(t))*2 {
+		size <<= 1
+	}
+	for ; size <= uint32(len(t))*64+64; size <<= 1 {
+	next:
+		for seed := uint32(1); seed <= 1024; seed++ {
+			x := &handlerIndex{seed: seed, mask: size - 1, slots: make([]handlerSlot, size)}
+			for name, f := range t {
+				if len(name) == 0 {
+					return nil, errors.Errorf("empty command name")
+				}
+				slot := &x.slots[hashCommand(seed, []byte(name))&x.mask]
+				if slot.name != nil {
+					if equalFold(slot.name, []byte(name)) {
+						return nil, errors.Errorf("func.name = '%s' has already exists", name)
+					}
+					continue next
+				}
+				slot.name, slot.f = []byte(name), f
+			}
+			return x, nil
+		}
+	}
+	return nil, errors.Errorf("build handler index failed")
+}
+
+func (x *handlerIndex) lookup(name []byte) HandlerFunc {
+	slot := &x.slots[hashCommand(x.seed, name)&x.mask]
+	if slot.f != nil && equalFold(slot.name, name) {
+		return slot.f
+	}
+	return nil
+}
+
+// hashCommand is FNV-1a of p folded to lower case.
+func hashCommand(seed uint32, p []byte) uint32 {
+	h := uint32(2166136261) ^ seed
+	for _, c := range p {
+		if c >= 'A' && c <= 'Z' {
+			c += 'a' - 'A'
+		}
+		h ^= uint32(c)
+		h *= 16777619
+	}
+	return h
+}
+
+func equalFold(a, b []byte) bool {
+	if len(a) != len(b) {
+		return false
+	}
+	for i := 0; i < len(a); i++ {
+		x, y := a[i], b[i]
+		if x >= 'A' && x <= 'Z' {
+			x += 'a' - 'A'
+		}
+		if y >= 'A' && y <= 'Z' {
+			y += 'a' - 'A'
+		}
+		if x != y {
+			return false
+		}
 	}
+	return true
 }
@@ -6,9 +6,15 @@ package redis
 import (
 	"bufio"
 	"bytes"
+	"net"
+	"strconv"
+	"strings"
 	"testing"
+	"time"
 
 	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
 )
 
 type testHandler struct {
@@ -66,3 +72,246 @@ func TestServerServe(t *testing.T) {
 	assert.MustNoError(err)
 	testmapcount(t, h.c, map[string]int{"foo": 1})
 }
+
+func TestDispatchCommand(t *testing.T) {
+	h := &testHandler{make(map[string]int)}
+	s, err := NewServer(h)
+	assert.MustNoError(err)
+	d := NewCommandDecoder(bufio.NewReader(bytes.NewReader([]byte("*2\r\n$3\r\nSeT\r\n$3\r\nfoo\r\n*3\r\n$3\r\nGET\r\n$3\r\nfoo\r\n$3\r\nbar\r\n*1\r\n$3\r\nDEL\r\n"))))
+	for i := 0; i < 2; i++ {
+		c, err := d.Decode()
+		assert.MustNoError(err)
+		_, err = s.DispatchCommand(nil, c)
+		assert.MustNoError(err)
+	}
+	testmapcount(t, h.c, map[string]int{"foo": 2, "bar": 1})
+	c, err := d.Decode()
+	assert.MustNoError(err)
+	_, err = s.DispatchCommand(nil, c)
+	assert.Must(err != nil)
+}
+
+func TestHandlerIndex(t *testing.T) {
+	tb := make(HandlerTable)
+	for i := 0; i < 500; i++ {
+		n := i
+		tb[strconv.Itoa(i)+"cmd"] = func(arg0 interface{}, args ...[]byte) (Resp, error) {
+			return &Int{int64(n)}, nil
+		}
+	}
+	s, err := NewServerWithTable(tb)
+	assert.MustNoError(err)
+	for i := 0; i < 1000; i++ {
+		f := s.Lookup([]byte(strconv.Itoa(i) + "CMD"))
+		if i >= 500 {
+			assert.Must(f == nil)
+			continue
+		}
+		r, err := f(nil)
+		assert.MustNoError(err)
+		assert.Must(r.(*Int).Value == int64(i))
+	}
+	_, err = NewServerWithTable(HandlerTable{"get": tb["1cmd"], "GET": tb["2cmd"]})
+	assert.Must(err != nil)
+}
+
+type benchHandler struct{}
+
+func (h *benchHandler) Get(arg0 interface{}, args ...[]byte) (Resp, error) { return nil, nil }
+func (h *benchHandler) Set(arg0 interface{}, args [][]byte) (Resp, error)  { return nil, nil }
+func (h *benchHandler) Del(arg0 interface{}, args ...[]byte) (Resp, error) { return nil, nil }
+func (h *benchHandler) Ping(arg0 interface{}, args ...[]byte) (Resp, error) {
+	return nil, nil
+}
+
+// HandlerTable is what handlergen writes for benchHandler, whose output is
+// built and dispatched through by TestGenerateBuild of handlergen.
+func (h *benchHandler) HandlerTable() HandlerTable {
+	return HandlerTable{
+		"del":  h.Del,
+		"get":  h.Get,
+		"ping": h.Ping,
+		"set": func(arg0 interface{}, args ...[]byte) (Resp, error) {
+			return h.Set(arg0, args)
+		},
+	}
+}
+
+func BenchmarkDispatch(b *testing.B) {
+	s, err := NewServerWithTable(MustHandlerTable(&benchHandler{}))
+	assert.MustNoError(err)
+	resp := NewCommand("SET", "key", "value")
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := s.Dispatch(nil, resp); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkDispatchCommandReflect(b *testing.B) {
+	s, err := NewServerWithTable(MustHandlerTable(&benchHandler{}))
+	assert.MustNoError(err)
+	c := &Command{Args: [][]byte{[]byte("SET"), []byte("key"), []byte("value")}}
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := s.DispatchCommand(nil, c); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkDispatchCommand(b *testing.B) {
+	s := MustServer(&benchHandler{})
+	c := &Command{Args: [][]byte{[]byte("SET"), []byte("key"), []byte("value")}}
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := s.DispatchCommand(nil, c); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+type serveHandler struct{}
+
+func (h *serveHandler) Echo(arg0 interface{}, args ...[]byte) (Resp, error) {
+	if len(args) != 1 {
+		return nil, errors.Errorf("wrong number of arguments")
+	}
+	return NewBulkBytes(args[0]), nil
+}
+
+func (h *serveHandler) Nop(arg0 interface{}, args ...[]byte) (Resp, error) {
+	return nil, nil
+}
+
+func TestServe(t *testing.T) {
+	s := MustServer(&serveHandler{})
+	s.MaxConns, s.MaxRequestSize = 1, 1024
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	defer l.Close()
+	go s.Serve(l)
+
+	c, err := net.Dial("tcp", l.Addr().String())
+	assert.MustNoError(err)
+	defer c.Close()
+	r := bufio.NewReader(c)
+	var req bytes.Buffer
+	for i := 0; i < 100; i++ {
+		req.Write(MustEncodeToBytes(NewCommand("ECHO", strconv.Itoa(i))))
+	}
+	req.WriteString("nop\r\n*1\r\n$4\r\necho\r\n*1\r\n$3\r\nbad\r\n")
+	_, err = c.Write(req.Bytes())
+	assert.MustNoError(err)
+	for i := 0; i < 100; i++ {
+		resp, err := Decode(r)
+		assert.MustNoError(err)
+		assert.Must(string(resp.(*BulkBytes).Value) == strconv.Itoa(i))
+	}
+	resp, err := Decode(r)
+	assert.MustNoError(err)
+	assert.Must(resp.(*BulkBytes).Value == nil)
+	for i := 0; i < 2; i++ {
+		resp, err := Decode(r)
+		assert.MustNoError(err)
+		_, ok := resp.(*Error)
+		assert.Must(ok)
+	}
+
+	c2, err := net.Dial("tcp", l.Addr().String())
+	assert.MustNoError(err)
+	defer c2.Close()
+	resp, err = Decode(bufio.NewReader(c2))
+	assert.MustNoError(err)
+	assert.Must(resp.(*Error).Value == "ERR max number of clients reached")
+
+	_, err = c.Write(MustEncodeToBytes(NewCommand("ECHO", string(make([]byte, 2048)))))
+	assert.MustNoError(err)
+	resp, err = Decode(r)
+	assert.MustNoError(err)
+	assert.Must(resp.(*Error).Value == "ERR Protocol error: request is too large")
+	_, err = Decode(r)
+	assert.Must(err != nil)
+}
+
+func TestServeHooks(t *testing.T) {
+	s := MustServer(&serveHandler{})
+	s.Fallback = func(arg0 interface{}, args ...[]byte) (Resp, error) {
+		return NewString(strings.ToLower(string(args[0]))), nil
+	}
+	var batches atomic2.Int64
+	s.BeforeFlush = func(c net.Conn) {
+		batches.Incr()
+		time.Sleep(time.Millisecond * 20)
+	}
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	defer l.Close()
+	go s.Serve(l)
+
+	c, err := net.Dial("tcp", l.Addr().String())
+	assert.MustNoError(err)
+	defer c.Close()
+	r := bufio.NewReader(c)
+	start := time.Now()
+	_, err = c.Write(append(MustEncodeToBytes(NewCommand("ECHO", "a")), MustEncodeToBytes(NewCommand("FOO", "b"))...))
+	assert.MustNoError(err)
+	resp, err := Decode(r)
+	assert.MustNoError(err)
+	assert.Must(string(resp.(*BulkBytes).Value) == "a")
+	resp, err = Decode(r)
+	assert.MustNoError(err)
+	assert.Must(resp.(*String).Value == "foo")
+	assert.Must(time.Since(start) >= time.Millisecond*20 && batches.Get() >= 1)
+}
+
+func TestServeOnClose(t *testing.T) {
+	s := MustServer(&serveHandler{})
+	closed := make(chan net.Conn, 1)
+	s.OnClose = func(c net.Conn) {
+		closed <- c
+	}
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	defer l.Close()
+	go s.Serve(l)
+
+	c, err := net.Dial("tcp", l.Addr().String())
+	assert.MustNoError(err)
+	c.Close()
+	select {
+	case x := <-closed:
+		assert.Must(x.RemoteAddr().String() == c.LocalAddr().String())
+	case <-time.After(time.Second * 5):
+		t.Fatal("OnClose is not called")
+	}
+}
+
+func BenchmarkServePipeline(b *testing.B) {
+	s := MustServer(&serveHandler{})
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	defer l.Close()
+	go s.Serve(l)
+	c, err := net.Dial("tcp", l.Addr().String())
+	assert.MustNoError(err)
+	defer c.Close()
+	const batch = 128
+	var req bytes.Buffer
+	for i := 0; i < batch; i++ {
+		req.Write(MustEncodeToBytes(NewCommand("ECHO", "value")))
+	}
+	r := bufio.NewReader(c)
+	b.SetBytes(int64(req.Len() / batch))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i += batch {
+		go c.Write(req.Bytes())
+		for j := 0; j < batch; j++ {
+			if _, err := Decode(r); err != nil {
+				b.Fatal(err)
+			}
+		}
+	}
+}
@@ -0,0 +1,108 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package redis
+
+import (
+	"bufio"
+	"io"
+
+	"github.com/CodisLabs/codis/pkg/utils/errors"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+)
+
+// VectorSize is the smallest payload that Writer sends without copying it
+// into its buffer.
+var VectorSize = 64 * 1024
+
+// Writer is a bufio.Writer on a connection that hands payloads of at least
+// VectorSize bytes to the kernel together with the buffered bytes in a single
+// writev, instead of copying them into the buffer first. Payloads are never
+// retained, so they may be reused as soon as the call returns.
+type Writer struct {
+	*bufio.Writer
+	sink vectorSink
+}
+
+// vectorSink takes the bytes flushed by the bufio.Writer, and holds them back
+// while a payload is being queued behind them.
+type vectorSink struct {
+	w     io.Writer
+	hold  bool
+	bufs  [][]byte
+	count *atomic2.Int64
+}
+
+func (s *vectorSink) Write(p []byte) (int, error) {
+	if s.hold {
+		s.bufs = append(s.bufs, p)
+		return len(p), nil
+	}
+	n, err := s.w.Write(p)
+	if s.count != nil {
+		s.count.Add(int64(n))
+	}
+	return n, err
+}
+
+// NewWriterSize returns a Writer on w, usually a net.Conn, and adds the bytes
+// it writes to count if it is not nil.
+func NewWriterSize(w io.Writer, size int, count *atomic2.Int64) *Writer {
+	x := &Writer{}
+	x.sink.w, x.sink.count = w, count
+	x.Writer = bufio.NewWriterSize(&x.sink, size)
+	return x
+}
+
+func (w *Writer) Write(p []byte) (int, error) {
+	if len(p) < VectorSize {
+		return w.Writer.Write(p)
+	}
+	if err := w.writeVector(p); err != nil {
+		return 0, err
+	}
+	return len(p), nil
+}
+
+func (w *Writer) writeVector(p []byte) error {
+	s := &w.sink
+	s.hold = true
+	err := w.Writer.Flush()
+	s.hold = false
+	if err != nil {
+		s.bufs = s.bufs[:0]
+		return errors.Trace(err)
+	}
+	s.bufs = append(s.bufs, p)
+	n, err := writev(s.w, s.bufs)
+	if s.count != nil {
+		s.count.Add(n)
+	}
+	for i := range s.bufs {
+		s.bufs[i] = nil
+	}
+	s.bufs = s.bufs[:0]
+	return errors.Trace(err)
+}
+
+func (w *Writer) Encode(r Resp, flush bool) error {
+	e := &encoder{w.Writer, w}
+	if err := e.encodeResp(r); err != nil {
+		return err
+	}
+	if !flush {
+		return nil
+	}
+	return errors.Trace(w.Flush())
+}
+
+func (w *Writer) EncodeArgs(args [][]byte, flush bool) error {
+	e := &encoder{w.Writer, w}
+	if err := e.encodeArgs(args); err != nil {
+		return err
+	}
+	if !flush {
+		return nil
+	}
+	return errors.Trace(w.Flush())
+}
@@ -0,0 +1,117 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+package redis
+
+import (
+	"bufio"
+	"bytes"
+	"io"
+	"io/ioutil"
+	"net"
+	"testing"
+
+	"github.com/CodisLabs/codis/pkg/utils/assert"
+	"github.com/CodisLabs/codis/pkg/utils/sync2/atomic2"
+)
+
+func TestWriter(t *testing.T) {
+	defer func(n int) {
+		VectorSize = n
+	}(VectorSize)
+	VectorSize = 16
+
+	var args [][]byte
+	for i := 0; i < 64; i++ {
+		args = append(args, bytes.Repeat([]byte{byte('a' + i%26)}, i))
+	}
+	var expect bytes.Buffer
+	bw := bufio.NewWriterSize(&expect, 32)
+	for i := 0; i < 4; i++ {
+		assert.MustNoError(EncodeArgs(bw, args, false))
+		_, err := bw.Write(args[i*8])
+		assert.MustNoError(err)
+	}
+	assert.MustNoError(Encode(bw, NewCommand("set", "key", string(args[32])), true))
+
+	var b bytes.Buffer
+	var count atomic2.Int64
+	w := NewWriterSize(&b, 32, &count)
+	for i := 0; i < 4; i++ {
+		assert.MustNoError(w.EncodeArgs(args, false))
+		_, err := w.Write(args[i*8])
+		assert.MustNoError(err)
+	}
+	assert.MustNoError(w.Encode(NewCommand("set", "key", string(args[32])), true))
+
+	assert.Must(bytes.Equal(b.Bytes(), expect.Bytes()))
+	assert.Must(count.Get() == int64(b.Len()))
+}
+
+func openLoopback(tb testing.TB, discard bool) (net.Conn, net.Conn) {
+	l, err := net.Listen("tcp", "127.0.0.1:0")
+	assert.MustNoError(err)
+	defer l.Close()
+	c, err := net.Dial("tcp", l.Addr().String())
+	assert.MustNoError(err)
+	s, err := l.Accept()
+	assert.MustNoError(err)
+	if discard {
+		go io.Copy(ioutil.Discard, s)
+	}
+	return c, s
+}
+
+func TestWriterConn(t *testing.T) {
+	c, s := openLoopback(t, false)
+	defer c.Close()
+	defer s.Close()
+	sizes := []int{0, 1, VectorSize - 1, VectorSize, 1024 * 1024 * 3}
+	go func() {
+		w := NewWriterSize(c, 1024, nil)
+		for _, n := range sizes {
+			assert.MustNoError(w.EncodeArgs([][]byte{[]byte("set"), []byte("key"), make([]byte, n)}, false))
+		}
+		assert.MustNoError(w.Flush())
+	}()
+	d := NewCommandDecoder(bufio.NewReader(s))
+	for _, n := range sizes {
+		cmd, err := d.Decode()
+		assert.MustNoError(err)
+		assert.Must(cmd.Is("set") && len(cmd.Args[2]) == n)
+	}
+}
+
+func benchmarkEncodeBulk(b *testing.B, size int, vector bool) {
+	c, s := openLoopback(b, true)
+	defer c.Close()
+	defer s.Close()
+	args := [][]byte{[]byte("restore"), []byte("key"), []byte("0"), make([]byte, size)}
+	var encode func() error
+	if vector {
+		w := NewWriterSize(c, 1024*64, nil)
+		encode = func() error {
+			return w.EncodeArgs(args, true)
+		}
+	} else {
+		w := bufio.NewWriterSize(c, 1024*64)
+		encode = func() error {
+			return EncodeArgs(w, args, true)
+		}
+	}
+	b.SetBytes(int64(size))
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		assert.MustNoError(encode())
+	}
+}
+
+func BenchmarkEncodeBulk4K(b *testing.B)  { benchmarkEncodeBulk(b, 1024*4, false) }
+func BenchmarkVectorBulk4K(b *testing.B)  { benchmarkEncodeBulk(b, 1024*4, true) }
+func BenchmarkEncodeBulk64K(b *testing.B) { benchmarkEncodeBulk(b, 1024*64, false) }
+func BenchmarkVectorBulk64K(b *testing.B) { benchmarkEncodeBulk(b, 1024*64, true) }
+func BenchmarkEncodeBulk1M(b *testing.B)  { benchmarkEncodeBulk(b, 1024*1024, false) }
+func BenchmarkVectorBulk1M(b *testing.B)  { benchmarkEncodeBulk(b, 1024*1024, true) }
+func BenchmarkEncodeBulk8M(b *testing.B)  { benchmarkEncodeBulk(b, 1024*1024*8, false) }
+func BenchmarkVectorBulk8M(b *testing.B)  { benchmarkEncodeBulk(b, 1024*1024*8, true) }
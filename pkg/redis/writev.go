@@ -0,0 +1,18 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+//go:build go1.8
+// +build go1.8
+
+package redis
+
+import (
+	"io"
+	"net"
+)
+
+// writev writes bufs with a single writev if w is a net.Conn.
+func writev(w io.Writer, bufs [][]byte) (int64, error) {
+	v := net.Buffers(bufs)
+	return v.WriteTo(w)
+}
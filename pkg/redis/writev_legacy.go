@@ -0,0 +1,21 @@
+// Copyright 2016 CodisLabs. All Rights Reserved.
+// Licensed under the MIT (MIT-LICENSE.txt) license.
+
+//go:build !go1.8
+// +build !go1.8
+
+package redis
+
+import "io"
+
+func writev(w io.Writer, bufs [][]byte) (int64, error) {
+	var n int64
+	for _, p := range bufs {
+		x, err := w.Write(p)
+		n += int64(x)
+		if err != nil {
+			return n, err
+		}
+	}
+	return n, nil
+}